@@ -5,13 +5,79 @@
 # hardware/qcom/camera/QCamera/HAL2/core
 ifeq ($(findstring $(TARGET_BOARD_PLATFORM),omap4 exynos5 msm8960),)
 LOCAL_PATH:= $(call my-dir)
+
+# Kernels with SSE2 bodies only: on ARM their portable loops are left to
+# the compiler's NEON vectoriser, so they are built apart with the flags
+# for it and merged into the core
+CORE_VEC_SRC_FILES:= \
+        demosaic.c \
+        denoise.c \
+        motion.c \
+        tensor.c
+
+ifeq ($(TARGET_ARCH),arm)
+include $(CLEAR_VARS)
+LOCAL_SRC_FILES:= $(CORE_VEC_SRC_FILES)
+LOCAL_CFLAGS += -mfpu=neon -ftree-vectorize
+LOCAL_MODULE:= libcamera_v4l2vec
+LOCAL_MODULE_TAGS:= optional
+include $(BUILD_STATIC_LIBRARY)
+endif
+
+# Platform-neutral capture core: V4L2 capture, conversion kernels and
+# the JPEG encoder. CMakeLists.txt builds the same sources for the host.
 include $(CLEAR_VARS)
 LOCAL_SRC_FILES:= \
-	CameraHal_Module.cpp \
         V4L2Camera.cpp \
-        CameraHardware.cpp \
-        convert.S \
-        rgbconvert.c
+        FakeCamera.cpp \
+        CameraTrace.cpp \
+        CameraStats.cpp \
+        PreviewWriter.cpp \
+        JpegEncoder.cpp \
+        M2MDevice.cpp \
+        M2MConverter.cpp \
+        SnapshotEncoder.cpp \
+        FrameRing.cpp \
+        WorkerPool.cpp \
+        ExposureBracket.cpp \
+        TemporalDenoise.cpp \
+        Stabilizer.cpp \
+        CallbackStream.cpp \
+        TensorOutput.cpp \
+        ConvertKernels.cpp \
+        ConvertGraph.cpp \
+        rgbconvert.c \
+        yuvconvert.c \
+        tiledconvert.c \
+        rawunpack.c \
+        fusion.c \
+        downscale.c
+
+ifeq ($(TARGET_ARCH),arm)
+LOCAL_SRC_FILES += convert.S
+LOCAL_CFLAGS += -DHAVE_NEON_CONVERT
+LOCAL_WHOLE_STATIC_LIBRARIES := libcamera_v4l2vec
+else
+LOCAL_SRC_FILES += $(CORE_VEC_SRC_FILES)
+endif
+
+LOCAL_C_INCLUDES += \
+    external/jpeg
+
+LOCAL_MODULE:= libcamera_v4l2core
+LOCAL_MODULE_TAGS:= optional
+
+include $(BUILD_STATIC_LIBRARY)
+
+# HAL glue on top of the core
+include $(CLEAR_VARS)
+LOCAL_SRC_FILES:= \
+	CameraHal_Module.cpp \
+        CameraHardware.cpp
+
+ifeq ($(TARGET_ARCH),arm)
+LOCAL_CFLAGS += -DHAVE_NEON_CONVERT
+endif
 
 LOCAL_C_INCLUDES += \
     $(LOCAL_PATH)/inc/ \
@@ -25,6 +91,9 @@ LOCAL_C_INCLUDES += \
     external/jpeg \
     external/jhead
 
+LOCAL_STATIC_LIBRARIES:= \
+    libcamera_v4l2core
+
 LOCAL_SHARED_LIBRARIES:= \
     libui \
     libbinder \
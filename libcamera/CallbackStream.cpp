@@ -0,0 +1,114 @@
+/*
+ *      This program is free software; you can redistribute it and/or modify
+ *      it under the terms of the GNU General Public License as published by
+ *      the Free Software Foundation; either version 2 of the License, or
+ *      (at your option) any later version.
+ *
+ */
+
+#define LOG_TAG "CallbackStream"
+#include "CameraLog.h"
+
+#include <string.h>
+
+#include "CallbackStream.h"
+#include "CameraStats.h"
+#include "convert.h"
+
+namespace android {
+
+static const struct {
+    const char *name;
+    int downscale;              /* DOWNSCALE_* */
+} kFormats[] = {
+    { "yuv420sp", DOWNSCALE_NV21 },     /* FORMAT_NV21 */
+    { "y8", DOWNSCALE_GREY },           /* FORMAT_GREY */
+    { "rgb888", DOWNSCALE_RGB888 },     /* FORMAT_RGB888 */
+};
+
+CallbackStream::CallbackStream ()
+    : isEnabled(false),
+      order(PACKED422_YUYV),
+      srcWidth(0),
+      srcHeight(0),
+      outWidth(0),
+      outHeight(0),
+      outSize(0),
+      outFormat(FORMAT_NV21),
+      every(1),
+      frames(0),
+      convertUs(0)
+{
+}
+
+bool CallbackStream::formatFromName (const char *name, Format *format)
+{
+    for (int i = 0; name && i < (int) (sizeof(kFormats) / sizeof(kFormats[0])); i++) {
+        if (!strcmp(name, kFormats[i].name)) {
+            *format = (Format) i;
+            return true;
+        }
+    }
+    return false;
+}
+
+const char *CallbackStream::formatName (Format format)
+{
+    return kFormats[format].name;
+}
+
+bool CallbackStream::configure (PixelFormat capture, int frameWidth, int frameHeight,
+                                int w, int h, int decimation, Format fmt)
+{
+    isEnabled = false;
+
+    switch (capture) {
+    case PIX_FMT_YUYV: order = PACKED422_YUYV; break;
+    case PIX_FMT_UYVY: order = PACKED422_UYVY; break;
+    case PIX_FMT_YVYU: order = PACKED422_YVYU; break;
+    case PIX_FMT_VYUY: order = PACKED422_VYUY; break;
+    default:
+        ALOGW("configure: no callback stream from %s", pixelFormatName(capture));
+        return false;
+    }
+
+    if (w <= 0 || w > frameWidth)
+        w = frameWidth;
+    if (h <= 0 || h > frameHeight)
+        h = frameHeight;
+    if (fmt == FORMAT_NV21) {
+        w &= ~1;
+        h &= ~1;
+    }
+    if (w <= 0 || h <= 0)
+        return false;
+
+    srcWidth = frameWidth;
+    srcHeight = frameHeight;
+    outWidth = w;
+    outHeight = h;
+    outFormat = fmt;
+    outSize = downscale_frame_size(kFormats[fmt].downscale, w, h);
+    every = decimation > 1 ? decimation : 1;
+    frames = 0;
+    isEnabled = true;
+    ALOGI("Callback stream %dx%d %s, 1 in %d frames", w, h, kFormats[fmt].name, every);
+    return true;
+}
+
+bool CallbackStream::due ()
+{
+    return frames++ % every == 0;
+}
+
+bool CallbackStream::convert (const unsigned char *frame, unsigned char *dst)
+{
+    int64_t t0 = cameraNowNs();
+    int ret = packed422_downscale(frame, order, srcWidth, srcHeight, dst,
+                                  outWidth, outHeight, kFormats[outFormat].downscale);
+
+    convertUs = (cameraNowNs() - t0) / 1000;
+    return ret == 0;
+}
+
+}; // namespace android
@@ -0,0 +1,77 @@
+/*
+ *      This program is free software; you can redistribute it and/or modify
+ *      it under the terms of the GNU General Public License as published by
+ *      the Free Software Foundation; either version 2 of the License, or
+ *      (at your option) any later version.
+ *
+ * Preview callback stream for analytics clients, which need far less than
+ * the display: every decimation-th frame, downscaled to its own size and
+ * converted to Y only, NV21 or RGB888 in one pass over the capture
+ * (downscale.c). The display preview is not affected.
+ */
+
+#ifndef _CALLBACKSTREAM_H
+#define _CALLBACKSTREAM_H
+
+#include <stdint.h>
+
+#include "ConvertKernels.h"
+
+namespace android {
+
+class CallbackStream {
+
+public:
+    enum Format {
+        FORMAT_NV21,
+        FORMAT_GREY,
+        FORMAT_RGB888
+    };
+
+    CallbackStream ();
+
+    /* Parameter values: "yuv420sp", "y8", "rgb888"; false if unknown */
+    static bool formatFromName (const char *name, Format *format);
+    static const char *formatName (Format format);
+
+    /* For the frames of one session: width x height (clamped to the
+     * frame, even for NV21) every decimation-th frame. False (and off)
+     * for a capture format other than packed 4:2:2. */
+    bool configure (PixelFormat capture, int frameWidth, int frameHeight,
+                    int width, int height, int decimation, Format format);
+
+    bool enabled () const { return isEnabled; }
+    void disable () { isEnabled = false; }
+
+    /* Counts a frame; true if it is one of the stream's */
+    bool due ();
+
+    /* Reduce frame into dst of frameSize() bytes */
+    bool convert (const unsigned char *frame, unsigned char *dst);
+
+    int width () const { return outWidth; }
+    int height () const { return outHeight; }
+    int frameSize () const { return outSize; }
+    int decimation () const { return every; }
+    Format format () const { return outFormat; }
+
+    /* Duration of the last convert() in us */
+    int64_t lastUs () const { return convertUs; }
+
+private:
+    bool isEnabled;
+    int order;                  /* PACKED422_* */
+    int srcWidth;
+    int srcHeight;
+    int outWidth;
+    int outHeight;
+    int outSize;
+    Format outFormat;
+    int every;
+    unsigned int frames;
+    int64_t convertUs;
+};
+
+}; // namespace android
+
+#endif
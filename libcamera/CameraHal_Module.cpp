@@ -262,9 +262,8 @@ static void camera_put_parameters(struct camera_device *device, char *params)
 int camera_send_command(struct camera_device * device,
             int32_t cmd, int32_t arg1, int32_t arg2)
 {
-    int rv =0;// -EINVAL;
     LOG_FUNCTION_NAME
-    return rv;
+    return V4L2CameraHardware->sendCommand(cmd, arg1, arg2);
 }
 
 void camera_release(struct camera_device * device)
@@ -276,9 +275,10 @@ LOG_FUNCTION_NAME
 
 int camera_dump(struct camera_device * device, int fd)
 {
-    int rv = 0;//-EINVAL;
     LOG_FUNCTION_NAME
-    return rv;
+    if (!V4L2CameraHardware)
+        return -EINVAL;
+    return V4L2CameraHardware->dump(fd, Vector<String16>());
 }
 
 extern "C" void heaptracker_free_leaked_memory(void);
@@ -28,23 +28,135 @@
 #include <hal_public.h>
 #include <ui/GraphicBufferMapper.h>
 #include <gui/ISurfaceTexture.h>
+#include <cutils/properties.h>
 #define MAX_VIDEONODES      20
 #define MIN_WIDTH           320
 #define MIN_HEIGHT          240
 #define CAM_SIZE            "320x240"
-#define PIXEL_FORMAT        V4L2_PIX_FMT_YUYV
+#ifndef ATRACE_TAG_CAMERA
+#define ATRACE_TAG_CAMERA   (1<<10)
+#endif
 #define CAMHAL_GRALLOC_USAGE GRALLOC_USAGE_HW_TEXTURE | \
                              GRALLOC_USAGE_HW_RENDER | \
                              GRALLOC_USAGE_SW_READ_RARELY | \
-                             GRALLOC_USAGE_SW_WRITE_NEVER
+                             GRALLOC_USAGE_SW_WRITE_OFTEN
 
-extern "C" {
-    void yuyv422_to_yuv420sp(unsigned char*,unsigned char*,int,int);
-    void convertYUYVtoRGB565(unsigned char *buf, unsigned char *rgb, int width, int height);
-}
+#include "convert.h"
+#include "CameraTrace.h"
 
 namespace android {
 
+// Formats the preview path can convert, preferred first: packed 4:2:2
+// directly, Bayer from ISP-less sensors through the demosaic
+static const unsigned int kCaptureFormats[] = {
+    V4L2_PIX_FMT_YUYV,
+    V4L2_PIX_FMT_UYVY,
+    V4L2_PIX_FMT_YVYU,
+    V4L2_PIX_FMT_VYUY,
+    V4L2_PIX_FMT_SBGGR8,
+    V4L2_PIX_FMT_SBGGR10,
+    V4L2_PIX_FMT_SGRBG10,
+#ifdef V4L2_PIX_FMT_SBGGR10P
+    V4L2_PIX_FMT_SBGGR10P,
+    V4L2_PIX_FMT_SBGGR12P,
+#endif
+};
+#define NUM_CAPTURE_FORMATS (sizeof(kCaptureFormats) / sizeof(kCaptureFormats[0]))
+
+
+
+// Zero shutter lag: "on" keeps the last zsl-depth preview frames so
+// takePicture encodes the one captured at the shutter press
+static const char KEY_ZSL[] = "zsl";
+static const char KEY_ZSL_DEPTH[] = "zsl-depth";
+static const int kDefaultZslDepth = 3;
+
+// Exposure bracketing: takePicture captures one frame per offset (tenths
+// of a stop, e.g. "-20,0,20") from the running stream and delivers a JPEG
+// of each, or a single exposure fused one with fusion "on"
+static const char KEY_EXP_BRACKETING_RANGE[] = "exp-bracketing-range";
+static const char KEY_EXP_BRACKETING_FUSION[] = "exp-bracketing-fusion";
+
+// Temporal noise reduction of the preview (and recording) stream
+static const char KEY_TEMPORAL_NR[] = "temporal-nr";
+
+// Electronic stabilization of the recording: "true" crops the video frames
+// to a window that follows the shake, with this share (percent) of each
+// side in reserve; video-size becomes the size of the window
+static const char KEY_VIDEO_STABILIZATION[] = "video-stabilization";
+static const char KEY_VIDEO_STABILIZATION_SUPPORTED[] = "video-stabilization-supported";
+static const int kStabilizationMargin = 8;
+
+// Scaling and colour conversion on a V4L2 mem2mem block, per stream: "on"
+// sends the display or the callback frames through one if the SoC has
+// it, the software converters do the rest
+static const char KEY_M2M_CONVERT_DISPLAY[] = "m2m-convert-display";
+static const char KEY_M2M_CONVERT_CALLBACK[] = "m2m-convert-callback";
+
+static void enableConverter(M2MConverter &converter, const char *value)
+{
+    if (value && strcmp(value, "on") == 0)
+        converter.enable(NULL);
+    else
+        converter.disable();
+}
+
+// For dump(): the node in use, or why there is none
+static const char *converterState(const M2MConverter &converter)
+{
+    if (!converter.enabled())
+        return "software";
+    return converter.node()[0] ? converter.node() : "searching";
+}
+
+// dump() waits at most this long for mLock, which the preview thread
+// holds across DQBUF, as CameraService does for its own lock
+static const int kDumpLockRetries = 20;
+static const int kDumpLockSleepUs = 50000;
+
+static bool tryLockForDump(Mutex &mutex)
+{
+    for (int i = 0; i < kDumpLockRetries; i++) {
+        if (mutex.tryLock() == NO_ERROR)
+            return true;
+        usleep(kDumpLockSleepUs);
+    }
+    return false;
+}
+
+// Reduced preview callbacks for analytics clients: the frames delivered
+// as CAMERA_MSG_PREVIEW_FRAME at their own size ("" for the preview size),
+// one in every callback-decimation frames, as NV21, Y only or RGB888. The
+// display is not affected.
+static const char KEY_CALLBACK_SIZE[] = "preview-callback-size";
+static const char KEY_CALLBACK_DECIMATION[] = "preview-callback-decimation";
+static const char KEY_CALLBACK_FORMAT[] = "preview-callback-format";
+
+// Set up the stream from the parameters; off when they ask for every full
+// size NV21 frame, which the regular preview path delivers
+static void configureCallbackStream(CallbackStream &stream, const CameraParameters &params,
+                                    PixelFormat capture, int width, int height)
+{
+    int streamWidth = 0, streamHeight = 0;
+    const char *size = params.get(KEY_CALLBACK_SIZE);
+    if (size && *size && sscanf(size, "%dx%d", &streamWidth, &streamHeight) != 2)
+        ALOGW("Bad %s %s", KEY_CALLBACK_SIZE, size);
+    int decimation = params.getInt(KEY_CALLBACK_DECIMATION);
+    CallbackStream::Format format = CallbackStream::FORMAT_NV21;
+    const char *name = params.get(KEY_CALLBACK_FORMAT);
+    if (name && !CallbackStream::formatFromName(name, &format))
+        ALOGW("Bad %s %s", KEY_CALLBACK_FORMAT, name);
+
+    bool reduced = (streamWidth > 0 && streamWidth < width) ||
+                   (streamHeight > 0 && streamHeight < height);
+    if (reduced || decimation > 1 || format != CallbackStream::FORMAT_NV21)
+        stream.configure(capture, width, height, streamWidth, streamHeight, decimation, format);
+    else
+        stream.disable();
+}
+
+// Pause after a window error before the preview thread tries again
+static const nsecs_t kWindowRetryNs = 33000000;
 
 const char supportedFpsRanges [] = "(8000,8000),(8000,10000),(10000,10000),(8000,15000),(15000,15000),(8000,20000),(20000,20000),(24000,24000),(25000,25000),(8000,30000),(30000,30000)";
 
@@ -58,9 +170,13 @@ CameraHardware::CameraHardware(int cameraId)
                     mPreviewFrameSize(0),
                     mCurrentPreviewFrame(0),
                     mRecordRunning(false),
-                    previewStopped(true),
+                    mPreviewState(PREVIEW_STOPPED),
                     nQueued(0),
                     nDequeued(0),
+                    mCaptureFormat(0),
+                    mSnapshotPending(false),
+                    mBracketFusion(false),
+                    mBracketJoinable(false),
                     mNotifyFn(NULL),
                     mDataFn(NULL),
                     mTimestampFn(NULL),
@@ -81,10 +197,29 @@ void CameraHardware::initDefaultParameters()
     p.set(p.KEY_SUPPORTED_PREVIEW_SIZES, CAM_SIZE);
     p.set(p.KEY_SUPPORTED_PREVIEW_SIZES, "640x480");
     p.set(CameraParameters::KEY_VIDEO_FRAME_FORMAT,CameraParameters::PIXEL_FORMAT_YUV420SP);
+    p.set(CameraParameters::KEY_VIDEO_SNAPSHOT_SUPPORTED, CameraParameters::TRUE);
     p.set(CameraParameters::KEY_FOCUS_MODE,0);
     p.setPictureSize(MIN_WIDTH, MIN_HEIGHT);
     p.setPictureFormat("jpeg");
     p.set(p.KEY_SUPPORTED_PICTURE_SIZES, CAM_SIZE);
+    p.set(KEY_ZSL, "off");
+    p.set("zsl-values", "off,on");
+    p.set(KEY_ZSL_DEPTH, kDefaultZslDepth);
+    p.set(KEY_EXP_BRACKETING_RANGE, "");
+    p.set(KEY_EXP_BRACKETING_FUSION, "off");
+    p.set("exp-bracketing-fusion-values", "off,on");
+    p.set(KEY_TEMPORAL_NR, "off");
+    p.set("temporal-nr-values", "off,low,high");
+    p.set(KEY_VIDEO_STABILIZATION, CameraParameters::FALSE);
+    p.set(KEY_VIDEO_STABILIZATION_SUPPORTED, CameraParameters::TRUE);
+    p.set(KEY_M2M_CONVERT_DISPLAY, "off");
+    p.set("m2m-convert-display-values", "off,on");
+    p.set(KEY_M2M_CONVERT_CALLBACK, "off");
+    p.set("m2m-convert-callback-values", "off,on");
+    p.set(KEY_CALLBACK_SIZE, "");
+    p.set(KEY_CALLBACK_DECIMATION, 1);
+    p.set(KEY_CALLBACK_FORMAT, "yuv420sp");
+    p.set("preview-callback-format-values", "yuv420sp,y8,rgb888");
 
     if (setParameters(p) != NO_ERROR) {
         ALOGE("Failed to set default parameters?!");
@@ -93,6 +228,7 @@ void CameraHardware::initDefaultParameters()
 
 CameraHardware::~CameraHardware()
 {
+    waitBracketThread();
 }
 
 sp<IMemoryHeap> CameraHardware::getPreviewHeap() const
@@ -151,6 +287,8 @@ int CameraHardware::setPreviewWindow( preview_stream_ops_t *window)
         }
     }
 
+    // a preview waiting for a window can start drawing
+    mPreviewCondition.broadcast();
     return 0;
 }
 
@@ -158,6 +296,8 @@ void CameraHardware::enableMsgType(int32_t msgType)
 {
     Mutex::Autolock lock(mLock);
     mMsgEnabled |= msgType;
+    // a headless preview may have frames to deliver now
+    mPreviewCondition.broadcast();
 }
 
 void CameraHardware::disableMsgType(int32_t msgType)
@@ -174,90 +314,347 @@ bool CameraHardware::msgTypeEnabled(int32_t msgType)
 
 
 //-------------------------------------------------------------
-int CameraHardware::previewThread()
+const char *CameraHardware::previewStateName(PreviewState state)
+{
+    switch (state) {
+    case PREVIEW_STOPPED: return "stopped";
+    case PREVIEW_WAITING: return "idle";
+    case PREVIEW_RUNNING: return "running";
+    case PREVIEW_HEADLESS: return "headless";
+    }
+    return "?";
+}
+
+// Called with mLock held; wakes the preview thread to look at the change
+void CameraHardware::setPreviewState(PreviewState state)
+{
+    if (state != mPreviewState)
+        ALOGD("preview: %s -> %s", previewStateName(mPreviewState), previewStateName(state));
+    mPreviewState = state;
+    mPreviewCondition.broadcast();
+}
+
+// Headless: frames are wanted without a window, by the preview or video
+// callbacks, a still taken from the stream, the tensor output or the ZSL
+// history, which would otherwise hand out a stale frame at takePicture.
+// Called with mLock held.
+bool CameraHardware::framesWanted() const
+{
+    return (mMsgEnabled & CAMERA_MSG_PREVIEW_FRAME) ||
+           (mRecordRunning && (mMsgEnabled & CAMERA_MSG_VIDEO_FRAME)) ||
+           mSnapshotPending || mBracket.state() == ExposureBracket::CAPTURING ||
+           mTensor.enabled() || mZsl.depth() > 0;
+}
+
+// One frame per call. Returns false once the preview is stopped, which
+// ends the thread. With neither a window nor headless work it sleeps on
+// mPreviewCondition until setPreviewWindow, enableMsgType,
+// startRecording, takePicture or stopPreview signal it.
+bool CameraHardware::previewThread()
 {
     int width, height;
     int err;
-    IMG_native_handle_t** hndl2hndl;
-    IMG_native_handle_t* handle;
+    IMG_native_handle_t** hndl2hndl = NULL;
     int stride;
-    mParameters.getPreviewSize(&width, &height);
-    int framesize= width * height * 1.5 ; //yuv420sp
 
-   if (!previewStopped) {
-    mLock.lock();
-    if (mNativeWindow != NULL)
-    {
-    if ((err = mNativeWindow->dequeue_buffer(mNativeWindow,(buffer_handle_t**) &hndl2hndl,&stride)) != 0) {
-        ALOGW("Surface::dequeueBuffer returned error %d", err);
-        return -1;
+    Mutex::Autolock lock(mLock);
+    while (mPreviewState != PREVIEW_STOPPED && mNativeWindow == NULL && !framesWanted()) {
+        if (mPreviewState != PREVIEW_WAITING)
+            setPreviewState(PREVIEW_WAITING);
+        mPreviewCondition.wait(mLock);
     }
-    mNativeWindow->lock_buffer(mNativeWindow, (buffer_handle_t*) hndl2hndl);
-    GraphicBufferMapper &mapper = GraphicBufferMapper::get();
+    if (mPreviewState == PREVIEW_STOPPED)
+        return false;
+    bool display = mNativeWindow != NULL;
+    PreviewState state = display ? PREVIEW_RUNNING : PREVIEW_HEADLESS;
+    if (mPreviewState != state)
+        setPreviewState(state);
 
-    Rect bounds(width, height);
+    mParameters.getPreviewSize(&width, &height);
+    int framesize= width * height * 3 / 2; //yuv420sp
+
+    unsigned int frame = mCurrentPreviewFrame++;
+    CAMERA_TRACE_COUNTER("camera.previewFrame", frame);
+    GraphicBufferMapper &mapper = GraphicBufferMapper::get();
     void *tempbuf;
-    void *dst;
-    if(0 == mapper.lock((buffer_handle_t)*hndl2hndl,CAMHAL_GRALLOC_USAGE, bounds, &dst)); 
+    void *dst = NULL;
+    if (display) {
+        if ((err = mNativeWindow->dequeue_buffer(mNativeWindow,(buffer_handle_t**) &hndl2hndl,&stride)) != 0) {
+            // e.g. an abandoned surface: try again a frame later, or when
+            // the window changes, rather than in a tight loop
+            ALOGW("Surface::dequeueBuffer returned error %d", err);
+            mPreviewCondition.waitRelative(mLock, kWindowRetryNs);
+            return true;
+        }
+        mNativeWindow->lock_buffer(mNativeWindow, (buffer_handle_t*) hndl2hndl);
+
+        Rect bounds(width, height);
+        CAMERA_TRACE_BEGIN("gralloc lock", frame);
+        err = mapper.lock((buffer_handle_t)*hndl2hndl,CAMHAL_GRALLOC_USAGE, bounds, &dst);
+        CAMERA_TRACE_END();
+        if (err != 0) {
+            ALOGW("GraphicBufferMapper::lock returned error %d", err);
+            mNativeWindow->cancel_buffer(mNativeWindow, (buffer_handle_t*) hndl2hndl);
+            mPreviewCondition.waitRelative(mLock, kWindowRetryNs);
+            return true;
+        }
+    }
     {
         // Get preview frame
+        mStats.occupancy.add(camera.GetQueuedBuffers());
+        int64_t t0 = cameraNowNs();
+        CAMERA_TRACE_BEGIN("dqbuf", frame);
         tempbuf=camera.GrabPreviewFrame();
-        convertYUYVtoRGB565((unsigned char *)tempbuf,(unsigned char *)dst, width, height);
-        mapper.unlock((buffer_handle_t)*hndl2hndl);
-        mNativeWindow->enqueue_buffer(mNativeWindow,(buffer_handle_t*) hndl2hndl);
-        if ((mMsgEnabled & CAMERA_MSG_PREVIEW_FRAME) ||
-                (mMsgEnabled & CAMERA_MSG_VIDEO_FRAME)) {
-            camera_memory_t* picture = mRequestMemory(-1, framesize, 1, NULL);
-            yuyv422_to_yuv420sp((unsigned char *)tempbuf,(unsigned char *) picture->data, width, height);
+        CAMERA_TRACE_END();
+        int64_t t1 = cameraNowNs();
+        mStats.dqbufWait.add((t1 - t0) / 1000);
+        if (!tempbuf) {
+            if (display) {
+                mapper.unlock((buffer_handle_t)*hndl2hndl);
+                mNativeWindow->cancel_buffer(mNativeWindow, (buffer_handle_t*) hndl2hndl);
+            }
+            mPreviewCondition.waitRelative(mLock, kWindowRetryNs);
+            return true;
+        }
+        mStats.frameCaptured(camera.GetFrameSequence());
+        CAMERA_TRACE_COUNTER("camera.v4l2Sequence", camera.GetFrameSequence());
+
+        // Display and callbacks read the denoised reference instead of the
+        // capture buffer; snapshots still get the frame as captured
+        unsigned char *src = (unsigned char *)tempbuf;
+        if (mDenoise.enabled()) {
+            CameraTraceScope trace("denoise", frame);
+            src = mDenoise.process(src);
+            mStats.denoise.add(mDenoise.lastUs());
+        }
+        int64_t t2 = cameraNowNs();
+
+        // Streams with a V4L2 converter go through it, the others share one
+        // software pass; stabilized video frames are converted from their
+        // window. The converter imports the capture buffer unless the
+        // frame is the denoised copy. Headless, there is no display
+        // conversion at all. With a callback stream the preview callback
+        // gets its reduced frames instead of the full size copy.
+        bool stabilize = mRecordRunning && (mMsgEnabled & CAMERA_MSG_VIDEO_FRAME) &&
+                         mStabilizer.enabled();
+        bool stream = (mMsgEnabled & CAMERA_MSG_PREVIEW_FRAME) && mCallbackStream.enabled();
+        bool callback = ((mMsgEnabled & CAMERA_MSG_PREVIEW_FRAME) && !stream) ||
+                        ((mMsgEnabled & CAMERA_MSG_VIDEO_FRAME) && !stabilize);
+        camera_memory_t* picture = callback ? mRequestMemory(-1, framesize, 1, NULL) : NULL;
+        PixelFormat srcFormat = pixelFormatFromFourcc(mCaptureFormat);
+        int srcFd = src == (unsigned char *)tempbuf ? camera.GetFrameFd() : -1;
+        CAMERA_TRACE_BEGIN("convert", frame);
+        bool displayDone = !display ||
+                           mDisplayConverter.convert(src, srcFd, srcFormat, width, height,
+                                                     (unsigned char *)dst, width * height * 2,
+                                                     PIX_FMT_RGB565, width, height);
+        bool callbackDone = picture &&
+                            mCallbackConverter.convert(src, srcFd, srcFormat, width, height,
+                                                       (unsigned char *)picture->data, framesize,
+                                                       PIX_FMT_NV21, width, height);
+        mPreviewWriter.write(src, displayDone ? NULL : (unsigned char *)dst,
+                             picture && !callbackDone ? (unsigned char *)picture->data : NULL,
+                             width, height);
+        CAMERA_TRACE_END();
+        mStats.conversion.add((cameraNowNs() - t2) / 1000);
+        if (display) {
+            mapper.unlock((buffer_handle_t)*hndl2hndl);
+            CAMERA_TRACE_BEGIN("enqueue", frame);
+            mNativeWindow->enqueue_buffer(mNativeWindow,(buffer_handle_t*) hndl2hndl);
+            CAMERA_TRACE_END();
+            mStats.frameDisplayed();
+        }
+        camera_memory_t* video = NULL;
+        if (stabilize) {
+            int64_t ts = cameraNowNs();
+            CameraTraceScope trace("stabilize", frame);
+            mStabilizer.update(src);
+            video = mRequestMemory(-1, mStabilizer.outputSize(), 1, NULL);
+            mStabilizer.convert(src, (unsigned char *)video->data, 0);
+            mStats.stabilize.add((cameraNowNs() - ts) / 1000);
+        }
+        camera_memory_t* reduced = NULL;
+        if (stream && mCallbackStream.due()) {
+            CameraTraceScope trace("callback stream", frame);
+            reduced = mRequestMemory(-1, mCallbackStream.frameSize(), 1, NULL);
+            if (!mCallbackStream.convert(src, (unsigned char *)reduced->data)) {
+                reduced->release(reduced);
+                reduced = NULL;
+            }
+            mStats.callbackStream.add(mCallbackStream.lastUs());
+        }
+        if (picture || video || reduced) {
+            int64_t t3 = cameraNowNs();
+            CameraTraceScope trace("callback", frame);
+            // the client keeps its own reference to the memory, so one
+            // buffer serves both callbacks and is released right away
             if ((mMsgEnabled & CAMERA_MSG_VIDEO_FRAME ) && mRecordRunning ) {
-                nsecs_t timeStamp = systemTime(SYSTEM_TIME_MONOTONIC);
-                //mTimestampFn(timeStamp, CAMERA_MSG_VIDEO_FRAME,mRecordBuffer, mUser);
+                nsecs_t timeStamp = camera.GetFrameTimestamp();
+                if (timeStamp == 0)
+                    timeStamp = systemTime(SYSTEM_TIME_MONOTONIC);
+                mTimestampFn(timeStamp, CAMERA_MSG_VIDEO_FRAME, video ? video : picture, 0, mUser);
             }
-            mDataFn(CAMERA_MSG_PREVIEW_FRAME,picture,0,NULL,mUser);
-	    picture->release(picture);
+            if (picture && (mMsgEnabled & CAMERA_MSG_PREVIEW_FRAME) && !stream)
+                mDataFn(CAMERA_MSG_PREVIEW_FRAME,picture,0,NULL,mUser);
+            if (reduced)
+                mDataFn(CAMERA_MSG_PREVIEW_FRAME,reduced,0,NULL,mUser);
+            if (picture)
+                picture->release(picture);
+            if (reduced)
+                reduced->release(reduced);
+            if (video)
+                video->release(video);
+            mStats.callback.add((cameraNowNs() - t3) / 1000);
+            mStats.frameDelivered();
 	}
-        camera.ReleasePreviewFrame();
-    }
+
+        // Video snapshot: this frame stays out of the driver until the
+        // worker has encoded it; the stream carries on with the others
+        bool held = false;
+        if (mSnapshotPending && !mSnapshot.busy()) {
+            int id = camera.HoldFrame();
+            mStats.picture.start();
+            if (mMsgEnabled & CAMERA_MSG_SHUTTER)
+                mNotifyFn(CAMERA_MSG_SHUTTER, 0, 0, mUser);
+            mStats.picture.mark(SessionTimeline::SHUTTER);
+            held = mSnapshot.submit(&camera, id, tempbuf, camera.GetFrameFd(),
+                                    pixelFormatFromFourcc(mCaptureFormat),
+                                    width, height, 90, snapshotDone, this);
+            mSnapshotPending = !held;
+        }
+        // Exposure bracket: copied out if it carries one of the exposures
+        if (mBracket.state() == ExposureBracket::CAPTURING) {
+            mBracket.onFrame(tempbuf, camera.GetFrameSequence());
+            if (mBracket.state() != ExposureBracket::CAPTURING) {
+                // the previous bracket thread has finished its bracket
+                waitBracketThread();
+                if (pthread_create(&mBracketThread, NULL, beginBracketThread, this) == 0) {
+                    mBracketJoinable = true;
+                } else {
+                    ALOGE("previewThread: unable to start the bracket thread");
+                    deliverJpeg(NULL, -1);
+                    mBracket.finish();
+                }
+            }
+        }
+
+        // Tensor output: made from the frame as captured on the worker,
+        // which holds it meanwhile; frames arriving while it is busy are
+        // skipped
+        if (!held && mTensor.enabled() && mTensor.due() && !mTensor.busy() &&
+            TensorOutput::accepts(srcFormat)) {
+            camera_memory_t* tensor = mRequestMemory(-1, mTensor.frameSize(), 1, NULL);
+            if (tensor) {
+                held = mTensor.submit(&camera, camera.HoldFrame(), tempbuf, srcFormat,
+                                      width, height, tensor->data, tensorDone, this, tensor);
+                if (!held)
+                    tensor->release(tensor);
+            }
+        }
+
+        // ZSL: the frame joins the history instead of going back to the
+        // driver; the ring requeues the oldest one
+        if (!held && mZsl.depth() > 0) {
+            int64_t timestamp = camera.GetFrameTimestamp();
+            mZsl.push(camera.HoldFrame(), tempbuf, timestamp ? timestamp : t1,
+                      camera.GetFrameSequence());
+            held = true;
+        }
+        if (!held) {
+            CAMERA_TRACE_BEGIN("qbuf", frame);
+            camera.ReleasePreviewFrame();
+            CAMERA_TRACE_END();
+        }
     }
-    mLock.unlock();
+
+    return true;
+}
+
+// Follow atrace: trace when the camera tag is enabled, picked up at every
+// preview start so "atrace camera" / perfetto work without a restart.
+void CameraHardware::updateTraceState()
+{
+    char value[PROPERTY_VALUE_MAX];
+
+    property_get("debug.atrace.tags.enableflags", value, "0");
+    CameraTrace::setEnabled((strtoull(value, NULL, 0) & ATRACE_TAG_CAMERA) != 0);
+}
+
+// Find a node streaming one of kCaptureFormats. Each node is opened and
+// queried once; the formats are only tried on a camera. Drivers substitute
+// their own format on S_FMT, so the negotiated one is read back and
+// accepted if it is any supported order.
+int CameraHardware::openCamera(int width, int height)
+{
+    char devnode[15];
+
+    for (int i = MAX_VIDEONODES; i >= 0; i--) {
+        sprintf(devnode,"/dev/video%d",i);
+        if (camera.OpenDevice(devnode) < 0)
+            continue;
+        for (size_t f = 0; f < NUM_CAPTURE_FORMATS; f++) {
+            ALOGI("trying the node %s width=%d height=%d format=%.4s\n",
+                  devnode, width, height, (const char *) &kCaptureFormats[f]);
+            if (camera.SetFormat(width, height, kCaptureFormats[f]) < 0)
+                continue;
+            mCaptureFormat = camera.GetPixelFormat();
+            for (size_t g = 0; g < NUM_CAPTURE_FORMATS; g++)
+                if (mCaptureFormat == kCaptureFormats[g])
+                    return 0;
+        }
+        camera.Close();
     }
 
-    return NO_ERROR;
+    return -1;
 }
 
 status_t CameraHardware::startPreview()
 {
     int ret;
     int width, height;
-    int i;
     IMG_native_handle_t** hndl2hndl;
     IMG_native_handle_t* handle;
     int stride;
-    char devnode[15];
     Mutex::Autolock lock(mLock);
     if (mPreviewThread != 0) {
         //already running
         return INVALID_OPERATION;
     }
+    updateTraceState();
+    mStats.previewStart.start();
+    mPreviewWriter.reset();
+    camera.SetTimeline(&mStats.previewStart);
 #if 1
     ALOGI("startPreview: in startpreview \n");
     mParameters.getPreviewSize(&width, &height);
-    for( i=MAX_VIDEONODES; i>=0; i--) {
-        sprintf(devnode,"/dev/video%d",i);
-        ALOGI("trying the node %s width=%d height=%d \n",devnode,width,height);
-        ret = camera.Open(devnode, width, height, PIXEL_FORMAT);
-        if( ret >= 0)
-            break;
-        }
-
-    if( ret < 0)
+    if (openCamera(width, height) < 0)
         return -1;
+    mPreviewWriter.setSourceFormat(pixelFormatFromFourcc(mCaptureFormat));
+    mDenoise.configure(pixelFormatFromFourcc(mCaptureFormat), width, height,
+                       TemporalDenoise::levelFromName(mParameters.get(KEY_TEMPORAL_NR)));
+    enableConverter(mDisplayConverter, mParameters.get(KEY_M2M_CONVERT_DISPLAY));
+    enableConverter(mCallbackConverter, mParameters.get(KEY_M2M_CONVERT_CALLBACK));
+    configureCallbackStream(mCallbackStream, mParameters, pixelFormatFromFourcc(mCaptureFormat),
+                            width, height);
 
     mPreviewFrameSize = width * height * 2;
 
     mHeap = new MemoryHeapBase(mPreviewFrameSize);
     mBuffer = new MemoryBase(mHeap, 0, mPreviewFrameSize);
 
+    // Frames in the ZSL history stay out of the driver, so the stream
+    // gets that many buffers on top of its usual set
+    int zslDepth = 0;
+    const char *zsl = mParameters.get(KEY_ZSL);
+    if (zsl && strcmp(zsl, "on") == 0) {
+        zslDepth = mParameters.getInt(KEY_ZSL_DEPTH);
+        if (zslDepth <= 0)
+            zslDepth = kDefaultZslDepth;
+        if (zslDepth > FrameRing::MAX_DEPTH)
+            zslDepth = FrameRing::MAX_DEPTH;
+    }
+    camera.SetBufferCount(NB_BUFFER + zslDepth);
+
     ret = camera.Init();
     if (ret != 0) {  
         ALOGI("startPreview: Camera.Init failed\n");
@@ -265,6 +662,13 @@ status_t CameraHardware::startPreview()
         return ret;
     }
 
+    // the driver may grant fewer; the stream keeps NB_BUFFER - 1 to itself
+    if (zslDepth > camera.GetBufferCount() - (NB_BUFFER - 1))
+        zslDepth = camera.GetBufferCount() - (NB_BUFFER - 1);
+    if (zslDepth < 0)
+        zslDepth = 0;
+    mZsl.reset(&camera, zslDepth);
+
     ret = camera.StartStreaming();
     if (ret != 0) {  
         ALOGI("startPreview: Camera.StartStreaming failed\n");
@@ -272,8 +676,9 @@ status_t CameraHardware::startPreview()
         camera.Close();
         return ret;
     }
+    mStats.streamStarted();
 
-    previewStopped = false;
+    setPreviewState(PREVIEW_WAITING);
     mPreviewThread = new PreviewThread(this);
 
 #endif
@@ -286,7 +691,8 @@ void CameraHardware::stopPreview()
 
     { // scope for the lock
         Mutex::Autolock lock(mLock);
-        previewStopped = true;
+        setPreviewState(PREVIEW_STOPPED);
+        mSnapshotPending = false;
     }
 
     {
@@ -298,7 +704,15 @@ void CameraHardware::stopPreview()
         previewThread->requestExitAndWait();
     }
 
+    // A snapshot or the tensor output still holds a buffer of the stream;
+    // a captured bracket is still fused and delivered
+    mSnapshot.wait();
+    mTensor.wait();
+    waitBracketThread();
+
     if (mPreviewThread != 0) {
+        mBracket.cancel();
+        mZsl.flush();
         camera.Uninit();
         camera.StopStreaming();
         camera.Close();
@@ -320,14 +734,25 @@ status_t CameraHardware::startRecording()
 
     mRecordHeap = new MemoryHeapBase(mPreviewFrameSize*3/4);
     mRecordBuffer = new MemoryBase(mRecordHeap, 0, mPreviewFrameSize*3/4);
+
+    int width, height;
+    mParameters.getPreviewSize(&width, &height);
+    const char *stabilization = mParameters.get(KEY_VIDEO_STABILIZATION);
+    bool stabilize = stabilization && !strcmp(stabilization, CameraParameters::TRUE);
+    mStabilizer.configure(pixelFormatFromFourcc(mCaptureFormat), width, height,
+                          stabilize ? kStabilizationMargin : 0);
     mRecordRunning = true;
+    mPreviewCondition.broadcast();
 
     return NO_ERROR;
 }
 
 void CameraHardware::stopRecording()
 {
+    Mutex::Autolock lock(mLock);
     mRecordRunning = false;
+    mSnapshotPending = false;
+    mStabilizer.disable();
 }
 
 bool CameraHardware::recordingEnabled()
@@ -337,7 +762,8 @@ bool CameraHardware::recordingEnabled()
 
 void CameraHardware::releaseRecordingFrame(const void *opaque)
 {
-
+    // Every video frame is its own request_memory allocation, released
+    // by the client's reference; nothing to return here
 }
 
 // ---------------------------------------------------------------------------
@@ -385,13 +811,13 @@ int CameraHardware::pictureThread()
     struct v4l2_buffer cfilledbuffer;
     struct v4l2_requestbuffers creqbuf;
     struct v4l2_capability cap;
-    int i;
-    char devnode[15];
     camera_memory_t* picture = NULL;
 
 
+   camera.SetTimeline(&mStats.picture);
    if (mMsgEnabled & CAMERA_MSG_SHUTTER)
         mNotifyFn(CAMERA_MSG_SHUTTER, 0, 0, mUser);
+   mStats.picture.mark(SessionTimeline::SHUTTER);
 
     mParameters.getPictureSize(&w, &h);
     ALOGD("Picture Size: Width = %d \t Height = %d", w, h);
@@ -400,24 +826,53 @@ int CameraHardware::pictureThread()
     mParameters.getPictureSize(&width, &height);
     mParameters.getPreviewSize(&width, &height);
 
-    for(i=MAX_VIDEONODES; i>=0; i--) {
-        sprintf(devnode,"/dev/video%d",i);
-        ALOGI("trying the node %s \n",devnode);
-        ret = camera.Open(devnode, width, height, PIXEL_FORMAT);
-        if( ret >= 0)
-            break;
-    }
-
-    if( ret < 0)
+    if (openCamera(width, height) < 0)
         return -1;
 
+    camera.SetBufferCount(NB_BUFFER);
     camera.Init();
     camera.StartStreaming();
+    mStats.streamStarted();
+
+    // Sensor data as captured. Copied out: the buffer goes back to the
+    // driver right away and the stream keeps running for the JPEG, so a
+    // client mapping of the V4L2 buffer would be overwritten under it.
+    if (mMsgEnabled & CAMERA_MSG_RAW_IMAGE) {
+        if (void *raw = camera.GrabPreviewFrame()) {
+            size_t rawSize = camera.GetFrameSize();
+
+            picture = mRequestMemory(-1, rawSize, 1, NULL);
+            if (picture) {
+                memcpy(picture->data, raw, rawSize);
+                mDataFn(CAMERA_MSG_RAW_IMAGE, picture, 0, NULL, mUser);
+                picture->release(picture);
+                picture = NULL;
+            }
+            camera.ReleasePreviewFrame();
+        }
+    } else if (mMsgEnabled & CAMERA_MSG_RAW_IMAGE_NOTIFY) {
+        mNotifyFn(CAMERA_MSG_RAW_IMAGE_NOTIFY, 0, 0, mUser);
+    }
+
     //TODO xxx : Optimize the memory capture call. Too many memcpy
     if (mMsgEnabled & CAMERA_MSG_COMPRESSED_IMAGE) {
         ALOGD ("mJpegPictureCallback");
-        picture = camera.GrabJpegFrame(mRequestMemory);
-        mDataFn(CAMERA_MSG_COMPRESSED_IMAGE,picture,0,NULL ,mUser);
+        size_t maxSize = width * height * 2;
+        if (unsigned char *jpeg = new unsigned char[maxSize]) {
+            int64_t t0 = cameraNowNs();
+            int jpegSize = camera.GrabJpegFrame(jpeg, maxSize);
+            mStats.jpegEncode.add((cameraNowNs() - t0) / 1000);
+            if (jpegSize > 0) {
+                mStats.picture.mark(SessionTimeline::JPEG_DONE);
+                mStats.jpegSize.add(jpegSize);
+                mStats.pictureTaken();
+                picture = mRequestMemory(-1, jpegSize, 1, NULL);
+                memcpy(picture->data, jpeg, jpegSize);
+                mDataFn(CAMERA_MSG_COMPRESSED_IMAGE,picture,0,NULL ,mUser);
+                picture->release(picture);
+            }
+            delete[] jpeg;
+        }
     }
 
     camera.Uninit();
@@ -427,10 +882,189 @@ int CameraHardware::pictureThread()
     return NO_ERROR;
 }
 
+/*static*/ void CameraHardware::snapshotDone(void *user, const unsigned char *jpeg, int size)
+{
+    CameraHardware *c = (CameraHardware *)user;
+
+    c->mStats.jpegEncode.add(c->mSnapshot.lastEncodeUs());
+    c->deliverJpeg(jpeg, size);
+}
+
+/*static*/ void CameraHardware::tensorDone(void *user, void *token, bool ok)
+{
+    CameraHardware *c = (CameraHardware *)user;
+    camera_memory_t* tensor = (camera_memory_t *)token;
+
+    c->mStats.tensor.add(c->mTensor.lastUs());
+    if (ok)
+        c->mDataFn(CAMERA_MSG_TENSOR, tensor, 0, NULL, c->mUser);
+    tensor->release(tensor);
+}
+
+// A still encoded off the preview path, or NULL if encoding failed
+void CameraHardware::deliverJpeg(const unsigned char *jpeg, int size)
+{
+    if (!jpeg) {
+        if (mMsgEnabled & CAMERA_MSG_ERROR)
+            mNotifyFn(CAMERA_MSG_ERROR, CAMERA_ERROR_UNKNOWN, 0, mUser);
+        return;
+    }
+    mStats.picture.mark(SessionTimeline::JPEG_DONE);
+    mStats.jpegSize.add(size);
+    mStats.pictureTaken();
+    if (mMsgEnabled & CAMERA_MSG_COMPRESSED_IMAGE) {
+        camera_memory_t* picture = mRequestMemory(-1, size, 1, NULL);
+        if (picture) {
+            memcpy(picture->data, jpeg, size);
+            mDataFn(CAMERA_MSG_COMPRESSED_IMAGE, picture, 0, NULL, mUser);
+            picture->release(picture);
+        }
+    }
+}
+
+/*static*/ void *CameraHardware::beginBracketThread(void *cookie)
+{
+    CameraHardware *c = (CameraHardware *)cookie;
+    c->bracketThread();
+    return NULL;
+}
+
+void CameraHardware::waitBracketThread()
+{
+    if (mBracketJoinable) {
+        pthread_join(mBracketThread, NULL);
+        mBracketJoinable = false;
+    }
+}
+
+// The bracket is complete (or failed); the stream has already moved on
+int CameraHardware::bracketThread()
+{
+    int width = mBracket.width();
+    int height = mBracket.height();
+    size_t maxSize = (size_t) width * height * 2;
+    unsigned char *jpeg = NULL;
+    JpegEncoder encoder;
+
+    if (mBracket.state() == ExposureBracket::CAPTURED)
+        jpeg = new unsigned char[maxSize];
+    if (!jpeg) {
+        deliverJpeg(NULL, -1);
+        mBracket.finish();
+        return NO_ERROR;
+    }
+
+    if (mBracketFusion) {
+        unsigned char *fused = new unsigned char[maxSize];
+        int64_t t0 = cameraNowNs();
+
+        mWorkers.start(0);
+        mBracket.fuse(&mWorkers, fused);
+        int64_t t1 = cameraNowNs();
+        int size = encoder.encode(fused, PIX_FMT_YUYV, width, height, 90, jpeg, maxSize);
+        mStats.jpegEncode.add((cameraNowNs() - t1) / 1000);
+        ALOGD("bracketThread: %d frames fused in %lld us", mBracket.count(),
+              (long long) ((t1 - t0) / 1000));
+        deliverJpeg(size > 0 ? jpeg : NULL, size);
+        delete[] fused;
+    } else {
+        for (int i = 0; i < mBracket.count(); i++) {
+            int64_t t0 = cameraNowNs();
+            int size = encoder.encode(mBracket.frame(i), PIX_FMT_YUYV, width, height, 90,
+                                      jpeg, maxSize);
+            mStats.jpegEncode.add((cameraNowNs() - t0) / 1000);
+            deliverJpeg(size > 0 ? jpeg : NULL, size);
+        }
+    }
+
+    delete[] jpeg;
+    mBracket.finish();
+    return NO_ERROR;
+}
+
+// "-20,0,20" -> { -20, 0, 20 }; the number of offsets, 0 if none
+static int parseBracketRange(const char *range, int *ev, int max)
+{
+    int count = 0;
+
+    while (range && *range && count < max) {
+        char *end;
+        long value = strtol(range, &end, 10);
+
+        if (end == range)
+            break;
+        ev[count++] = value;
+        range = *end == ',' ? end + 1 : NULL;
+    }
+    return count;
+}
+
 status_t CameraHardware::takePicture()
 {
         ALOGD ("takepicture");
+    int64_t pressNs = cameraNowNs();
+
+    {
+        Mutex::Autolock lock(mLock);
+
+        // Exposure bracket from the running stream; preview keeps running
+        int ev[ExposureBracket::MAX_FRAMES];
+        int evCount = parseBracketRange(mParameters.get(KEY_EXP_BRACKETING_RANGE), ev,
+                                        ExposureBracket::MAX_FRAMES);
+        if (mPreviewThread != 0 && evCount > 0) {
+            int width, height;
+            const char *fusion = mParameters.get(KEY_EXP_BRACKETING_FUSION);
+
+            if (mBracket.state() != ExposureBracket::IDLE)
+                return INVALID_OPERATION;
+            mParameters.getPreviewSize(&width, &height);
+            if (mBracket.start(&camera, ev, evCount, pixelFormatFromFourcc(mCaptureFormat),
+                               width, height)) {
+                mBracketFusion = fusion && strcmp(fusion, "on") == 0;
+                mPreviewCondition.broadcast();
+                mStats.picture.start();
+                if (mMsgEnabled & CAMERA_MSG_SHUTTER)
+                    mNotifyFn(CAMERA_MSG_SHUTTER, 0, 0, mUser);
+                mStats.picture.mark(SessionTimeline::SHUTTER);
+                return NO_ERROR;
+            }
+            ALOGW("takePicture: bracketing unavailable, taking a single picture");
+        }
+
+        // ZSL: encode the frame captured closest to the press, already
+        // in memory; preview keeps running
+        if (mPreviewThread != 0 && mZsl.count() > 0 && !mSnapshot.busy()) {
+            FrameRing::Entry entry;
+            int width, height;
+
+            mZsl.take(pressNs, &entry);
+            mParameters.getPreviewSize(&width, &height);
+            mStats.picture.start();
+            if (mMsgEnabled & CAMERA_MSG_SHUTTER)
+                mNotifyFn(CAMERA_MSG_SHUTTER, 0, 0, mUser);
+            mStats.picture.mark(SessionTimeline::SHUTTER);
+            if (mSnapshot.submit(&camera, entry.id, entry.frame, entry.fd,
+                                 pixelFormatFromFourcc(mCaptureFormat),
+                                 width, height, 90, snapshotDone, this))
+                return NO_ERROR;
+            camera.ReleaseHeldFrame(entry.id);
+        }
+
+        // While recording, or with ZSL when the history is empty or the
+        // encoder busy, the still comes from the running stream instead:
+        // the preview thread hands its next frame to the snapshot encoder.
+        if (mPreviewThread != 0 && (mRecordRunning || mZsl.depth() > 0)) {
+            mSnapshotPending = true;
+            mPreviewCondition.broadcast();
+            return NO_ERROR;
+        }
+    }
+
+    // The picture session starts at the shutter press, so the timeline
+    // includes tearing down the preview and reopening the device.
+    mStats.picture.start();
     stopPreview();
+    mStats.picture.mark(SessionTimeline::PREVIEW_STOPPED);
 
     pictureThread();
 
@@ -445,6 +1079,45 @@ status_t CameraHardware::cancelPicture()
 
 status_t CameraHardware::dump(int fd, const Vector<String16>& args) const
 {
+    String8 result;
+    int width, height;
+
+    // The state is copied under mLock and written out after it: a stalled
+    // driver does not hang the dump, nor a slow reader the stream
+    if (tryLockForDump(mLock)) {
+        char writes[160];
+
+        mParameters.getPreviewSize(&width, &height);
+        result.appendFormat("V4L2 camera %d: preview %dx%d %s, recording %s, zsl %d/%d\n",
+                            mCameraId, width, height,
+                            previewStateName(mPreviewState),
+                            mRecordRunning ? "on" : "off", mZsl.count(), mZsl.depth());
+        mPreviewWriter.dump(writes, sizeof(writes));
+        result.append(writes);
+        result.appendFormat("  m2m convert: display %s, callback %s\n",
+                            converterState(mDisplayConverter),
+                            converterState(mCallbackConverter));
+        if (mCallbackStream.enabled())
+            result.appendFormat("  callback stream: %dx%d %s, 1 in %d frames\n",
+                                mCallbackStream.width(), mCallbackStream.height(),
+                                CallbackStream::formatName(mCallbackStream.format()),
+                                mCallbackStream.decimation());
+        if (mTensor.enabled()) {
+            const struct tensor_params &tp = mTensor.parameters();
+            result.appendFormat("  tensor: %dx%d %s%s\n", tp.width, tp.height,
+                                tp.type == TENSOR_FLOAT32 ? "float32" : "uint8",
+                                tp.flags & TENSOR_BGR ? " bgr" : "");
+        }
+        mLock.unlock();
+    } else {
+        result.appendFormat("V4L2 camera %d: busy, the capture thread holds the lock\n",
+                            mCameraId);
+    }
+    write(fd, result.string(), result.size());
+
+    // Counters are lock-free; read them without holding mLock
+    mStats.dump(fd);
+
     return NO_ERROR;
 }
 
@@ -472,11 +1145,57 @@ status_t CameraHardware::setParameters(const CameraParameters& params)
     mParameters.set(CameraParameters::KEY_SUPPORTED_PREVIEW_FPS_RANGE, supportedFpsRanges);
     mParameters.set(CameraParameters::KEY_SUPPORTED_PREVIEW_SIZES, "320x240,352x288,640x480,720x480,720x576,848x480");
 
+    // Video frames come from the preview stream: full size, or the
+    // stabilization window of it
+    int videoWidth = w, videoHeight = h;
+    const char *stabilization = mParameters.get(KEY_VIDEO_STABILIZATION);
+    if (stabilization && !strcmp(stabilization, CameraParameters::TRUE))
+        Stabilizer::cropSize(w, h, kStabilizationMargin, &videoWidth, &videoHeight);
+    mParameters.setVideoSize(videoWidth, videoHeight);
+    char videoSize[32];
+    snprintf(videoSize, sizeof(videoSize), "%dx%d", videoWidth, videoHeight);
+    mParameters.set(CameraParameters::KEY_SUPPORTED_VIDEO_SIZES, videoSize);
+
     return NO_ERROR;
 }
 
+// Only the vendor commands of the tensor output are supported
 status_t CameraHardware::sendCommand(int32_t command, int32_t arg1, int32_t arg2)
 {
+    Mutex::Autolock lock(mLock);
+
+    switch (command) {
+    case CAMERA_CMD_TENSOR_ENABLE:
+        mTensor.setEnabled(arg1 != 0);
+        // a headless preview may have frames to deliver now
+        mPreviewCondition.broadcast();
+        return NO_ERROR;
+    case CAMERA_CMD_TENSOR_SIZE:
+        if (arg1 < 0 || arg2 < 0 || arg1 > TENSOR_MAX_SIZE || arg2 > TENSOR_MAX_SIZE)
+            return BAD_VALUE;
+        mTensor.setSize(arg1, arg2);
+        mPreviewCondition.broadcast();
+        return NO_ERROR;
+    case CAMERA_CMD_TENSOR_CROP_ORIGIN:
+        mTensor.setCropOrigin(arg1, arg2);
+        return NO_ERROR;
+    case CAMERA_CMD_TENSOR_CROP_SIZE:
+        mTensor.setCropSize(arg1, arg2);
+        return NO_ERROR;
+    case CAMERA_CMD_TENSOR_TYPE:
+        if (arg1 != TENSOR_UINT8 && arg1 != TENSOR_FLOAT32)
+            return BAD_VALUE;
+        mTensor.setType(arg1, arg2);
+        return NO_ERROR;
+    case CAMERA_CMD_TENSOR_NORMALIZE:
+        if (arg1 < 0 || arg1 > 2 || (arg2 & 0xffff) == 0)
+            return BAD_VALUE;
+        mTensor.setNormalization(arg1, ((uint32_t)arg2 >> 16) / 256.0f, (arg2 & 0xffff) / 256.0f);
+        return NO_ERROR;
+    case CAMERA_CMD_TENSOR_DECIMATION:
+        mTensor.setDecimation(arg1);
+        return NO_ERROR;
+    }
     return BAD_VALUE;
 }
 
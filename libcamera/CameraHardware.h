@@ -27,6 +27,7 @@
 #include <utils/threads.h>
 
 #include <utils/threads.h>
+#include <pthread.h>
 #include <stdio.h>
 #include <stdarg.h>
 #include <stdlib.h>
@@ -51,6 +52,17 @@
 #include <binder/MemoryHeapBase.h>
 #include <utils/threads.h>
 #include "V4L2Camera.h"
+#include "CameraStats.h"
+#include "PreviewWriter.h"
+#include "SnapshotEncoder.h"
+#include "FrameRing.h"
+#include "ExposureBracket.h"
+#include "WorkerPool.h"
+#include "TemporalDenoise.h"
+#include "Stabilizer.h"
+#include "M2MConverter.h"
+#include "CallbackStream.h"
+#include "TensorOutput.h"
 
 #include <hardware/camera.h>
 
@@ -61,6 +73,22 @@ namespace android {
 
 class CameraHardware  {
 public:
+    // Vendor sendCommand()s setting up the tensor output, model input
+    // made from every frame (or one in every decimation) and delivered
+    // as CAMERA_MSG_TENSOR data: planar RGB of width x height elements,
+    // uint8 or float32 (TENSOR_* of convert.h)
+    enum {
+        CAMERA_CMD_TENSOR_ENABLE = 0x1000,  // arg1: 1 on, 0 off
+        CAMERA_CMD_TENSOR_SIZE,             // arg1 x arg2 output elements, TENSOR_MAX_SIZE at most
+        CAMERA_CMD_TENSOR_CROP_ORIGIN,      // arg1, arg2 in frame pixels
+        CAMERA_CMD_TENSOR_CROP_SIZE,        // arg1 x arg2, 0 x 0 for the frame
+        CAMERA_CMD_TENSOR_TYPE,             // arg1 TENSOR_UINT8/FLOAT32, arg2 TENSOR_BGR
+        CAMERA_CMD_TENSOR_NORMALIZE,        // arg1 channel (R, G, B), arg2 mean << 16 | std,
+                                            // both 8.8 fixed point
+        CAMERA_CMD_TENSOR_DECIMATION,       // arg1: one frame in arg1
+    };
+    static const int32_t CAMERA_MSG_TENSOR = 0x10000;
+
     virtual sp<IMemoryHeap> getPreviewHeap() const;
     virtual sp<IMemoryHeap> getRawHeap() const;
 
@@ -123,22 +151,43 @@ private:
             run("CameraPreviewThread", PRIORITY_URGENT_DISPLAY);
         }
         virtual bool threadLoop() {
-            mHardware->previewThread();
-            // loop until we need to quit
-            return true;
+            // loops until the preview is stopped
+            return mHardware->previewThread();
         }
     };
 
     void initDefaultParameters();
     bool initHeapLocked();
-
-    int previewThread();
+    void updateTraceState();
+    int openCamera(int width, int height);
+
+    // The preview thread runs while the preview is started. It draws
+    // while there is a window, and without one still captures for the
+    // callbacks, recording and stills (headless); transitions go through
+    // setPreviewState
+    enum PreviewState {
+        PREVIEW_STOPPED,
+        PREVIEW_WAITING,    // started, sleeping until there is work
+        PREVIEW_RUNNING,
+        PREVIEW_HEADLESS,   // capturing with no window
+    };
+    static const char *previewStateName(PreviewState state);
+    void setPreviewState(PreviewState state);
+    bool framesWanted() const;
+    bool previewThread();
 
     static int beginAutoFocusThread(void *cookie);
     int autoFocusThread();
 
     static int beginPictureThread(void *cookie);
     int pictureThread();
+    static void snapshotDone(void *user, const unsigned char *jpeg, int size);
+    void deliverJpeg(const unsigned char *jpeg, int size);
+    static void tensorDone(void *user, void *token, bool ok);
+
+    static void *beginBracketThread(void *cookie);
+    int bracketThread();
+    void waitBracketThread();
     camera_request_memory   mRequestMemory;
     mutable Mutex           mLock;
     preview_stream_ops_t*  mNativeWindow;
@@ -165,12 +214,41 @@ private:
     int                     mCurrentPreviewFrame;
 
     void *                  framebuffer;
-    bool                    previewStopped;
+    // protected by mLock; mPreviewCondition signals changes of the state
+    // and of mNativeWindow
+    PreviewState            mPreviewState;
+    Condition               mPreviewCondition;
     int                     camera_device;
     void*                   mem[4];
     int                     nQueued;
     int                     nDequeued;
     V4L2Camera              camera;
+    unsigned int            mCaptureFormat;
+    CameraStats             mStats;
+    PreviewWriter           mPreviewWriter;
+    TemporalDenoise         mDenoise;
+    // configured by startRecording, applied to the video frames
+    Stabilizer              mStabilizer;
+    // V4L2 mem2mem conversion per stream, set up by startPreview
+    M2MConverter            mDisplayConverter;
+    M2MConverter            mCallbackConverter;
+    // reduced preview callbacks, set up by startPreview
+    CallbackStream          mCallbackStream;
+    // set up by sendCommand, fed by the preview thread; protected by mLock
+    TensorOutput            mTensor;
+    // takePicture while recording tags the next frame; protected by mLock
+    bool                    mSnapshotPending;
+    SnapshotEncoder         mSnapshot;
+    // ZSL history of the running preview; protected by mLock
+    FrameRing               mZsl;
+    // Exposure bracket; started under mLock, fed by the preview thread,
+    // then fused/encoded on its own thread
+    ExposureBracket         mBracket;
+    bool                    mBracketFusion;
+    // the fuse/encode thread, joined by stopPreview and the destructor
+    pthread_t               mBracketThread;
+    bool                    mBracketJoinable;
+    WorkerPool              mWorkers;
     camera_notify_callback         mNotifyFn;
     camera_data_callback           mDataFn;
     camera_data_timestamp_callback mTimestampFn;
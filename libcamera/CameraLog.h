@@ -0,0 +1,46 @@
+/*
+ *      This program is free software; you can redistribute it and/or modify
+ *      it under the terms of the GNU General Public License as published by
+ *      the Free Software Foundation; either version 2 of the License, or
+ *      (at your option) any later version.
+ *
+ * Logging for the platform-neutral capture core. On Android this is the
+ * regular liblog front end; host builds (CAMERA_HOST_BUILD) print to stderr
+ * so the core can be built and benchmarked without the platform tree.
+ */
+
+#ifndef _CAMERALOG_H
+#define _CAMERALOG_H
+
+#ifndef CAMERA_HOST_BUILD
+
+#include <utils/Log.h>
+
+#else
+
+#include <stdio.h>
+
+#ifndef LOG_TAG
+#define LOG_TAG NULL
+#endif
+
+#define CAMERA_HOST_LOG(prio, ...) \
+    do { \
+        fprintf(stderr, "%s/%s: ", prio, LOG_TAG ? LOG_TAG : "camera"); \
+        fprintf(stderr, __VA_ARGS__); \
+        fputc('\n', stderr); \
+    } while (0)
+
+#define ALOGE(...) CAMERA_HOST_LOG("E", __VA_ARGS__)
+#define ALOGW(...) CAMERA_HOST_LOG("W", __VA_ARGS__)
+#ifdef CAMERA_HOST_VERBOSE
+#define ALOGI(...) CAMERA_HOST_LOG("I", __VA_ARGS__)
+#define ALOGD(...) CAMERA_HOST_LOG("D", __VA_ARGS__)
+#else
+#define ALOGI(...) do { } while (0)
+#define ALOGD(...) do { } while (0)
+#endif
+
+#endif // CAMERA_HOST_BUILD
+
+#endif
@@ -0,0 +1,231 @@
+/*
+ *      This program is free software; you can redistribute it and/or modify
+ *      it under the terms of the GNU General Public License as published by
+ *      the Free Software Foundation; either version 2 of the License, or
+ *      (at your option) any later version.
+ *
+ */
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "CameraStats.h"
+#include "CameraTrace.h"
+
+namespace android {
+
+static void dumpPrintf (int fd, const char *fmt, ...) __attribute__((format(printf, 2, 3)));
+
+static void dumpPrintf (int fd, const char *fmt, ...)
+{
+    char buf[256];
+    va_list ap;
+    int len;
+
+    va_start(ap, fmt);
+    len = vsnprintf(buf, sizeof(buf), fmt, ap);
+    va_end(ap);
+    if (len > (int) sizeof(buf) - 1)
+        len = sizeof(buf) - 1;
+    if (len > 0)
+        write(fd, buf, len);
+}
+
+StatsHistogram::StatsHistogram (const char *n, const char *u)
+    : name(n), unit(u)
+{
+    reset();
+}
+
+void StatsHistogram::add (uint64_t value)
+{
+    int bucket = 0;
+
+    for (uint64_t v = value; v && bucket < kBuckets - 1; v >>= 1)
+        bucket++;
+
+    __sync_fetch_and_add(&buckets[bucket], 1);
+    __sync_fetch_and_add(&samples, 1);
+    __sync_fetch_and_add(&sum, value);
+
+    uint64_t old = max;
+    while (value > old && !__sync_bool_compare_and_swap(&max, old, value))
+        old = max;
+}
+
+void StatsHistogram::reset ()
+{
+    for (int i = 0; i < kBuckets; i++)
+        buckets[i] = 0;
+    samples = 0;
+    sum = 0;
+    max = 0;
+}
+
+uint64_t StatsHistogram::percentile (double p) const
+{
+    uint64_t total = samples;
+    uint64_t target = (uint64_t) (total * p / 100.0 + 0.5);
+    uint64_t seen = 0;
+
+    if (!total)
+        return 0;
+    for (int i = 0; i < kBuckets; i++) {
+        seen += buckets[i];
+        if (seen >= target && seen)
+            return i ? (1ULL << i) - 1 : 0;
+    }
+    return max;
+}
+
+void StatsHistogram::dump (int fd) const
+{
+    uint64_t n = samples;
+
+    if (!n) {
+        dumpPrintf(fd, "    %-14s no samples\n", name);
+        return;
+    }
+
+    dumpPrintf(fd, "    %-14s n=%llu mean=%llu p50<=%llu p99<=%llu max=%llu %s\n", name,
+               (unsigned long long) n, (unsigned long long) (sum / n),
+               (unsigned long long) percentile(50), (unsigned long long) percentile(99),
+               (unsigned long long) max, unit);
+
+    /* Non-empty buckets as "<upper bound>:<count>" */
+    char line[256];
+    int len = snprintf(line, sizeof(line), "      ");
+    for (int i = 0; i < kBuckets; i++) {
+        if (!buckets[i])
+            continue;
+        if (len > (int) sizeof(line) - 32) {
+            dumpPrintf(fd, "%s\n", line);
+            len = snprintf(line, sizeof(line), "      ");
+        }
+        len += snprintf(line + len, sizeof(line) - len, " <%llu:%u",
+                        (unsigned long long) (1ULL << i), buckets[i]);
+    }
+    dumpPrintf(fd, "%s\n", line);
+}
+
+static const char *kMilestoneNames[SessionTimeline::MILESTONE_COUNT] = {
+    "preview stopped", "open", "s_fmt", "reqbufs", "mmap", "streamon",
+    "first frame", "shutter", "jpeg done",
+};
+
+SessionTimeline::SessionTimeline (const char *n)
+    : name(n), sessions(0), startNs(0)
+{
+    for (int i = 0; i < MILESTONE_COUNT; i++)
+        markNs[i] = 0;
+}
+
+void SessionTimeline::start ()
+{
+    for (int i = 0; i < MILESTONE_COUNT; i++)
+        markNs[i] = 0;
+    startNs = cameraNowNs();
+    sessions++;
+}
+
+void SessionTimeline::mark (Milestone milestone)
+{
+    if (!startNs || markNs[milestone])
+        return;
+    markNs[milestone] = cameraNowNs();
+
+    if (CameraTrace::enabled()) {
+        CameraTrace::begin(kMilestoneNames[milestone], sessions);
+        CameraTrace::end();
+    }
+}
+
+void SessionTimeline::dump (int fd) const
+{
+    if (!sessions) {
+        dumpPrintf(fd, "    %-14s none yet\n", name);
+        return;
+    }
+
+    char line[256];
+    int len = snprintf(line, sizeof(line), "    %-14s #%u:", name, sessions);
+    for (int i = 0; i < MILESTONE_COUNT && len < (int) sizeof(line); i++) {
+        if (!markNs[i])
+            continue;
+        len += snprintf(line + len, sizeof(line) - len, " %s +%.1fms",
+                        kMilestoneNames[i], (markNs[i] - startNs) / 1e6);
+    }
+    dumpPrintf(fd, "%s\n", line);
+}
+
+CameraStats::CameraStats ()
+    : dqbufWait("dqbuf wait", "us"),
+      denoise("denoise", "us"),
+      stabilize("stabilize", "us"),
+      conversion("conversion", "us"),
+      callbackStream("callback stream", "us"),
+      callback("callback", "us"),
+      tensor("tensor", "us"),
+      occupancy("queued bufs", "buffers"),
+      jpegEncode("jpeg encode", "us"),
+      jpegSize("jpeg size", "bytes"),
+      previewStart("preview start"),
+      picture("picture")
+{
+    reset();
+}
+
+void CameraStats::reset ()
+{
+    captured = 0;
+    dropped = 0;
+    displayed = 0;
+    delivered = 0;
+    pictures = 0;
+    haveSequence = false;
+    lastSequence = 0;
+
+    dqbufWait.reset();
+    denoise.reset();
+    stabilize.reset();
+    conversion.reset();
+    callbackStream.reset();
+    callback.reset();
+    tensor.reset();
+    occupancy.reset();
+    jpegEncode.reset();
+    jpegSize.reset();
+}
+
+void CameraStats::frameCaptured (unsigned int sequence)
+{
+    int gap = (int) (sequence - lastSequence);
+    if (haveSequence && gap > 1)
+        __sync_fetch_and_add(&dropped, gap - 1);
+    haveSequence = true;
+    lastSequence = sequence;
+    __sync_fetch_and_add(&captured, 1);
+}
+
+void CameraStats::dump (int fd) const
+{
+    dumpPrintf(fd, "  frames: captured %u, dropped %u, displayed %u, delivered %u; pictures %u\n",
+               captured, dropped, displayed, delivered, pictures);
+    dqbufWait.dump(fd);
+    denoise.dump(fd);
+    stabilize.dump(fd);
+    conversion.dump(fd);
+    callbackStream.dump(fd);
+    callback.dump(fd);
+    tensor.dump(fd);
+    occupancy.dump(fd);
+    jpegEncode.dump(fd);
+    jpegSize.dump(fd);
+    dumpPrintf(fd, "  last sessions:\n");
+    previewStart.dump(fd);
+    picture.dump(fd);
+}
+
+}; // namespace android
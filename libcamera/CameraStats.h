@@ -0,0 +1,128 @@
+/*
+ *      This program is free software; you can redistribute it and/or modify
+ *      it under the terms of the GNU General Public License as published by
+ *      the Free Software Foundation; either version 2 of the License, or
+ *      (at your option) any later version.
+ *
+ * Runtime statistics for dump(). Updates are single atomic adds so the
+ * capture path never takes a lock; dump() reads them without stopping the
+ * stream and may see a frame's counters only partly updated.
+ */
+
+#ifndef _CAMERASTATS_H
+#define _CAMERASTATS_H
+
+#include <stdint.h>
+#include <time.h>
+
+namespace android {
+
+static inline int64_t cameraNowNs ()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t) ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+/* Power of two histogram: bucket i counts values in [2^(i-1), 2^i) */
+class StatsHistogram {
+
+public:
+    enum { kBuckets = 33 };
+
+    StatsHistogram (const char *name, const char *unit);
+
+    void add (uint64_t value);
+    void reset ();
+
+    uint64_t count () const { return samples; }
+    /* Upper bound of the bucket holding the p-th percentile */
+    uint64_t percentile (double p) const;
+
+    void dump (int fd) const;
+
+private:
+    const char *name;
+    const char *unit;
+    volatile uint32_t buckets[kBuckets];
+    volatile uint64_t samples;
+    volatile uint64_t sum;
+    volatile uint64_t max;
+};
+
+/* Milestones of one preview start or picture, in ms since the session
+ * began. Each milestone is also emitted as a trace slice. */
+class SessionTimeline {
+
+public:
+    enum Milestone {
+        PREVIEW_STOPPED,
+        OPEN,
+        S_FMT,
+        REQBUFS,
+        MMAP,
+        STREAMON,
+        FIRST_FRAME,
+        SHUTTER,
+        JPEG_DONE,
+        MILESTONE_COUNT
+    };
+
+    SessionTimeline (const char *name);
+
+    void start ();
+    void mark (Milestone milestone);
+    void dump (int fd) const;
+
+private:
+    const char *name;
+    volatile uint32_t sessions;
+    volatile int64_t startNs;
+    volatile int64_t markNs[MILESTONE_COUNT];
+};
+
+class CameraStats {
+
+public:
+    CameraStats ();
+
+    void reset ();
+    void dump (int fd) const;
+
+    /* Counts driver drops from forward gaps in the V4L2 sequence. Called
+     * from the capture thread only. */
+    void frameCaptured (unsigned int sequence);
+    /* The sequence restarts at 0 on STREAMON; call before the first frame */
+    void streamStarted () { haveSequence = false; }
+    void frameDisplayed () { __sync_fetch_and_add(&displayed, 1); }
+    void frameDelivered () { __sync_fetch_and_add(&delivered, 1); }
+    void pictureTaken () { __sync_fetch_and_add(&pictures, 1); }
+
+    StatsHistogram dqbufWait;       /* us */
+    StatsHistogram denoise;         /* us */
+    StatsHistogram stabilize;       /* us, recording only */
+    StatsHistogram conversion;      /* us */
+    StatsHistogram callbackStream;  /* us, reduced callback frames */
+    StatsHistogram callback;        /* us */
+    StatsHistogram tensor;          /* us, on the tensor worker */
+    StatsHistogram occupancy;       /* buffers queued in the driver */
+    StatsHistogram jpegEncode;      /* us */
+    StatsHistogram jpegSize;        /* bytes */
+
+    SessionTimeline previewStart;
+    SessionTimeline picture;
+
+private:
+    volatile uint32_t captured;
+    volatile uint32_t dropped;
+    volatile uint32_t displayed;
+    volatile uint32_t delivered;
+    volatile uint32_t pictures;
+
+    bool haveSequence;
+    unsigned int lastSequence;
+};
+
+}; // namespace android
+
+#endif
@@ -0,0 +1,71 @@
+/*
+ *      This program is free software; you can redistribute it and/or modify
+ *      it under the terms of the GNU General Public License as published by
+ *      the Free Software Foundation; either version 2 of the License, or
+ *      (at your option) any later version.
+ *
+ */
+
+#define LOG_TAG "CameraTrace"
+#include "CameraLog.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "CameraTrace.h"
+
+namespace android {
+
+volatile bool CameraTrace::sEnabled = false;
+int CameraTrace::sFd = -1;
+
+static const char *kTraceMarkers[] = {
+    "/sys/kernel/tracing/trace_marker",
+    "/sys/kernel/debug/tracing/trace_marker",
+};
+
+void CameraTrace::setEnabled (bool enable)
+{
+    if (enable && sFd < 0) {
+        for (size_t i = 0; i < sizeof(kTraceMarkers) / sizeof(kTraceMarkers[0]) && sFd < 0; i++)
+            sFd = open(kTraceMarkers[i], O_WRONLY | O_CLOEXEC);
+        if (sFd < 0) {
+            ALOGW("setEnabled: cannot open trace_marker: %s", strerror(errno));
+            enable = false;
+        }
+    }
+    sEnabled = enable;
+}
+
+void CameraTrace::write (const char *buf, int len)
+{
+    if (len <= 0)
+        return;
+    if (len > 255)
+        len = 255;
+    if (::write(sFd, buf, len) < 0 && errno == EBADF)
+        sEnabled = false;
+}
+
+void CameraTrace::begin (const char *name, unsigned int frame)
+{
+    char buf[256];
+    write(buf, snprintf(buf, sizeof(buf), "B|%d|%s %u", getpid(), name, frame));
+}
+
+void CameraTrace::end ()
+{
+    char buf[32];
+    write(buf, snprintf(buf, sizeof(buf), "E|%d", getpid()));
+}
+
+void CameraTrace::counter (const char *name, int64_t value)
+{
+    char buf[256];
+    write(buf, snprintf(buf, sizeof(buf), "C|%d|%s|%lld", getpid(), name, (long long) value));
+}
+
+}; // namespace android
@@ -0,0 +1,67 @@
+/*
+ *      This program is free software; you can redistribute it and/or modify
+ *      it under the terms of the GNU General Public License as published by
+ *      the Free Software Foundation; either version 2 of the License, or
+ *      (at your option) any later version.
+ *
+ * Per-frame trace points written to the ftrace trace_marker in the atrace
+ * text format, so they show up as slices and counters in systrace and
+ * perfetto. Disabled trace points cost one load and a branch.
+ */
+
+#ifndef _CAMERATRACE_H
+#define _CAMERATRACE_H
+
+#include <stdint.h>
+
+namespace android {
+
+class CameraTrace {
+
+public:
+    /* Opens trace_marker on first enable; stays off if that fails */
+    static void setEnabled (bool enable);
+    static bool enabled () { return sEnabled; }
+
+    /* Slice "<name> <frame>" on the calling thread */
+    static void begin (const char *name, unsigned int frame);
+    static void end ();
+
+    static void counter (const char *name, int64_t value);
+
+private:
+    static void write (const char *buf, int len);
+
+    static volatile bool sEnabled;
+    static int sFd;
+};
+
+class CameraTraceScope {
+
+public:
+    CameraTraceScope (const char *name, unsigned int frame)
+        : active(CameraTrace::enabled())
+    {
+        if (active)
+            CameraTrace::begin(name, frame);
+    }
+    ~CameraTraceScope ()
+    {
+        if (active)
+            CameraTrace::end();
+    }
+
+private:
+    bool active;
+};
+
+}; // namespace android
+
+#define CAMERA_TRACE_BEGIN(name, frame) \
+    do { if (android::CameraTrace::enabled()) android::CameraTrace::begin(name, frame); } while (0)
+#define CAMERA_TRACE_END() \
+    do { if (android::CameraTrace::enabled()) android::CameraTrace::end(); } while (0)
+#define CAMERA_TRACE_COUNTER(name, value) \
+    do { if (android::CameraTrace::enabled()) android::CameraTrace::counter(name, value); } while (0)
+
+#endif
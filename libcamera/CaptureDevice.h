@@ -0,0 +1,67 @@
+/*
+ *      This program is free software; you can redistribute it and/or modify
+ *      it under the terms of the GNU General Public License as published by
+ *      the Free Software Foundation; either version 2 of the License, or
+ *      (at your option) any later version.
+ *
+ * Capture backend interface. V4L2Camera talks to a real video node;
+ * FakeCamera replays a file so tools can run without /dev/video*.
+ */
+
+#ifndef _CAPTUREDEVICE_H
+#define _CAPTUREDEVICE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace android {
+
+class CaptureDevice {
+
+public:
+    virtual ~CaptureDevice() {}
+
+    virtual int Open (const char *device, int width, int height, int pixelformat) = 0;
+    virtual void Close () = 0;
+
+    /* V4L2 fourcc of the frames actually delivered, valid after Open */
+    virtual unsigned int GetPixelFormat () = 0;
+
+    virtual int Init () = 0;
+    virtual void Uninit () = 0;
+
+    virtual int StartStreaming () = 0;
+    virtual int StopStreaming () = 0;
+
+    virtual void * GrabPreviewFrame () = 0;
+    virtual void ReleasePreviewFrame () = 0;
+
+    /* Keep the last dequeued frame instead of releasing it, e.g. while it
+     * is encoded on another thread; the returned id goes back through
+     * ReleaseHeldFrame, from any thread */
+    virtual int HoldFrame () = 0;
+    virtual void ReleaseHeldFrame (int id) = 0;
+
+    /* Capture time (CLOCK_MONOTONIC ns, 0 if unknown) and sequence number
+     * of the last dequeued frame */
+    virtual int64_t GetFrameTimestamp () = 0;
+    virtual unsigned int GetFrameSequence () = 0;
+
+    /* Payload of the last dequeued frame in bytes, and the frame as a
+     * dma-buf fd owned by the device (valid until Uninit), or -1 if the
+     * buffers cannot be exported */
+    virtual size_t GetFrameSize () = 0;
+    virtual int GetFrameFd () = 0;
+
+    virtual int GrabJpegFrame (void *jpeg, size_t size) = 0;
+
+    /* V4L2 controls (V4L2_CID_*), usable while streaming; -1 if the
+     * device does not have the control. QueryControl gives its range. */
+    virtual int GetControl (unsigned int id, int *value) = 0;
+    virtual int SetControl (unsigned int id, int value) = 0;
+    virtual int QueryControl (unsigned int id, int *minimum, int *maximum) = 0;
+};
+
+}; // namespace android
+
+#endif
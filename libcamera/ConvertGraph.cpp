@@ -0,0 +1,343 @@
+/*
+ *      This program is free software; you can redistribute it and/or modify
+ *      it under the terms of the GNU General Public License as published by
+ *      the Free Software Foundation; either version 2 of the License, or
+ *      (at your option) any later version.
+ *
+ */
+
+#define LOG_TAG "ConvertGraph"
+#include "CameraLog.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "ConvertGraph.h"
+#include "convert.h"
+
+namespace android {
+
+/* The tiled converters for each packed 4:2:2 order and output set */
+#define TILED_KERNELS(NAME, ORDER) \
+static void NAME##Pair (const unsigned char *src, unsigned char *rgb565, unsigned char *yuv, \
+                        int width, int height, int flags) \
+{ \
+    convertPacked422_tiled((unsigned char *) src, ORDER, rgb565, yuv, width, height, flags); \
+} \
+static void NAME##PairNV12 (const unsigned char *src, unsigned char *rgb565, unsigned char *yuv, \
+                            int width, int height, int flags) \
+{ \
+    convertPacked422_tiled((unsigned char *) src, ORDER, rgb565, yuv, width, height, flags | CONVERT_NV12); \
+} \
+static void NAME##RGB565 (const unsigned char *src, unsigned char *rgb565, unsigned char *, \
+                          int width, int height, int flags) \
+{ \
+    convertPacked422_tiled((unsigned char *) src, ORDER, rgb565, NULL, width, height, flags); \
+} \
+static void NAME##NV21 (const unsigned char *src, unsigned char *yuv, unsigned char *, \
+                        int width, int height, int flags) \
+{ \
+    convertPacked422_tiled((unsigned char *) src, ORDER, NULL, yuv, width, height, flags); \
+} \
+static void NAME##NV12 (const unsigned char *src, unsigned char *yuv, unsigned char *, \
+                        int width, int height, int flags) \
+{ \
+    convertPacked422_tiled((unsigned char *) src, ORDER, NULL, yuv, width, height, flags | CONVERT_NV12); \
+}
+
+TILED_KERNELS(yuyv, PACKED422_YUYV)
+TILED_KERNELS(uyvy, PACKED422_UYVY)
+TILED_KERNELS(yvyu, PACKED422_YVYU)
+TILED_KERNELS(vyuy, PACKED422_VYUY)
+
+/* The C fallback of the tiled converters reads the byte order from a
+ * table and does not vectorise: without SSE2 the templates beat it */
+#define TILED_ENTRIES(IN, NAME) \
+    { IN, { PIX_FMT_RGB565, PIX_FMT_NV21 }, COLOR_BT601, RANGE_LIMITED, CONVERT_COST(970, 3960), NAME##Pair, "tiled" }, \
+    { IN, { PIX_FMT_RGB565, PIX_FMT_NV12 }, COLOR_BT601, RANGE_LIMITED, CONVERT_COST(970, 3960), NAME##PairNV12, "tiled" }, \
+    { IN, { PIX_FMT_RGB565, -1 }, COLOR_BT601, RANGE_LIMITED, CONVERT_COST(870, 3080), NAME##RGB565, "tiled" }, \
+    { IN, { PIX_FMT_NV21, -1 }, CONVERT_ANY, CONVERT_ANY, CONVERT_COST(225, 690), NAME##NV21, "tiled" }, \
+    { IN, { PIX_FMT_NV12, -1 }, CONVERT_ANY, CONVERT_ANY, CONVERT_COST(225, 690), NAME##NV12, "tiled" }
+
+/* Kernels that take destination flags; costs as in ConvertKernels.cpp */
+const ConvertPlan::Fused ConvertPlan::kFused[] = {
+    TILED_ENTRIES(PIX_FMT_YUYV, yuyv),
+    TILED_ENTRIES(PIX_FMT_UYVY, uyvy),
+    TILED_ENTRIES(PIX_FMT_YVYU, yvyu),
+    TILED_ENTRIES(PIX_FMT_VYUY, vyuy),
+    { -1, { -1, -1 }, 0, 0, 0, NULL, NULL }
+};
+
+/* Chroma resolution: 4:2:0 < 4:2:2 < RGB. A Bayer mosaic samples each
+ * colour at most every other pixel, so it ranks with 4:2:2. */
+static int chromaDetail (int format)
+{
+    switch (format) {
+    case PIX_FMT_NV12:
+    case PIX_FMT_NV21:
+    case PIX_FMT_I420:
+    case PIX_FMT_YV12:
+        return 0;
+    case PIX_FMT_YUYV:
+    case PIX_FMT_UYVY:
+    case PIX_FMT_YVYU:
+    case PIX_FMT_VYUY:
+    case PIX_FMT_SBGGR8:
+    case PIX_FMT_SBGGR10:
+    case PIX_FMT_SGRBG10:
+    case PIX_FMT_SBGGR12:
+    case PIX_FMT_SBGGR10P:
+    case PIX_FMT_SBGGR12P:
+        return 1;
+    default:
+        return 2;
+    }
+}
+
+static inline bool matches (int want, int have)
+{
+    return have == CONVERT_ANY || have == want;
+}
+
+ConvertPlan::ConvertPlan ()
+    : stepCount(0),
+      totalCost(0),
+      outputCount(0)
+{
+    memset(intermediate, 0, sizeof(intermediate));
+}
+
+ConvertPlan::~ConvertPlan ()
+{
+    clear();
+}
+
+void ConvertPlan::clear ()
+{
+    for (int i = 0; i < PIX_FMT_COUNT; i++) {
+        free(intermediate[i]);
+        intermediate[i] = NULL;
+    }
+    stepCount = 0;
+    totalCost = 0;
+    outputCount = 0;
+}
+
+int ConvertPlan::addPaths (PixelFormat in, const PixelFormat *outs, int count, unsigned int done,
+                           ColorMatrix matrix, ColorRange range, Step *steps, int *nsteps)
+{
+    int added = 0;
+    int kernelCount;
+    const ConvertKernelInfo *kernels = convertKernelTable(&kernelCount);
+
+    for (int o = 0; o < count; o++) {
+        int dist[PIX_FMT_COUNT];
+        Step prev[PIX_FMT_COUNT];
+        bool visited[PIX_FMT_COUNT];
+        /* Never route through a format that would lose chroma detail both
+         * the source and this output have */
+        int floor = chromaDetail(in) < chromaDetail(outs[o]) ? chromaDetail(in) : chromaDetail(outs[o]);
+
+        if (done & (1u << outs[o]))
+            continue;
+
+        /* Dijkstra from everything produced so far */
+        for (int f = 0; f < PIX_FMT_COUNT; f++) {
+            dist[f] = (done & (1u << f)) && chromaDetail(f) >= floor ? 0 : -1;
+            visited[f] = chromaDetail(f) < floor;
+        }
+        for (;;) {
+            int u = -1;
+
+            for (int f = 0; f < PIX_FMT_COUNT; f++)
+                if (!visited[f] && dist[f] >= 0 && (u < 0 || dist[f] < dist[u]))
+                    u = f;
+            if (u < 0 || u == outs[o])
+                break;
+            visited[u] = true;
+
+            for (int k = 0; k < kernelCount; k++) {
+                const ConvertKernelInfo &e = kernels[k];
+                int v = e.out;
+
+                if (e.in != u || !matches(matrix, e.matrix) || !matches(range, e.range))
+                    continue;
+                if (dist[v] < 0 || dist[u] + e.cost < dist[v]) {
+                    Step s = { u, { v, -1 }, e.cost, e.fn, NULL, NULL };
+                    dist[v] = dist[u] + e.cost;
+                    prev[v] = s;
+                }
+            }
+            for (int k = 0; kFused[k].fn; k++) {
+                const Fused &e = kFused[k];
+                int v = e.out[0];
+
+                if (e.in != u || e.out[1] >= 0 || !matches(matrix, e.matrix) || !matches(range, e.range))
+                    continue;
+                if (dist[v] < 0 || dist[u] + e.cost < dist[v]) {
+                    Step s = { u, { v, -1 }, e.cost, NULL, e.fn, e.name };
+                    dist[v] = dist[u] + e.cost;
+                    prev[v] = s;
+                }
+            }
+        }
+        if (dist[outs[o]] < 0)
+            return -1;
+
+        /* Walk back to a produced format, then append in forward order */
+        Step path[PIX_FMT_COUNT];
+        int len = 0;
+        for (int f = outs[o]; !(done & (1u << f)); f = prev[f].in)
+            path[len++] = prev[f];
+        while (len > 0) {
+            Step &s = path[--len];
+            steps[(*nsteps)++] = s;
+            done |= 1u << s.out[0];
+            added += s.cost;
+        }
+    }
+
+    return added;
+}
+
+bool ConvertPlan::build (PixelFormat in, const PixelFormat *outs, int count,
+                         ColorMatrix matrix, ColorRange range, int w, int h)
+{
+    Step trial[PIX_FMT_COUNT];
+    bool found = false;
+
+    clear();
+    if (count < 1 || count > kMaxOutputs)
+        return false;
+    for (int i = 0; i < count; i++)
+        for (int j = 0; j < i; j++)
+            if (outs[i] == outs[j])
+                return false;
+
+    /* Separate paths only (-1), or each fused kernel plus paths for the rest */
+    for (int c = -1; c < 0 || kFused[c].fn; c++) {
+        unsigned int done = 1u << in;
+        int n = 0;
+        int cost = 0;
+
+        if (c >= 0) {
+            const Fused &f = kFused[c];
+            bool usable = f.out[1] >= 0 && matches(matrix, f.matrix) && matches(range, f.range);
+            bool wanted = false;
+
+            /* the output nobody asked for becomes an intermediate */
+            for (int i = 0; usable && i < count; i++)
+                wanted = wanted || outs[i] == f.out[0] || outs[i] == f.out[1];
+            if (!wanted)
+                continue;
+
+            /* a source the fused kernel does not read (Bayer) is first
+             * converted to one it does */
+            if (f.in != in) {
+                PixelFormat fin = (PixelFormat) f.in;
+
+                cost = addPaths(in, &fin, 1, done, matrix, range, trial, &n);
+                if (cost < 0)
+                    continue;
+                done |= 1u << f.in;
+            }
+
+            Step s = { f.in, { f.out[0], f.out[1] }, f.cost, NULL, f.fn, f.name };
+            trial[n++] = s;
+            done |= (1u << f.out[0]) | (1u << f.out[1]);
+            cost += f.cost;
+        }
+
+        int added = addPaths(in, outs, count, done, matrix, range, trial, &n);
+        if (added < 0)
+            continue;
+        if (!found || cost + added < totalCost) {
+            memcpy(steps, trial, n * sizeof(Step));
+            stepCount = n;
+            totalCost = cost + added;
+            found = true;
+        }
+    }
+
+    if (!found) {
+        ALOGE("No conversion from %s to every requested format", pixelFormatName(in));
+        return false;
+    }
+
+    source = in;
+    width = w;
+    height = h;
+    outputCount = count;
+    for (int i = 0; i < count; i++)
+        output[i] = outs[i];
+
+    /* Buffers for formats that are neither the source nor an output */
+    for (int s = 0; s < stepCount; s++) {
+        for (int j = 0; j < 2; j++) {
+            int f = steps[s].out[j];
+            bool isOutput = false;
+
+            if (f < 0 || intermediate[f])
+                continue;
+            for (int i = 0; i < count; i++)
+                isOutput = isOutput || outs[i] == f;
+            if (isOutput)
+                continue;
+            intermediate[f] = (unsigned char *) malloc(pixelFormatFrameSize((PixelFormat) f, w, h));
+            if (!intermediate[f]) {
+                ALOGE("Unable to allocate %s intermediate", pixelFormatName((PixelFormat) f));
+                clear();
+                return false;
+            }
+        }
+    }
+
+    return true;
+}
+
+void ConvertPlan::run (const unsigned char *src, unsigned char *const *dst, int flags) const
+{
+    unsigned char *buf[PIX_FMT_COUNT];
+
+    for (int f = 0; f < PIX_FMT_COUNT; f++)
+        buf[f] = intermediate[f];
+    buf[source] = (unsigned char *) src;
+    for (int i = 0; i < outputCount; i++)
+        if (output[i] != source)
+            buf[output[i]] = dst[i];
+
+    for (int s = 0; s < stepCount; s++) {
+        const Step &step = steps[s];
+
+        if (step.fused)
+            /* intermediates are always cached */
+            step.fused(buf[step.in], buf[step.out[0]], step.out[1] >= 0 ? buf[step.out[1]] : NULL,
+                       width, height, intermediate[step.out[0]] ? 0 : flags);
+        else
+            step.fn(buf[step.in], buf[step.out[0]], width, height);
+    }
+
+    for (int i = 0; i < outputCount; i++)
+        if (output[i] == source)
+            memcpy(dst[i], src, pixelFormatFrameSize((PixelFormat) source, width, height));
+}
+
+void ConvertPlan::describe (char *buf, int size) const
+{
+    int len = 0;
+
+    buf[0] = '\0';
+    for (int s = 0; s < stepCount && len < size; s++) {
+        const Step &step = steps[s];
+
+        len += snprintf(buf + len, size - len, "%s%s->%s%s%s%s%s", s ? ", " : "",
+                        pixelFormatName((PixelFormat) step.in),
+                        pixelFormatName((PixelFormat) step.out[0]),
+                        step.out[1] >= 0 ? "+" : "",
+                        step.out[1] >= 0 ? pixelFormatName((PixelFormat) step.out[1]) : "",
+                        step.name ? " " : "", step.name ? step.name : "");
+    }
+}
+
+}; // namespace android
@@ -0,0 +1,92 @@
+/*
+ *      This program is free software; you can redistribute it and/or modify
+ *      it under the terms of the GNU General Public License as published by
+ *      the Free Software Foundation; either version 2 of the License, or
+ *      (at your option) any later version.
+ *
+ * Conversion paths between pixel formats. The kernels of ConvertKernels.h
+ * and the fused tiled converters are the edges of a graph weighted by
+ * their measured cost; a plan is the cheapest set of kernels producing
+ * every requested output from one source frame. Outputs that share a path
+ * share its intermediate buffers, and a kernel writing two outputs in one
+ * pass is used when it beats the separate paths.
+ */
+
+#ifndef _CONVERTGRAPH_H
+#define _CONVERTGRAPH_H
+
+#include "ConvertKernels.h"
+
+namespace android {
+
+class ConvertPlan {
+
+public:
+    enum { kMaxOutputs = 4 };
+
+    ConvertPlan ();
+    ~ConvertPlan ();
+
+    /* Plan in -> outs[0..count). Fails if an output cannot be reached. */
+    bool build (PixelFormat in, const PixelFormat *outs, int count,
+                ColorMatrix matrix, ColorRange range, int width, int height);
+    void clear ();
+
+    bool valid () const { return outputCount > 0; }
+    int cost () const { return totalCost; }
+
+    /* dst[i] receives outs[i]. flags (CONVERT_DST_UNCACHED) are passed to
+     * the kernels writing the outputs that understand them. */
+    void run (const unsigned char *src, unsigned char *const *dst, int flags) const;
+
+    /* Human readable steps, e.g. "YUYV->RGB565+NV21 (tiled)" */
+    void describe (char *buf, int size) const;
+
+private:
+    typedef void (*FusedKernel)(const unsigned char *src, unsigned char *dst0,
+                                unsigned char *dst1, int width, int height, int flags);
+
+    struct Step {
+        int in;
+        int out[2];         /* out[1] is -1 unless fused */
+        int cost;
+        ConvertKernel fn;
+        FusedKernel fused;
+        const char *name;
+    };
+
+    struct Fused {
+        int in;
+        int out[2];
+        int matrix;
+        int range;
+        int cost;
+        FusedKernel fn;
+        const char *name;
+    };
+
+    static const Fused kFused[];
+
+    /* Append the cheapest path to each of outs from any format in done
+     * (a bit mask), returning the added cost or -1 */
+    static int addPaths (PixelFormat in, const PixelFormat *outs, int count, unsigned int done,
+                         ColorMatrix matrix, ColorRange range, Step *steps, int *nsteps);
+
+    /* Not copyable: owns the intermediate buffers */
+    ConvertPlan (const ConvertPlan &);
+    ConvertPlan &operator= (const ConvertPlan &);
+
+    Step steps[PIX_FMT_COUNT];
+    int stepCount;
+    int totalCost;
+    int source;
+    int output[kMaxOutputs];
+    int outputCount;
+    int width;
+    int height;
+    unsigned char *intermediate[PIX_FMT_COUNT];
+};
+
+}; // namespace android
+
+#endif
@@ -0,0 +1,236 @@
+/*
+ *      This program is free software; you can redistribute it and/or modify
+ *      it under the terms of the GNU General Public License as published by
+ *      the Free Software Foundation; either version 2 of the License, or
+ *      (at your option) any later version.
+ *
+ */
+
+#include <stddef.h>
+#include <linux/videodev2.h>
+
+#include "ConvertKernels.h"
+#include "convert.h"
+
+namespace android {
+
+using namespace kernels;
+
+/*
+ * cost is roughly picoseconds per pixel of a 1080p frame, measured with
+ * convert_bench on the host. Only the ratios matter: they let
+ * ConvertGraph prefer one fused kernel over a chain through intermediate
+ * formats. The templates below are plain C vectorised by the compiler on
+ * every target; kernels with hand written SIMD are costed per target
+ * (CONVERT_COST, HAVE_NEON_CONVERT).
+ */
+
+#define ANY CONVERT_ANY
+
+/* The raw kernels are C; these give them the kernel signature */
+template <int Bits, int Packing, int Pattern>
+static void bayerToYUYV (const unsigned char *src, unsigned char *dst, int width, int height)
+{
+    static const struct raw_format fmt = { Bits, Packing, Pattern, 0, 256 };
+
+    bayer_to_yuyv(src, &fmt, dst, width, height, DEMOSAIC_EDGE_AWARE);
+}
+
+template <int Bits>
+static void mipiUnpack16 (const unsigned char *src, unsigned char *dst, int width, int height)
+{
+    static const struct raw_format fmt = { Bits, RAW_MIPI, BAYER_BGGR, 0, 256 };
+    const int rowBytes = raw_row_bytes(&fmt, width);
+
+    for (int y = 0; y < height; y++)
+        raw_unpack_row16(src + y * rowBytes, &fmt, (unsigned short *) dst + y * width, width);
+}
+
+#define RGB_KERNEL(K, IN, In, OUT, Out, MATRIX, RANGE, COST) \
+    { IN, OUT, MATRIX, RANGE, COST, K<In, Out, Coefficients<MATRIX, RANGE> > }
+
+#define RGB_KERNELS(K, IN, In, OUT, Out, COST) \
+    RGB_KERNEL(K, IN, In, OUT, Out, COLOR_BT601, RANGE_LIMITED, COST), \
+    RGB_KERNEL(K, IN, In, OUT, Out, COLOR_BT601, RANGE_FULL, COST), \
+    RGB_KERNEL(K, IN, In, OUT, Out, COLOR_BT709, RANGE_LIMITED, COST), \
+    RGB_KERNEL(K, IN, In, OUT, Out, COLOR_BT709, RANGE_FULL, COST)
+
+#define PACKED422_KERNELS(IN, In) \
+    RGB_KERNELS(packed422ToRGB, IN, In, PIX_FMT_RGB565, RGB565, 2100), \
+    RGB_KERNELS(packed422ToRGB, IN, In, PIX_FMT_RGB888, RGB888, 5000), \
+    RGB_KERNELS(packed422ToRGB, IN, In, PIX_FMT_RGBA8888, RGBA8888, 4500), \
+    { IN, PIX_FMT_NV12, ANY, ANY, 220, packed422ToYuv420<In, NV12> }, \
+    { IN, PIX_FMT_NV21, ANY, ANY, 220, packed422ToYuv420<In, NV21> }, \
+    { IN, PIX_FMT_I420, ANY, ANY, 720, packed422ToYuv420<In, I420> }, \
+    { IN, PIX_FMT_YV12, ANY, ANY, 720, packed422ToYuv420<In, YV12> }
+
+#define YUV420_KERNELS(IN, In) \
+    RGB_KERNELS(yuv420ToRGB, IN, In, PIX_FMT_RGB565, RGB565, 2100), \
+    RGB_KERNELS(yuv420ToRGB, IN, In, PIX_FMT_RGB888, RGB888, 4500), \
+    RGB_KERNELS(yuv420ToRGB, IN, In, PIX_FMT_RGBA8888, RGBA8888, 4400)
+
+#define REPACK_KERNEL(IN, In, OUT, Out) \
+    { IN, OUT, ANY, ANY, 140, yuv420Repack<In, Out> }
+
+#ifdef HAVE_NEON_CONVERT
+static void yuyvToNV21Neon (const unsigned char *src, unsigned char *dst, int width, int height)
+{
+    yuyv422_to_yuv420sp_neon((unsigned char *) src, dst, width, height);
+}
+#endif
+
+static const ConvertKernelInfo kKernels[] = {
+#ifdef HAVE_NEON_CONVERT
+    /* convert.S; ahead of the template so findConvertKernel returns it */
+    { PIX_FMT_YUYV, PIX_FMT_NV21, ANY, ANY, 180, yuyvToNV21Neon },
+#endif
+    PACKED422_KERNELS(PIX_FMT_YUYV, YUYV),
+    { PIX_FMT_YUYV, PIX_FMT_UYVY, ANY, ANY, 200, packed422Swizzle<YUYV, UYVY> },
+    PACKED422_KERNELS(PIX_FMT_UYVY, UYVY),
+    { PIX_FMT_UYVY, PIX_FMT_YUYV, ANY, ANY, 200, packed422Swizzle<UYVY, YUYV> },
+    PACKED422_KERNELS(PIX_FMT_YVYU, YVYU),
+    { PIX_FMT_YVYU, PIX_FMT_YUYV, ANY, ANY, 200, packed422Swizzle<YVYU, YUYV> },
+    PACKED422_KERNELS(PIX_FMT_VYUY, VYUY),
+    { PIX_FMT_VYUY, PIX_FMT_YUYV, ANY, ANY, 200, packed422Swizzle<VYUY, YUYV> },
+    YUV420_KERNELS(PIX_FMT_NV12, NV12),
+    YUV420_KERNELS(PIX_FMT_NV21, NV21),
+    YUV420_KERNELS(PIX_FMT_I420, I420),
+    YUV420_KERNELS(PIX_FMT_YV12, YV12),
+    REPACK_KERNEL(PIX_FMT_NV12, NV12, PIX_FMT_NV21, NV21),
+    REPACK_KERNEL(PIX_FMT_NV12, NV12, PIX_FMT_I420, I420),
+    REPACK_KERNEL(PIX_FMT_NV12, NV12, PIX_FMT_YV12, YV12),
+    REPACK_KERNEL(PIX_FMT_NV21, NV21, PIX_FMT_NV12, NV12),
+    REPACK_KERNEL(PIX_FMT_NV21, NV21, PIX_FMT_I420, I420),
+    REPACK_KERNEL(PIX_FMT_NV21, NV21, PIX_FMT_YV12, YV12),
+    REPACK_KERNEL(PIX_FMT_I420, I420, PIX_FMT_NV12, NV12),
+    REPACK_KERNEL(PIX_FMT_I420, I420, PIX_FMT_NV21, NV21),
+    REPACK_KERNEL(PIX_FMT_I420, I420, PIX_FMT_YV12, YV12),
+    REPACK_KERNEL(PIX_FMT_YV12, YV12, PIX_FMT_NV12, NV12),
+    REPACK_KERNEL(PIX_FMT_YV12, YV12, PIX_FMT_NV21, NV21),
+    REPACK_KERNEL(PIX_FMT_YV12, YV12, PIX_FMT_I420, I420),
+    /* demosaic produces BT.601 limited range */
+    { PIX_FMT_SBGGR8, PIX_FMT_YUYV, COLOR_BT601, RANGE_LIMITED, 1450, bayerToYUYV<8, RAW_UNPACKED, BAYER_BGGR> },
+    { PIX_FMT_SBGGR10, PIX_FMT_YUYV, COLOR_BT601, RANGE_LIMITED, 1550, bayerToYUYV<10, RAW_UNPACKED, BAYER_BGGR> },
+    { PIX_FMT_SGRBG10, PIX_FMT_YUYV, COLOR_BT601, RANGE_LIMITED, 1550, bayerToYUYV<10, RAW_UNPACKED, BAYER_GRBG> },
+    { PIX_FMT_SBGGR12, PIX_FMT_YUYV, COLOR_BT601, RANGE_LIMITED, 1550, bayerToYUYV<12, RAW_UNPACKED, BAYER_BGGR> },
+    { PIX_FMT_SBGGR10P, PIX_FMT_YUYV, COLOR_BT601, RANGE_LIMITED, 1450, bayerToYUYV<10, RAW_MIPI, BAYER_BGGR> },
+    { PIX_FMT_SBGGR12P, PIX_FMT_YUYV, COLOR_BT601, RANGE_LIMITED, 1450, bayerToYUYV<12, RAW_MIPI, BAYER_BGGR> },
+    { PIX_FMT_SBGGR10P, PIX_FMT_SBGGR10, ANY, ANY, 300, mipiUnpack16<10> },
+    { PIX_FMT_SBGGR12P, PIX_FMT_SBGGR12, ANY, ANY, 300, mipiUnpack16<12> },
+};
+
+#define KERNEL_COUNT ((int) (sizeof(kKernels) / sizeof(kKernels[0])))
+
+ConvertKernel findConvertKernel (PixelFormat in, PixelFormat out, ColorMatrix matrix, ColorRange range)
+{
+    for (int i = 0; i < KERNEL_COUNT; i++) {
+        const ConvertKernelInfo &k = kKernels[i];
+
+        if (k.in == in && k.out == out &&
+            (k.matrix == ANY || k.matrix == matrix) &&
+            (k.range == ANY || k.range == range))
+            return k.fn;
+    }
+    return NULL;
+}
+
+const ConvertKernelInfo *convertKernelTable (int *count)
+{
+    *count = KERNEL_COUNT;
+    return kKernels;
+}
+
+const char *pixelFormatName (PixelFormat format)
+{
+    static const char *names[PIX_FMT_COUNT] = {
+        "YUYV", "UYVY", "YVYU", "VYUY", "NV12", "NV21", "I420", "YV12", "RGB565", "RGB888", "RGBA8888",
+        "SBGGR8", "SBGGR10", "SGRBG10", "SBGGR12", "SBGGR10P", "SBGGR12P",
+    };
+
+    return format >= 0 && format < PIX_FMT_COUNT ? names[format] : "unknown";
+}
+
+int pixelFormatFrameSize (PixelFormat format, int width, int height)
+{
+    switch (format) {
+    case PIX_FMT_YUYV:
+    case PIX_FMT_UYVY:
+    case PIX_FMT_YVYU:
+    case PIX_FMT_VYUY:
+    case PIX_FMT_RGB565:
+        return width * height * 2;
+    case PIX_FMT_NV12:
+    case PIX_FMT_NV21:
+    case PIX_FMT_I420:
+    case PIX_FMT_YV12:
+        return width * height * 3 / 2;
+    case PIX_FMT_RGB888:
+        return width * height * 3;
+    case PIX_FMT_RGBA8888:
+        return width * height * 4;
+    case PIX_FMT_SBGGR8:
+        return width * height;
+    case PIX_FMT_SBGGR10:
+    case PIX_FMT_SGRBG10:
+    case PIX_FMT_SBGGR12:
+        return width * height * 2;
+    case PIX_FMT_SBGGR10P:
+        return width * height * 5 / 4;
+    case PIX_FMT_SBGGR12P:
+        return width * height * 3 / 2;
+    default:
+        return 0;
+    }
+}
+
+PixelFormat pixelFormatFromFourcc (unsigned int fourcc)
+{
+    switch (fourcc) {
+    case V4L2_PIX_FMT_YUYV:     return PIX_FMT_YUYV;
+    case V4L2_PIX_FMT_UYVY:     return PIX_FMT_UYVY;
+    case V4L2_PIX_FMT_YVYU:     return PIX_FMT_YVYU;
+    case V4L2_PIX_FMT_VYUY:     return PIX_FMT_VYUY;
+    case V4L2_PIX_FMT_NV12:     return PIX_FMT_NV12;
+    case V4L2_PIX_FMT_NV21:     return PIX_FMT_NV21;
+    case V4L2_PIX_FMT_YUV420:   return PIX_FMT_I420;
+    case V4L2_PIX_FMT_YVU420:   return PIX_FMT_YV12;
+    case V4L2_PIX_FMT_RGB565:   return PIX_FMT_RGB565;
+    case V4L2_PIX_FMT_RGB24:    return PIX_FMT_RGB888;
+    case V4L2_PIX_FMT_SBGGR8:   return PIX_FMT_SBGGR8;
+    case V4L2_PIX_FMT_SBGGR10:  return PIX_FMT_SBGGR10;
+    case V4L2_PIX_FMT_SGRBG10:  return PIX_FMT_SGRBG10;
+    case V4L2_PIX_FMT_SBGGR12:  return PIX_FMT_SBGGR12;
+#ifdef V4L2_PIX_FMT_SBGGR10P
+    case V4L2_PIX_FMT_SBGGR10P: return PIX_FMT_SBGGR10P;
+    case V4L2_PIX_FMT_SBGGR12P: return PIX_FMT_SBGGR12P;
+#endif
+    default:                    return PIX_FMT_COUNT;
+    }
+}
+
+unsigned int pixelFormatToFourcc (PixelFormat format)
+{
+    switch (format) {
+    case PIX_FMT_YUYV:      return V4L2_PIX_FMT_YUYV;
+    case PIX_FMT_UYVY:      return V4L2_PIX_FMT_UYVY;
+    case PIX_FMT_YVYU:      return V4L2_PIX_FMT_YVYU;
+    case PIX_FMT_VYUY:      return V4L2_PIX_FMT_VYUY;
+    case PIX_FMT_NV12:      return V4L2_PIX_FMT_NV12;
+    case PIX_FMT_NV21:      return V4L2_PIX_FMT_NV21;
+    case PIX_FMT_I420:      return V4L2_PIX_FMT_YUV420;
+    case PIX_FMT_YV12:      return V4L2_PIX_FMT_YVU420;
+    case PIX_FMT_RGB565:    return V4L2_PIX_FMT_RGB565;
+    case PIX_FMT_RGB888:    return V4L2_PIX_FMT_RGB24;
+    case PIX_FMT_SBGGR8:    return V4L2_PIX_FMT_SBGGR8;
+    case PIX_FMT_SBGGR10:   return V4L2_PIX_FMT_SBGGR10;
+    case PIX_FMT_SGRBG10:   return V4L2_PIX_FMT_SGRBG10;
+    case PIX_FMT_SBGGR12:   return V4L2_PIX_FMT_SBGGR12;
+#ifdef V4L2_PIX_FMT_SBGGR10P
+    case PIX_FMT_SBGGR10P:  return V4L2_PIX_FMT_SBGGR10P;
+    case PIX_FMT_SBGGR12P:  return V4L2_PIX_FMT_SBGGR12P;
+#endif
+    default:                return 0;
+    }
+}
+
+}; // namespace android
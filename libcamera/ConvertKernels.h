@@ -0,0 +1,338 @@
+/*
+ *      This program is free software; you can redistribute it and/or modify
+ *      it under the terms of the GNU General Public License as published by
+ *      the Free Software Foundation; either version 2 of the License, or
+ *      (at your option) any later version.
+ *
+ * Colour conversion kernels specialised at compile time on the input byte
+ * order, the output format, the colour matrix and the range. Every choice
+ * is a template parameter, so each instance is a straight loop without
+ * per-pixel branches that the compiler can vectorise. findConvertKernel()
+ * picks an instance at run time.
+ */
+
+#ifndef _CONVERTKERNELS_H
+#define _CONVERTKERNELS_H
+
+#include <string.h>
+
+namespace android {
+
+enum PixelFormat {
+    PIX_FMT_YUYV,
+    PIX_FMT_UYVY,
+    PIX_FMT_YVYU,
+    PIX_FMT_VYUY,
+    PIX_FMT_NV12,
+    PIX_FMT_NV21,
+    PIX_FMT_I420,
+    PIX_FMT_YV12,
+    PIX_FMT_RGB565,
+    PIX_FMT_RGB888,
+    PIX_FMT_RGBA8888,
+    PIX_FMT_SBGGR8,
+    PIX_FMT_SBGGR10,    /* 16 bit little endian samples */
+    PIX_FMT_SGRBG10,
+    PIX_FMT_SBGGR12,
+    PIX_FMT_SBGGR10P,   /* MIPI CSI-2 packed */
+    PIX_FMT_SBGGR12P,
+    PIX_FMT_COUNT
+};
+
+enum ColorMatrix {
+    COLOR_BT601,
+    COLOR_BT709
+};
+
+enum ColorRange {
+    RANGE_LIMITED,      /* Y 16..235, C 16..240 */
+    RANGE_FULL
+};
+
+typedef void (*ConvertKernel)(const unsigned char *src, unsigned char *dst, int width, int height);
+
+#define CONVERT_ANY -1
+
+/* Cost of a kernel with an SSE2 body and a C fallback: the fallback is
+ * what runs on ARM, where it can be several times slower */
+#ifdef __SSE2__
+#define CONVERT_COST(sse2, c) (sse2)
+#else
+#define CONVERT_COST(sse2, c) (c)
+#endif
+
+struct ConvertKernelInfo {
+    int in;
+    int out;
+    int matrix;     /* CONVERT_ANY for kernels that do not convert colour */
+    int range;
+    int cost;       /* relative, see ConvertKernels.cpp */
+    ConvertKernel fn;
+};
+
+/* Kernel for in -> out, or NULL if there is none. matrix and range only
+ * matter for YUV -> RGB. */
+ConvertKernel findConvertKernel (PixelFormat in, PixelFormat out, ColorMatrix matrix, ColorRange range);
+
+/* Every kernel, for building conversion paths */
+const ConvertKernelInfo *convertKernelTable (int *count);
+
+const char *pixelFormatName (PixelFormat format);
+
+/* V4L2 fourcc to PixelFormat, PIX_FMT_COUNT if there is no match */
+PixelFormat pixelFormatFromFourcc (unsigned int fourcc);
+/* and back, 0 if V4L2 has no equivalent */
+unsigned int pixelFormatToFourcc (PixelFormat format);
+
+/* Bytes of a tightly packed frame; 4:2:0 chroma planes follow the luma
+ * plane without padding */
+int pixelFormatFrameSize (PixelFormat format, int width, int height);
+
+namespace kernels {
+
+/* Byte offsets of the samples in a packed 4:2:2 macropixel */
+template <int Y0, int U, int Y1, int V>
+struct Packed422 {
+    enum { y0 = Y0, u = U, y1 = Y1, v = V };
+};
+
+typedef Packed422<0, 1, 2, 3> YUYV;
+typedef Packed422<1, 0, 3, 2> UYVY;
+typedef Packed422<0, 3, 2, 1> YVYU;
+typedef Packed422<1, 2, 3, 0> VYUY;
+
+/* Chroma placement of a 4:2:0 frame: U or V first, interleaved (semi
+ * planar) or in separate planes */
+template <int UFirst, int Interleaved>
+struct Yuv420 {
+    enum { step = Interleaved ? 2 : 1, uFirst = UFirst };
+
+    static inline int chromaStride (int width)
+    {
+        return Interleaved ? width : width / 2;
+    }
+
+    template <class T>
+    static inline void chroma (T *frame, int width, int height, T **u, T **v)
+    {
+        T *c = frame + width * height;
+        int second = Interleaved ? 1 : width * height / 4;
+
+        *u = UFirst ? c : c + second;
+        *v = UFirst ? c + second : c;
+    }
+};
+
+typedef Yuv420<1, 1> NV12;
+typedef Yuv420<0, 1> NV21;
+typedef Yuv420<1, 0> I420;
+typedef Yuv420<0, 0> YV12;
+
+/* YCbCr -> RGB in 2^14 fixed point */
+template <int Matrix, int Range>
+struct Coefficients;
+
+template <>
+struct Coefficients<COLOR_BT601, RANGE_LIMITED> {
+    enum { yOffset = 16, y = 19071, rv = 26149, gu = 6406, gv = 13320, bu = 33063 };
+};
+
+template <>
+struct Coefficients<COLOR_BT601, RANGE_FULL> {
+    enum { yOffset = 0, y = 16384, rv = 22970, gu = 5638, gv = 11700, bu = 29032 };
+};
+
+template <>
+struct Coefficients<COLOR_BT709, RANGE_LIMITED> {
+    enum { yOffset = 16, y = 19071, rv = 29376, gu = 3490, gv = 8733, bu = 34603 };
+};
+
+template <>
+struct Coefficients<COLOR_BT709, RANGE_FULL> {
+    enum { yOffset = 0, y = 16384, rv = 25802, gu = 3069, gv = 7669, bu = 30402 };
+};
+
+static inline int clamp8 (int v)
+{
+    return v > 255 ? 255 : (v < 0 ? 0 : v);
+}
+
+/* RGB pixel writers; components are already clamped */
+struct RGB565 {
+    enum { bpp = 2 };
+    static inline void put (unsigned char *d, int r, int g, int b)
+    {
+        int v = ((r >> 3) << 11) | ((g >> 2) << 5) | (b >> 3);
+        d[0] = v;
+        d[1] = v >> 8;
+    }
+};
+
+struct RGB888 {
+    enum { bpp = 3 };
+    static inline void put (unsigned char *d, int r, int g, int b)
+    {
+        d[0] = r;
+        d[1] = g;
+        d[2] = b;
+    }
+};
+
+struct RGBA8888 {
+    enum { bpp = 4 };
+    static inline void put (unsigned char *d, int r, int g, int b)
+    {
+        d[0] = r;
+        d[1] = g;
+        d[2] = b;
+        d[3] = 255;
+    }
+};
+
+template <class In, class Out, class Coef>
+void packed422ToRGB (const unsigned char *src, unsigned char *dst, int width, int height)
+{
+    const int pairs = width * height / 2;
+
+    for (int i = 0; i < pairs; i++) {
+        const unsigned char *p = src + i * 4;
+        unsigned char *d = dst + i * 2 * Out::bpp;
+        int y0 = (p[In::y0] - Coef::yOffset) * Coef::y;
+        int y1 = (p[In::y1] - Coef::yOffset) * Coef::y;
+        int u = p[In::u] - 128;
+        int v = p[In::v] - 128;
+        int dr = Coef::rv * v;
+        int dg = -Coef::gu * u - Coef::gv * v;
+        int db = Coef::bu * u;
+
+        Out::put(d, clamp8((y0 + dr) >> 14), clamp8((y0 + dg) >> 14), clamp8((y0 + db) >> 14));
+        Out::put(d + Out::bpp, clamp8((y1 + dr) >> 14), clamp8((y1 + dg) >> 14), clamp8((y1 + db) >> 14));
+    }
+}
+
+/* 4:2:2 -> 4:2:0; chroma of each row pair averaged with truncation, as
+ * the NEON kernel does */
+template <class In, class Out>
+void packed422ToYuv420 (const unsigned char *src, unsigned char *dst, int width, int height)
+{
+    const int cstride = Out::chromaStride(width);
+    unsigned char *u, *v;
+
+    Out::chroma(dst, width, height, &u, &v);
+    for (int y = 0; y < height; y += 2) {
+        const unsigned char *s0 = src + y * width * 2;
+        const unsigned char *s1 = s0 + width * 2;
+        unsigned char *d0 = dst + y * width;
+        unsigned char *d1 = d0 + width;
+        /* semi planar chroma goes through one pointer so the compiler sees
+         * a contiguous store it can vectorise */
+        unsigned char *c = Out::uFirst ? u : v;
+
+        for (int x = 0; x < width / 2; x++) {
+            int cb = (s0[x * 4 + In::u] + s1[x * 4 + In::u]) >> 1;
+            int cr = (s0[x * 4 + In::v] + s1[x * 4 + In::v]) >> 1;
+
+            d0[x * 2] = s0[x * 4 + In::y0];
+            d0[x * 2 + 1] = s0[x * 4 + In::y1];
+            d1[x * 2] = s1[x * 4 + In::y0];
+            d1[x * 2 + 1] = s1[x * 4 + In::y1];
+            if (Out::step == 2) {
+                c[x * 2 + !Out::uFirst] = cb;
+                c[x * 2 + !!Out::uFirst] = cr;
+            } else {
+                u[x] = cb;
+                v[x] = cr;
+            }
+        }
+        u += cstride;
+        v += cstride;
+    }
+}
+
+/* Reorder the samples of a packed 4:2:2 frame */
+template <class In, class Out>
+void packed422Swizzle (const unsigned char *src, unsigned char *dst, int width, int height)
+{
+    const int pairs = width * height / 2;
+
+    for (int i = 0; i < pairs; i++) {
+        const unsigned char *s = src + i * 4;
+        unsigned char *d = dst + i * 4;
+
+        d[Out::y0] = s[In::y0];
+        d[Out::u] = s[In::u];
+        d[Out::y1] = s[In::y1];
+        d[Out::v] = s[In::v];
+    }
+}
+
+template <class In, class Out, class Coef>
+void yuv420ToRGB (const unsigned char *src, unsigned char *dst, int width, int height)
+{
+    const int cstride = In::chromaStride(width);
+    const unsigned char *u, *v;
+
+    In::chroma(src, width, height, &u, &v);
+    for (int y = 0; y < height; y++) {
+        const unsigned char *s = src + y * width;
+        const unsigned char *cu = u + (y / 2) * cstride;
+        const unsigned char *cv = v + (y / 2) * cstride;
+        unsigned char *d = dst + y * width * Out::bpp;
+
+        for (int x = 0; x < width / 2; x++) {
+            int y0 = (s[x * 2] - Coef::yOffset) * Coef::y;
+            int y1 = (s[x * 2 + 1] - Coef::yOffset) * Coef::y;
+            int cb = cu[x * In::step] - 128;
+            int cr = cv[x * In::step] - 128;
+            int dr = Coef::rv * cr;
+            int dg = -Coef::gu * cb - Coef::gv * cr;
+            int db = Coef::bu * cb;
+
+            Out::put(d + x * 2 * Out::bpp,
+                     clamp8((y0 + dr) >> 14), clamp8((y0 + dg) >> 14), clamp8((y0 + db) >> 14));
+            Out::put(d + (x * 2 + 1) * Out::bpp,
+                     clamp8((y1 + dr) >> 14), clamp8((y1 + dg) >> 14), clamp8((y1 + db) >> 14));
+        }
+    }
+}
+
+/* Move the chroma of a 4:2:0 frame into another layout */
+template <class In, class Out>
+void yuv420Repack (const unsigned char *src, unsigned char *dst, int width, int height)
+{
+    const int istride = In::chromaStride(width);
+    const int ostride = Out::chromaStride(width);
+    const unsigned char *su, *sv;
+    unsigned char *du, *dv;
+
+    memcpy(dst, src, width * height);
+    In::chroma(src, width, height, &su, &sv);
+    Out::chroma(dst, width, height, &du, &dv);
+    for (int y = 0; y < height / 2; y++) {
+        const unsigned char *ic = In::uFirst ? su : sv;
+        unsigned char *oc = Out::uFirst ? du : dv;
+
+        for (int x = 0; x < width / 2; x++) {
+            int cb = In::step == 2 ? ic[x * 2 + !In::uFirst] : su[x];
+            int cr = In::step == 2 ? ic[x * 2 + !!In::uFirst] : sv[x];
+
+            if (Out::step == 2) {
+                oc[x * 2 + !Out::uFirst] = cb;
+                oc[x * 2 + !!Out::uFirst] = cr;
+            } else {
+                du[x] = cb;
+                dv[x] = cr;
+            }
+        }
+        su += istride;
+        sv += istride;
+        du += ostride;
+        dv += ostride;
+    }
+}
+
+}; // namespace kernels
+
+}; // namespace android
+
+#endif
@@ -0,0 +1,239 @@
+/*
+ *      This program is free software; you can redistribute it and/or modify
+ *      it under the terms of the GNU General Public License as published by
+ *      the Free Software Foundation; either version 2 of the License, or
+ *      (at your option) any later version.
+ *
+ */
+
+#define LOG_TAG "ExposureBracket"
+#include "CameraLog.h"
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include <linux/videodev2.h>
+
+#include "CameraStats.h"
+#include "ExposureBracket.h"
+
+namespace android {
+
+/* missing frames tolerated per bracket before giving up */
+static const int kMaxRetries = 4;
+
+ExposureBracket::ExposureBracket ()
+    : currentState(IDLE),
+      device(NULL),
+      latency(2),
+      exposureId(0),
+      baseExposure(0),
+      baseAuto(-1),
+      nFrames(0),
+      nCaptured(0),
+      queueHead(0),
+      queueSize(0),
+      restorePending(false),
+      retries(0),
+      convert(NULL),
+      frameWidth(0),
+      frameHeight(0),
+      frameBytes(0),
+      frames(NULL),
+      framesCapacity(0),
+      startNs(0),
+      doneNs(0)
+{
+}
+
+ExposureBracket::~ExposureBracket ()
+{
+    free(frames);
+}
+
+void ExposureBracket::setLatency (int frames)
+{
+    latency = frames < 1 ? 1 : frames;
+}
+
+bool ExposureBracket::start (CaptureDevice *dev, const int *ev, int count,
+                             PixelFormat format, int width, int height)
+{
+    int minimum, maximum;
+
+    if (currentState != IDLE || count < 1)
+        return false;
+    if (count > MAX_FRAMES)
+        count = MAX_FRAMES;
+
+    convert = NULL;
+    if (format != PIX_FMT_YUYV) {
+        convert = findConvertKernel(format, PIX_FMT_YUYV, COLOR_BT601, RANGE_LIMITED);
+        if (!convert) {
+            ALOGW("start: no conversion from %s to YUYV", pixelFormatName(format));
+            return false;
+        }
+    }
+
+    size_t bytes = (size_t) width * height * 2;
+    if (bytes * count > framesCapacity) {
+        free(frames);
+        frames = (unsigned char *) malloc(bytes * count);
+        framesCapacity = frames ? bytes * count : 0;
+        if (!frames)
+            return false;
+    }
+
+    /* absolute exposure (100 us units) where the driver has it */
+    device = dev;
+    exposureId = V4L2_CID_EXPOSURE_ABSOLUTE;
+    if (device->GetControl(exposureId, &baseExposure) < 0 ||
+        device->QueryControl(exposureId, &minimum, &maximum) < 0) {
+        exposureId = V4L2_CID_EXPOSURE;
+        if (device->GetControl(exposureId, &baseExposure) < 0 ||
+            device->QueryControl(exposureId, &minimum, &maximum) < 0) {
+            ALOGW("start: no manual exposure control");
+            return false;
+        }
+    }
+    if (device->GetControl(V4L2_CID_EXPOSURE_AUTO, &baseAuto) < 0)
+        baseAuto = -1;
+    if (baseAuto >= 0 && baseAuto != V4L2_EXPOSURE_MANUAL)
+        device->SetControl(V4L2_CID_EXPOSURE_AUTO, V4L2_EXPOSURE_MANUAL);
+
+    nFrames = count;
+    for (int i = 0; i < count; i++) {
+        int value = (int) (baseExposure * pow(2.0, ev[i] / 10.0) + 0.5);
+
+        evs[i] = ev[i];
+        values[i] = value < minimum ? minimum : (value > maximum ? maximum : value);
+        captured[i] = false;
+        written[i] = false;
+        queue[i] = i;
+    }
+    nCaptured = 0;
+    queueHead = 0;
+    queueSize = count;
+    restorePending = true;
+    retries = 0;
+
+    frameWidth = width;
+    frameHeight = height;
+    frameBytes = bytes;
+
+    startNs = cameraNowNs();
+    currentState = CAPTURING;
+    return true;
+}
+
+void ExposureBracket::writeExposure (int value)
+{
+    device->SetControl(exposureId, value);
+}
+
+void ExposureBracket::restore ()
+{
+    writeExposure(baseExposure);
+    if (baseAuto >= 0 && baseAuto != V4L2_EXPOSURE_MANUAL)
+        device->SetControl(V4L2_CID_EXPOSURE_AUTO, baseAuto);
+}
+
+void ExposureBracket::onFrame (const void *frame, unsigned int sequence)
+{
+    if (currentState != CAPTURING)
+        return;
+
+    for (int i = 0; i < nFrames; i++) {
+        if (!written[i] || captured[i])
+            continue;
+        if (sequence == expected[i]) {
+            unsigned char *dst = frames + (size_t) i * frameBytes;
+
+            if (convert)
+                convert((const unsigned char *) frame, dst, frameWidth, frameHeight);
+            else
+                memcpy(dst, frame, frameBytes);
+            captured[i] = true;
+            nCaptured++;
+        } else if ((int) (sequence - expected[i]) > 0) {
+            /* dropped: write the exposure again, and the base after it */
+            written[i] = false;
+            queue[(queueHead + queueSize++) % MAX_FRAMES] = i;
+            restorePending = true;
+            retries++;
+        }
+    }
+
+    if (nCaptured == nFrames || retries > kMaxRetries) {
+        if (restorePending)
+            restore();
+        doneNs = cameraNowNs();
+        if (nCaptured == nFrames) {
+            ALOGI("onFrame: bracket of %d in %lld us", nFrames, (long long) sequenceUs());
+            currentState = CAPTURED;
+        } else {
+            ALOGE("onFrame: bracket lost %d frames, giving up", retries);
+            currentState = FAILED;
+        }
+        return;
+    }
+
+    /* one control per frame; the base goes right after the last one */
+    if (queueSize) {
+        int i = queue[queueHead];
+
+        queueHead = (queueHead + 1) % MAX_FRAMES;
+        queueSize--;
+        writeExposure(values[i]);
+        written[i] = true;
+        expected[i] = sequence + latency;
+    } else if (restorePending) {
+        restore();
+        restorePending = false;
+    }
+}
+
+void ExposureBracket::cancel ()
+{
+    if (currentState == CAPTURING) {
+        restore();
+        currentState = IDLE;
+    }
+}
+
+void ExposureBracket::finish ()
+{
+    currentState = IDLE;
+}
+
+struct FuseJob {
+    const ExposureBracket *bracket;
+    unsigned char *dst;
+};
+
+void ExposureBracket::fuseStripe (void *arg, int part, int parts)
+{
+    const FuseJob *job = (const FuseJob *) arg;
+    const ExposureBracket *b = job->bracket;
+    const unsigned char *src[MAX_FRAMES];
+    int y0 = b->frameHeight * part / parts;
+    int y1 = b->frameHeight * (part + 1) / parts;
+    size_t offset = (size_t) y0 * b->frameWidth * 2;
+
+    for (int i = 0; i < b->nFrames; i++)
+        src[i] = b->frame(i) + offset;
+    exposure_fuse_yuyv(src, b->nFrames, job->dst + offset, b->frameWidth, y1 - y0);
+}
+
+void ExposureBracket::fuse (WorkerPool *pool, unsigned char *dst) const
+{
+    FuseJob job = { this, dst };
+    /* a few stripes per thread so a slow one does not hold up the rest */
+    int parts = pool->size() * 4;
+
+    if (parts > frameHeight)
+        parts = frameHeight;
+    pool->run(fuseStripe, &job, parts);
+}
+
+}; // namespace android
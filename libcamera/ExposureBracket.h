@@ -0,0 +1,123 @@
+/*
+ *      This program is free software; you can redistribute it and/or modify
+ *      it under the terms of the GNU General Public License as published by
+ *      the Free Software Foundation; either version 2 of the License, or
+ *      (at your option) any later version.
+ *
+ * Exposure bracketing from a running stream. One exposure control is
+ * written per frame, without waiting for the previous one to show up, so
+ * a bracket of n takes n + latency frames instead of n * (latency + 1);
+ * every frame is matched to its exposure by V4L2 sequence number. A frame
+ * that goes missing has its exposure requeued. Bracket members are copied
+ * out (as YUYV) so the stream keeps all of its buffers meanwhile.
+ */
+
+#ifndef _EXPOSUREBRACKET_H
+#define _EXPOSUREBRACKET_H
+
+#include <stdint.h>
+
+#include "CaptureDevice.h"
+#include "ConvertKernels.h"
+#include "WorkerPool.h"
+#include "convert.h"
+
+namespace android {
+
+class ExposureBracket {
+
+public:
+    enum { MAX_FRAMES = FUSE_MAX_FRAMES };
+
+    enum State {
+        IDLE,
+        CAPTURING,      /* fed by onFrame */
+        CAPTURED,       /* frames valid until finish */
+        FAILED          /* frames went missing too often; finish to reset */
+    };
+
+    ExposureBracket ();
+    ~ExposureBracket ();
+
+    /* Frames from writing a control to the first frame exposed with it:
+     * 1 if the next one already is, 2 suits most sensors */
+    void setLatency (int frames);
+
+    /* Arm a bracket of count exposures, ev[i] in tenths of a stop from the
+     * current exposure, for frames of format at width x height. False if
+     * the device has no manual exposure, the format cannot be converted to
+     * YUYV, or out of memory. */
+    bool start (CaptureDevice *device, const int *ev, int count,
+                PixelFormat format, int width, int height);
+
+    /* Every dequeued frame while CAPTURING: writes the next control and
+     * keeps the frame if it carries a bracket exposure */
+    void onFrame (const void *frame, unsigned int sequence);
+
+    /* Stop capturing and put the exposure back */
+    void cancel ();
+
+    /* Release the frames, back to IDLE */
+    void finish ();
+
+    State state () const { return (State) currentState; }
+
+    int count () const { return nFrames; }
+    int ev (int i) const { return evs[i]; }
+    const unsigned char *frame (int i) const { return frames + (size_t) i * frameBytes; }
+    int width () const { return frameWidth; }
+    int height () const { return frameHeight; }
+
+    /* Start to last frame in us */
+    int64_t sequenceUs () const { return (doneNs - startNs) / 1000; }
+
+    /* All frames fused into dst (YUYV), in stripes over pool */
+    void fuse (WorkerPool *pool, unsigned char *dst) const;
+
+private:
+    static void fuseStripe (void *arg, int part, int parts);
+    void writeExposure (int value);
+    void restore ();
+
+    /* Not copyable: owns the frames */
+    ExposureBracket (const ExposureBracket &);
+    ExposureBracket &operator= (const ExposureBracket &);
+
+    volatile int currentState;
+    CaptureDevice *device;
+    int latency;
+
+    /* the control written and how the device was set before */
+    unsigned int exposureId;
+    int baseExposure;
+    int baseAuto;               /* V4L2_CID_EXPOSURE_AUTO, -1 if absent */
+
+    int nFrames;
+    int evs[MAX_FRAMES];
+    int values[MAX_FRAMES];
+    bool captured[MAX_FRAMES];
+    int nCaptured;
+
+    /* exposures to write, oldest first, and the frame each one lands on */
+    int queue[MAX_FRAMES];
+    int queueHead;
+    int queueSize;
+    bool written[MAX_FRAMES];
+    unsigned int expected[MAX_FRAMES];
+    bool restorePending;
+    int retries;
+
+    ConvertKernel convert;
+    int frameWidth;
+    int frameHeight;
+    size_t frameBytes;
+    unsigned char *frames;
+    size_t framesCapacity;
+
+    int64_t startNs;
+    int64_t doneNs;
+};
+
+}; // namespace android
+
+#endif
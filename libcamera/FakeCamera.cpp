@@ -0,0 +1,356 @@
+/*
+ *      This program is free software; you can redistribute it and/or modify
+ *      it under the terms of the GNU General Public License as published by
+ *      the Free Software Foundation; either version 2 of the License, or
+ *      (at your option) any later version.
+ *
+ */
+
+#define LOG_TAG "FakeCamera"
+#include "CameraLog.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <linux/videodev2.h>
+
+#include "FakeCamera.h"
+
+namespace android {
+
+static int64_t monotonicNs ()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t) ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+FakeCamera::FakeCamera ()
+    : data(NULL), dataSize(0), width(0), height(0), pixelformat(0),
+      fps(30), jitterUs(0), dropPercent(0), seed(1), state(1),
+      isStreaming(false), nextFrameNs(0), current(0), sequence(0),
+      lastFrame(0), lastSequence(0), timestamp(0)
+{
+}
+
+FakeCamera::~FakeCamera ()
+{
+    Close();
+}
+
+void FakeCamera::SetFrameRate (int rate)
+{
+    fps = rate;
+}
+
+void FakeCamera::SetJitter (int us)
+{
+    jitterUs = us;
+}
+
+void FakeCamera::SetDropRate (int percent)
+{
+    /* at 100 no frame would ever be returned */
+    dropPercent = percent < 0 ? 0 : (percent > 99 ? 99 : percent);
+}
+
+void FakeCamera::SetSeed (unsigned int s)
+{
+    seed = s;
+}
+
+int FakeCamera::Open (const char *device, int w, int h, int format)
+{
+    struct stat st;
+    int fd;
+
+    Close();
+
+    if ((fd = open(device, O_RDONLY)) == -1) {
+        ALOGE("ERROR opening %s: %s", device, strerror(errno));
+        return -1;
+    }
+
+    if (fstat(fd, &st) < 0 || st.st_size == 0) {
+        ALOGE("Open: %s is empty or unreadable", device);
+        close(fd);
+        return -1;
+    }
+
+    /* Private writable mapping so in-place processing never touches the file */
+    dataSize = st.st_size;
+    data = (unsigned char *) mmap(0, dataSize, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) {
+        ALOGE("Open: Unable to map %s (%s)", device, strerror(errno));
+        data = NULL;
+        return -1;
+    }
+
+    width = w;
+    height = h;
+    pixelformat = format;
+
+    if (indexFrames() < 0) {
+        Close();
+        return -1;
+    }
+
+    ALOGI("Open: %s has %zu frames", device, frameOffset.size());
+    return 0;
+}
+
+void FakeCamera::Close ()
+{
+    if (data)
+        munmap(data, dataSize);
+    data = NULL;
+    dataSize = 0;
+    frameOffset.clear();
+    frameSize.clear();
+    isStreaming = false;
+}
+
+unsigned int FakeCamera::GetPixelFormat ()
+{
+    return pixelformat;
+}
+
+/* Split the file into frames: fixed size for raw formats, one entry per
+ * JPEG (SOI..EOI, skipping marker segments so EXIF thumbnails don't end a
+ * frame early) for MJPEG. */
+int FakeCamera::indexFrames ()
+{
+    size_t bytes = 0;
+
+    switch (pixelformat) {
+    case V4L2_PIX_FMT_YUYV:
+    case V4L2_PIX_FMT_UYVY:
+    case V4L2_PIX_FMT_YVYU:
+    case V4L2_PIX_FMT_VYUY:
+        bytes = (size_t) width * height * 2;
+        break;
+    case V4L2_PIX_FMT_NV12:
+    case V4L2_PIX_FMT_NV21:
+        bytes = (size_t) width * height * 3 / 2;
+        break;
+    case V4L2_PIX_FMT_MJPEG:
+    case V4L2_PIX_FMT_JPEG:
+        break;
+    default:
+        /* Bayer, packed or not */
+        bytes = pixelFormatFrameSize(pixelFormatFromFourcc(pixelformat), width, height);
+        if (!bytes) {
+            ALOGE("indexFrames: unsupported pixel format 0x%08x", pixelformat);
+            return -1;
+        }
+        break;
+    }
+
+    if (bytes) {
+        for (size_t off = 0; off + bytes <= dataSize; off += bytes) {
+            frameOffset.push_back(off);
+            frameSize.push_back(bytes);
+        }
+    } else {
+        size_t p = 0;
+        while (p + 4 <= dataSize) {
+            if (data[p] != 0xff || data[p + 1] != 0xd8) {
+                p++;
+                continue;
+            }
+            size_t start = p;
+            size_t q = p + 2;
+            bool done = false;
+            while (!done && q + 2 <= dataSize) {
+                if (data[q] != 0xff) {
+                    q++;
+                    continue;
+                }
+                unsigned char marker = data[q + 1];
+                if (marker == 0xd9) {
+                    q += 2;
+                    done = true;
+                } else if (marker == 0xda) {
+                    /* entropy coded data: stop at the first real EOI */
+                    q += 2;
+                    while (q + 2 <= dataSize &&
+                           !(data[q] == 0xff && data[q + 1] == 0xd9))
+                        q++;
+                } else if (marker == 0xff || marker == 0x00 ||
+                           (marker >= 0xd0 && marker <= 0xd7)) {
+                    q += (marker == 0xff) ? 1 : 2;
+                } else if (q + 4 <= dataSize) {
+                    q += 2 + ((data[q + 2] << 8) | data[q + 3]);
+                } else {
+                    break;
+                }
+            }
+            if (!done)
+                break;
+            frameOffset.push_back(start);
+            frameSize.push_back(q - start);
+            p = q;
+        }
+    }
+
+    if (frameOffset.empty()) {
+        ALOGE("indexFrames: no complete %dx%d frame in file", width, height);
+        return -1;
+    }
+    return 0;
+}
+
+int FakeCamera::Init ()
+{
+    return data ? 0 : -1;
+}
+
+void FakeCamera::Uninit ()
+{
+}
+
+int FakeCamera::StartStreaming ()
+{
+    if (!data)
+        return -1;
+
+    if (!isStreaming) {
+        state = seed;
+        current = 0;
+        sequence = 0;
+        nextFrameNs = monotonicNs();
+        isStreaming = true;
+    }
+    return 0;
+}
+
+int FakeCamera::StopStreaming ()
+{
+    isStreaming = false;
+    return 0;
+}
+
+unsigned int FakeCamera::random ()
+{
+    state = state * 1103515245 + 12345;
+    return (state >> 1) & 0x7fffffff;
+}
+
+void * FakeCamera::GrabPreviewFrame ()
+{
+    if (!isStreaming)
+        return NULL;
+
+    for (;;) {
+        int64_t due = nextFrameNs;
+
+        if (fps > 0) {
+            nextFrameNs += 1000000000LL / fps;
+            if (jitterUs > 0)
+                due += ((int64_t) (random() % (2 * jitterUs + 1)) - jitterUs) * 1000;
+
+            int64_t wait = due - monotonicNs();
+            if (wait > 0) {
+                struct timespec ts;
+                ts.tv_sec = wait / 1000000000LL;
+                ts.tv_nsec = wait % 1000000000LL;
+                while (nanosleep(&ts, &ts) < 0 && errno == EINTR)
+                    ;
+            }
+        } else {
+            due = monotonicNs();
+        }
+
+        size_t index = current;
+        unsigned int seq = sequence;
+        current = (current + 1) % frameOffset.size();
+        sequence++;
+
+        if (dropPercent > 0 && (int) (random() % 100) < dropPercent)
+            continue;
+
+        timestamp = due;
+        lastFrame = index;
+        lastSequence = seq;
+        return data + frameOffset[index];
+    }
+}
+
+void FakeCamera::ReleasePreviewFrame ()
+{
+}
+
+int FakeCamera::HoldFrame ()
+{
+    /* frames stay mapped until Close */
+    return lastFrame;
+}
+
+void FakeCamera::ReleaseHeldFrame (int id)
+{
+}
+
+int64_t FakeCamera::GetFrameTimestamp ()
+{
+    return timestamp;
+}
+
+unsigned int FakeCamera::GetFrameSequence ()
+{
+    return lastSequence;
+}
+
+size_t FakeCamera::GetFrameSize ()
+{
+    return frameSize[lastFrame];
+}
+
+int FakeCamera::GetFrameFd ()
+{
+    /* frames are slices of one mapping */
+    return -1;
+}
+
+int FakeCamera::GrabJpegFrame (void *jpeg, size_t size)
+{
+    unsigned char *frame = (unsigned char *) GrabPreviewFrame();
+
+    if (!frame)
+        return -1;
+
+    switch (pixelformat) {
+    case V4L2_PIX_FMT_MJPEG:
+    case V4L2_PIX_FMT_JPEG:
+        if (GetFrameSize() > size)
+            return -1;
+        memcpy(jpeg, frame, GetFrameSize());
+        return GetFrameSize();
+    default:
+        /* the encoder rejects what it cannot convert */
+        return jpegEncoder.encode(frame, pixelFormatFromFourcc(pixelformat), width, height,
+                                  100, (unsigned char *) jpeg, size);
+    }
+}
+
+/* a recording has no controls */
+int FakeCamera::GetControl (unsigned int id, int *value)
+{
+    return -1;
+}
+
+int FakeCamera::SetControl (unsigned int id, int value)
+{
+    return -1;
+}
+
+int FakeCamera::QueryControl (unsigned int id, int *minimum, int *maximum)
+{
+    return -1;
+}
+
+}; // namespace android
@@ -0,0 +1,98 @@
+/*
+ *      This program is free software; you can redistribute it and/or modify
+ *      it under the terms of the GNU General Public License as published by
+ *      the Free Software Foundation; either version 2 of the License, or
+ *      (at your option) any later version.
+ *
+ * File-backed capture backend. Replays raw YUYV, NV12 or Bayer frames, or a
+ * concatenated MJPEG stream, from a memory-mapped file at a fixed rate with
+ * optional jitter and dropped frames. Pacing and drops come from a seeded
+ * generator so runs are reproducible.
+ */
+
+#ifndef _FAKECAMERA_H
+#define _FAKECAMERA_H
+
+#include <vector>
+
+#include "CaptureDevice.h"
+#include "JpegEncoder.h"
+
+namespace android {
+
+class FakeCamera : public CaptureDevice {
+
+public:
+    FakeCamera();
+    ~FakeCamera();
+
+    /* Playback settings, applied at the next StartStreaming */
+    void SetFrameRate (int fps);
+    void SetJitter (int jitterUs);
+    void SetDropRate (int percent);     /* 0..99 */
+    void SetSeed (unsigned int seed);
+
+    /* device is the path of the file to replay */
+    int Open (const char *device, int width, int height, int pixelformat);
+    void Close ();
+    unsigned int GetPixelFormat ();
+
+    int Init ();
+    void Uninit ();
+
+    int StartStreaming ();
+    int StopStreaming ();
+
+    void * GrabPreviewFrame ();
+    void ReleasePreviewFrame ();
+    int HoldFrame ();
+    void ReleaseHeldFrame (int id);
+
+    int64_t GetFrameTimestamp ();
+    unsigned int GetFrameSequence ();
+    /* varies for MJPEG */
+    size_t GetFrameSize ();
+    int GetFrameFd ();
+    int GrabJpegFrame (void *jpeg, size_t size);
+
+    int GetControl (unsigned int id, int *value);
+    int SetControl (unsigned int id, int value);
+    int QueryControl (unsigned int id, int *minimum, int *maximum);
+
+private:
+    unsigned int random ();
+    int indexFrames ();
+
+    unsigned char *data;
+    size_t dataSize;
+
+    int width;
+    int height;
+    int pixelformat;
+
+    /* offset and size of every frame in the file */
+    std::vector<size_t> frameOffset;
+    std::vector<size_t> frameSize;
+
+    int fps;
+    int jitterUs;
+    int dropPercent;
+    unsigned int seed;
+    unsigned int state;
+
+    bool isStreaming;
+    int64_t nextFrameNs;
+    size_t current;
+    unsigned int sequence;
+
+    /* last dequeued frame */
+    size_t lastFrame;
+    unsigned int lastSequence;
+    int64_t timestamp;
+
+    JpegEncoder jpegEncoder;
+};
+
+}; // namespace android
+
+#endif
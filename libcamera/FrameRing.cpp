@@ -0,0 +1,101 @@
+/*
+ *      This program is free software; you can redistribute it and/or modify
+ *      it under the terms of the GNU General Public License as published by
+ *      the Free Software Foundation; either version 2 of the License, or
+ *      (at your option) any later version.
+ *
+ */
+
+#define LOG_TAG "FrameRing"
+#include "CameraLog.h"
+
+#include "FrameRing.h"
+
+namespace android {
+
+FrameRing::FrameRing ()
+    : device(NULL),
+      head(0),
+      used(0),
+      maxCount(0)
+{
+}
+
+FrameRing::~FrameRing ()
+{
+    flush();
+}
+
+void FrameRing::reset (CaptureDevice *dev, int depth)
+{
+    flush();
+    device = dev;
+    if (depth < 0)
+        depth = 0;
+    maxCount = depth < MAX_DEPTH ? depth : MAX_DEPTH;
+}
+
+void FrameRing::push (int id, const void *frame, int64_t timestamp, unsigned int sequence)
+{
+    if (maxCount == 0) {
+        device->ReleaseHeldFrame(id);
+        return;
+    }
+
+    if (used == maxCount) {
+        device->ReleaseHeldFrame(entries[head].id);
+        head = (head + 1) % maxCount;
+        used--;
+    }
+
+    Entry &e = entries[(head + used) % maxCount];
+    e.id = id;
+    e.frame = frame;
+    /* still the last dequeued frame */
+    e.fd = device->GetFrameFd();
+    e.timestamp = timestamp;
+    e.sequence = sequence;
+    used++;
+}
+
+bool FrameRing::take (int64_t timestamp, Entry *entry)
+{
+    if (used == 0)
+        return false;
+
+    int best = 0;
+    int64_t bestDelta = -1;
+    for (int i = 0; i < used; i++) {
+        int64_t delta = entries[(head + i) % maxCount].timestamp - timestamp;
+
+        if (delta < 0)
+            delta = -delta;
+
+        /* on a tie the newer frame wins */
+        if (bestDelta < 0 || delta <= bestDelta) {
+            best = i;
+            bestDelta = delta;
+        }
+    }
+
+    *entry = entries[(head + best) % maxCount];
+
+    /* close the gap, keeping capture order */
+    for (int i = best; i < used - 1; i++)
+        entries[(head + i) % maxCount] = entries[(head + i + 1) % maxCount];
+    used--;
+
+    ALOGI("take: frame %u, %lld us from the request", entry->sequence,
+          (long long) ((entry->timestamp - timestamp) / 1000));
+    return true;
+}
+
+void FrameRing::flush ()
+{
+    for (int i = 0; i < used; i++)
+        device->ReleaseHeldFrame(entries[(head + i) % maxCount].id);
+    head = 0;
+    used = 0;
+}
+
+}; // namespace android
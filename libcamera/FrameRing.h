@@ -0,0 +1,68 @@
+/*
+ *      This program is free software; you can redistribute it and/or modify
+ *      it under the terms of the GNU General Public License as published by
+ *      the Free Software Foundation; either version 2 of the License, or
+ *      (at your option) any later version.
+ *
+ * Zero shutter lag history: the last few captured frames, kept by
+ * reference while the device holds their buffers (CaptureDevice::HoldFrame).
+ * Not thread safe; the owner serializes access.
+ */
+
+#ifndef _FRAMERING_H
+#define _FRAMERING_H
+
+#include <stdint.h>
+
+#include "CaptureDevice.h"
+
+namespace android {
+
+class FrameRing {
+
+public:
+    enum { MAX_DEPTH = 8 };
+
+    struct Entry {
+        int id;                 /* from CaptureDevice::HoldFrame */
+        const void *frame;
+        int fd;                 /* dma-buf of frame, -1 if none */
+        int64_t timestamp;      /* CLOCK_MONOTONIC ns */
+        unsigned int sequence;
+    };
+
+    FrameRing ();
+    ~FrameRing ();
+
+    /* Release what is held and keep up to depth frames of device from now
+     * on; 0 disables the ring */
+    void reset (CaptureDevice *device, int depth);
+
+    int depth () const { return maxCount; }
+    int count () const { return used; }
+
+    /* Take over a held frame; when full the oldest goes back to the device */
+    void push (int id, const void *frame, int64_t timestamp, unsigned int sequence);
+
+    /* Remove the frame captured closest to timestamp, which the caller now
+     * releases. False if the ring is empty. */
+    bool take (int64_t timestamp, Entry *entry);
+
+    /* Give every frame back to the device */
+    void flush ();
+
+private:
+    /* Not copyable: the held frames belong to one owner */
+    FrameRing (const FrameRing &);
+    FrameRing &operator= (const FrameRing &);
+
+    CaptureDevice *device;
+    Entry entries[MAX_DEPTH];
+    int head;                   /* oldest entry */
+    int used;
+    int maxCount;
+};
+
+}; // namespace android
+
+#endif
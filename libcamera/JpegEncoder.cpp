@@ -0,0 +1,270 @@
+/*
+ *      This program is free software; you can redistribute it and/or modify
+ *      it under the terms of the GNU General Public License as published by
+ *      the Free Software Foundation; either version 2 of the License, or
+ *      (at your option) any later version.
+ *
+ *      Author: Niels Keeman <nielskeeman@gmail.com>
+ *
+ */
+
+#define LOG_TAG "JpegEncoder"
+#include "CameraLog.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <linux/videodev2.h>
+
+#include "JpegEncoder.h"
+#include "ConvertKernels.h"
+#include "M2MDevice.h"
+#include "convert.h"
+
+extern "C" { /* Android jpeglib.h missed extern "C" */
+#include <jpeglib.h>
+}
+
+namespace android {
+
+/* libjpeg destination writing straight into a caller supplied buffer.
+ * Output past the end is discarded into a scratch area and flagged. */
+struct MemoryDestination {
+    struct jpeg_destination_mgr pub;
+    unsigned char *buffer;
+    size_t size;
+    bool overflow;
+    JOCTET scratch[4096];
+
+    static void initDestination(j_compress_ptr cinfo);
+    static boolean emptyOutputBuffer(j_compress_ptr cinfo);
+    static void termDestination(j_compress_ptr cinfo);
+};
+
+void MemoryDestination::initDestination(j_compress_ptr cinfo)
+{
+    MemoryDestination *dest = (MemoryDestination *) cinfo->dest;
+
+    dest->pub.next_output_byte = dest->buffer;
+    dest->pub.free_in_buffer = dest->size;
+    dest->overflow = false;
+}
+
+boolean MemoryDestination::emptyOutputBuffer(j_compress_ptr cinfo)
+{
+    MemoryDestination *dest = (MemoryDestination *) cinfo->dest;
+
+    dest->overflow = true;
+    dest->pub.next_output_byte = dest->scratch;
+    dest->pub.free_in_buffer = sizeof(dest->scratch);
+    return TRUE;
+}
+
+void MemoryDestination::termDestination(j_compress_ptr cinfo)
+{
+}
+
+JpegEncoder::JpegEncoder ()
+    : lineBuffer(NULL), lineBufferWidth(0),
+      frameBuffer(NULL), frameBufferSize(0),
+      hardwareState(HW_OFF), hardware(NULL),
+      hardwareQuality(-1), hardwareUsed(false)
+{
+    hardwareNode[0] = '\0';
+}
+
+JpegEncoder::~JpegEncoder ()
+{
+    delete hardware;
+    free(lineBuffer);
+    free(frameBuffer);
+}
+
+void JpegEncoder::useHardware (const char *node)
+{
+    delete hardware;
+    hardware = NULL;
+    snprintf(hardwareNode, sizeof(hardwareNode), "%s", node ? node : "");
+    hardwareState = HW_PROBE;
+}
+
+int JpegEncoder::encodeHardware (const unsigned char *frame, int frameFd, PixelFormat format,
+                                 int width, int height, int quality,
+                                 unsigned char *dst, size_t size)
+{
+    unsigned int fourcc = pixelFormatToFourcc(format);
+
+    if (hardwareState == HW_PROBE) {
+        /* the search only asks for the JPEG side: the input formats an
+         * encoder takes vary, and are checked per frame below */
+        hardware = new M2MDevice();
+        if ((hardwareNode[0] || M2MDevice::find(V4L2_PIX_FMT_YUYV, V4L2_PIX_FMT_JPEG,
+                                                hardwareNode, sizeof(hardwareNode))) &&
+            hardware->open(hardwareNode) == 0) {
+            hardwareState = HW_READY;
+        } else {
+            ALOGI("encodeHardware: no V4L2 JPEG encoder, using libjpeg");
+            hardwareState = HW_FAILED;
+        }
+    }
+    if (hardwareState != HW_READY || !fourcc || !hardware->supports(fourcc, V4L2_PIX_FMT_JPEG))
+        return -1;
+
+    if (hardware->configure(fourcc, width, height, V4L2_PIX_FMT_JPEG, width, height,
+                            frameFd >= 0) < 0)
+        return -1;
+#ifdef V4L2_CID_JPEG_COMPRESSION_QUALITY
+    if (quality != hardwareQuality) {
+        hardware->setControl(V4L2_CID_JPEG_COMPRESSION_QUALITY, quality);
+        hardwareQuality = quality;
+    }
+#endif
+
+    int jpegSize = hardware->process(frame, pixelFormatFrameSize(format, width, height),
+                                     frameFd, dst, size);
+    if (jpegSize < 0) {
+        /* a device that failed once is not worth a timeout per picture */
+        ALOGW("encodeHardware: %s failed, using libjpeg from now on", hardwareNode);
+        hardwareState = HW_FAILED;
+    }
+    return jpegSize;
+}
+
+static void yuyvToRGB888 (const unsigned char *src, unsigned char *dst, int width, int height)
+{
+    convertYUYVtoRGB888((unsigned char *) src, dst, width, height);
+}
+
+static bool isPacked422 (PixelFormat format)
+{
+    return format == PIX_FMT_YUYV || format == PIX_FMT_UYVY ||
+           format == PIX_FMT_YVYU || format == PIX_FMT_VYUY;
+}
+
+int JpegEncoder::encodeYUYV (const unsigned char *yuyv, int width, int height, int quality,
+                             unsigned char *dst, size_t size)
+{
+    return encodePacked422(yuyv, PIX_FMT_YUYV, width, height, quality, dst, size);
+}
+
+int JpegEncoder::encode (const unsigned char *frame, PixelFormat format, int width, int height,
+                         int quality, unsigned char *dst, size_t size)
+{
+    return encode(frame, -1, format, width, height, quality, dst, size);
+}
+
+int JpegEncoder::encode (const unsigned char *frame, int frameFd, PixelFormat format,
+                         int width, int height, int quality, unsigned char *dst, size_t size)
+{
+    ConvertKernel toYUYV;
+    int needed = width * height * 2;
+
+    hardwareUsed = false;
+    if (hardwareState != HW_OFF && hardwareState != HW_FAILED) {
+        int jpegSize = encodeHardware(frame, frameFd, format, width, height, quality, dst, size);
+        if (jpegSize > 0) {
+            hardwareUsed = true;
+            return jpegSize;
+        }
+    }
+
+    if (isPacked422(format))
+        return encodePacked422(frame, format, width, height, quality, dst, size);
+
+    toYUYV = findConvertKernel(format, PIX_FMT_YUYV, COLOR_BT601, RANGE_LIMITED);
+    if (!toYUYV) {
+        ALOGE("encode: cannot encode %s", pixelFormatName(format));
+        return -1;
+    }
+    if (needed > frameBufferSize) {
+        free(frameBuffer);
+        frameBuffer = (unsigned char *) malloc(needed);
+        if (!frameBuffer) {
+            frameBufferSize = 0;
+            return -1;
+        }
+        frameBufferSize = needed;
+    }
+    toYUYV(frame, frameBuffer, width, height);
+
+    return encodePacked422(frameBuffer, PIX_FMT_YUYV, width, height, quality, dst, size);
+}
+
+int JpegEncoder::encodePacked422 (const unsigned char *inputBuffer, PixelFormat format,
+                                  int width, int height, int quality,
+                                  unsigned char *dst, size_t size)
+{
+    struct jpeg_compress_struct cinfo;
+    struct jpeg_error_mgr jerr;
+    MemoryDestination dest;
+    JSAMPROW row_pointer[1];
+    const unsigned char *row;
+    ConvertKernel toRGB;
+    int fileSize;
+
+    /* JFIF is full range BT.601 */
+    if (format == PIX_FMT_YUYV)
+        toRGB = yuyvToRGB888;
+    else if (isPacked422(format))
+        toRGB = findConvertKernel(format, PIX_FMT_RGB888, COLOR_BT601, RANGE_FULL);
+    else
+        toRGB = NULL;
+    if (!toRGB) {
+        ALOGE("encodePacked422: cannot encode %s", pixelFormatName(format));
+        return -1;
+    }
+
+    if (width > lineBufferWidth) {
+        free(lineBuffer);
+        lineBuffer = (unsigned char *) calloc (width * 3, 1);
+        if (!lineBuffer) {
+            lineBufferWidth = 0;
+            return -1;
+        }
+        lineBufferWidth = width;
+    }
+    row = inputBuffer;
+
+    cinfo.err = jpeg_std_error (&jerr);
+    jpeg_create_compress (&cinfo);
+
+    dest.pub.init_destination = MemoryDestination::initDestination;
+    dest.pub.empty_output_buffer = MemoryDestination::emptyOutputBuffer;
+    dest.pub.term_destination = MemoryDestination::termDestination;
+    dest.buffer = dst;
+    dest.size = size;
+    dest.overflow = false;
+    cinfo.dest = &dest.pub;
+
+    ALOGI("JPEG PICTURE WIDTH AND HEIGHT: %dx%d", width, height);
+
+    cinfo.image_width = width;
+    cinfo.image_height = height;
+    cinfo.input_components = 3;
+    cinfo.in_color_space = JCS_RGB;
+
+    jpeg_set_defaults (&cinfo);
+    jpeg_set_quality (&cinfo, quality, TRUE);
+
+    jpeg_start_compress (&cinfo, TRUE);
+
+    while (cinfo.next_scanline < cinfo.image_height) {
+        toRGB(row, lineBuffer, width, 1);
+        row += width * 2;
+
+        row_pointer[0] = lineBuffer;
+        jpeg_write_scanlines (&cinfo, row_pointer, 1);
+    }
+
+    jpeg_finish_compress (&cinfo);
+    fileSize = size - dest.pub.free_in_buffer;
+    jpeg_destroy_compress (&cinfo);
+
+    if (dest.overflow) {
+        ALOGE("encodePacked422: JPEG does not fit into %zu bytes", size);
+        return -1;
+    }
+
+    return fileSize;
+}
+
+}; // namespace android
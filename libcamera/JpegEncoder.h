@@ -0,0 +1,73 @@
+/*
+ *      This program is free software; you can redistribute it and/or modify
+ *      it under the terms of the GNU General Public License as published by
+ *      the Free Software Foundation; either version 2 of the License, or
+ *      (at your option) any later version.
+ *
+ *      Author: Niels Keeman <nielskeeman@gmail.com>
+ *
+ */
+
+#ifndef _JPEGENCODER_H
+#define _JPEGENCODER_H
+
+#include <stddef.h>
+
+#include "ConvertKernels.h"
+
+namespace android {
+
+class M2MDevice;
+
+class JpegEncoder {
+
+public:
+    JpegEncoder();
+    ~JpegEncoder();
+
+    /* Compress a YUYV frame into dst. Returns the JPEG size in bytes, or -1
+     * if the result did not fit into size bytes. */
+    int encodeYUYV (const unsigned char *yuyv, int width, int height, int quality,
+                    unsigned char *dst, size_t size);
+    /* Same for any packed 4:2:2 byte order */
+    int encodePacked422 (const unsigned char *frame, PixelFormat format, int width, int height,
+                         int quality, unsigned char *dst, size_t size);
+    /* Any capture format: others (Bayer) are converted to YUYV first */
+    int encode (const unsigned char *frame, PixelFormat format, int width, int height,
+                int quality, unsigned char *dst, size_t size);
+    /* Same, with the frame also given as a dma-buf fd (-1 if none) that a
+     * hardware encoder can import instead of copying the frame */
+    int encode (const unsigned char *frame, int frameFd, PixelFormat format, int width,
+                int height, int quality, unsigned char *dst, size_t size);
+
+    /* Offload to a V4L2 mem2mem JPEG encoder: node, or NULL to look for
+     * one at the first encode. Formats it does not take, or any failure,
+     * fall back to libjpeg. */
+    void useHardware (const char *node);
+    /* The last encode ran on the hardware encoder */
+    bool lastWasHardware () const { return hardwareUsed; }
+
+private:
+    int encodeHardware (const unsigned char *frame, int frameFd, PixelFormat format,
+                        int width, int height, int quality, unsigned char *dst, size_t size);
+
+    /* Not copyable: owns the hardware encoder */
+    JpegEncoder (const JpegEncoder &);
+    JpegEncoder &operator= (const JpegEncoder &);
+
+    unsigned char *lineBuffer;
+    int lineBufferWidth;
+    unsigned char *frameBuffer;
+    int frameBufferSize;
+
+    enum HardwareState { HW_OFF, HW_PROBE, HW_READY, HW_FAILED };
+    HardwareState hardwareState;
+    char hardwareNode[32];
+    M2MDevice *hardware;
+    int hardwareQuality;
+    bool hardwareUsed;
+};
+
+}; // namespace android
+
+#endif
@@ -0,0 +1,91 @@
+/*
+ *      This program is free software; you can redistribute it and/or modify
+ *      it under the terms of the GNU General Public License as published by
+ *      the Free Software Foundation; either version 2 of the License, or
+ *      (at your option) any later version.
+ *
+ */
+
+#define LOG_TAG "M2MConverter"
+#include "CameraLog.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#include "CameraStats.h"
+#include "M2MConverter.h"
+
+namespace android {
+
+M2MConverter::M2MConverter ()
+    : state(STATE_OFF),
+      missing(false),
+      convertUs(0)
+{
+    devNode[0] = '\0';
+}
+
+void M2MConverter::enable (const char *node)
+{
+    if (node && strcmp(node, devNode)) {
+        snprintf(devNode, sizeof(devNode), "%s", node);
+        device.close();
+        missing = false;
+    }
+    /* a device that failed gets another chance every session */
+    state = device.isOpen() ? STATE_READY : STATE_PROBE;
+}
+
+void M2MConverter::disable ()
+{
+    /* the device stays open for the next session */
+    state = STATE_OFF;
+}
+
+bool M2MConverter::convert (const unsigned char *src, int srcFd, PixelFormat in,
+                            int inWidth, int inHeight, unsigned char *dst, size_t capacity,
+                            PixelFormat out, int outWidth, int outHeight)
+{
+    unsigned int inFourcc = pixelFormatToFourcc(in);
+    unsigned int outFourcc = pixelFormatToFourcc(out);
+    int64_t t0 = cameraNowNs();
+
+    if (!enabled())
+        return false;
+
+    if (state == STATE_PROBE) {
+        /* the search runs once; nodes do not come and go */
+        if (!devNode[0] && !missing && inFourcc && outFourcc &&
+            !M2MDevice::find(inFourcc, outFourcc, devNode, sizeof(devNode)))
+            missing = true;
+        if (!devNode[0] || device.open(devNode) < 0) {
+            ALOGI("convert: no V4L2 converter for %s -> %s, converting in software",
+                  pixelFormatName(in), pixelFormatName(out));
+            state = STATE_FAILED;
+            return false;
+        }
+        state = STATE_READY;
+    }
+
+    /* the setup only changes between sessions; one the device refuses,
+     * or a device that fails, is not worth a try per frame */
+    if (!inFourcc || !outFourcc ||
+        device.configure(inFourcc, inWidth, inHeight, outFourcc, outWidth, outHeight,
+                         srcFd >= 0) < 0) {
+        ALOGI("convert: %s cannot do %s %dx%d -> %s %dx%d, converting in software", devNode,
+              pixelFormatName(in), inWidth, inHeight, pixelFormatName(out), outWidth, outHeight);
+        state = STATE_FAILED;
+        return false;
+    }
+    int size = device.process(src, pixelFormatFrameSize(in, inWidth, inHeight), srcFd,
+                              dst, capacity);
+    if (size < 0) {
+        ALOGW("convert: %s failed, converting in software", devNode);
+        state = STATE_FAILED;
+        return false;
+    }
+    convertUs = (cameraNowNs() - t0) / 1000;
+    return true;
+}
+
+}; // namespace android
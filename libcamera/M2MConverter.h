@@ -0,0 +1,63 @@
+/*
+ *      This program is free software; you can redistribute it and/or modify
+ *      it under the terms of the GNU General Public License as published by
+ *      the Free Software Foundation; either version 2 of the License, or
+ *      (at your option) any later version.
+ *
+ * Scaling and colour conversion on a V4L2 mem2mem scaler/CSC block, for
+ * one stream (display or callbacks): the device is set up for that
+ * stream's formats and size and left that way. convert() reports whether
+ * the frame was done; when it was not (no device, a format or size the
+ * device does not take, a failure) the caller converts in software.
+ */
+
+#ifndef _M2MCONVERTER_H
+#define _M2MCONVERTER_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "ConvertKernels.h"
+#include "M2MDevice.h"
+
+namespace android {
+
+class M2MConverter {
+
+public:
+    M2MConverter ();
+
+    /* Offload from now on, e.g. for a new session: on node, or NULL to
+     * look for one at the next frame. Off by default. */
+    void enable (const char *node);
+    void disable ();
+    bool enabled () const { return state != STATE_OFF && state != STATE_FAILED; }
+
+    /* src (srcFd its dma-buf, -1 if none) as in, inWidth x inHeight, into
+     * dst as out, outWidth x outHeight, with capacity bytes. False if
+     * the frame was not converted. */
+    bool convert (const unsigned char *src, int srcFd, PixelFormat in, int inWidth, int inHeight,
+                  unsigned char *dst, size_t capacity, PixelFormat out, int outWidth, int outHeight);
+
+    /* Node in use, "" if none */
+    const char *node () const { return devNode; }
+    /* Duration of the last converted frame in us */
+    int64_t lastUs () const { return convertUs; }
+
+private:
+    /* Not copyable: owns the device */
+    M2MConverter (const M2MConverter &);
+    M2MConverter &operator= (const M2MConverter &);
+
+    enum State { STATE_OFF, STATE_PROBE, STATE_READY, STATE_FAILED };
+
+    State state;
+    char devNode[32];
+    bool missing;               /* the search found nothing */
+    M2MDevice device;
+    int64_t convertUs;
+};
+
+}; // namespace android
+
+#endif
@@ -0,0 +1,415 @@
+/*
+ *      This program is free software; you can redistribute it and/or modify
+ *      it under the terms of the GNU General Public License as published by
+ *      the Free Software Foundation; either version 2 of the License, or
+ *      (at your option) any later version.
+ *
+ */
+
+#define LOG_TAG "M2MDevice"
+#include "CameraLog.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <linux/videodev2.h>
+
+#include "M2MDevice.h"
+
+namespace android {
+
+/* a frame that takes longer than this means the device is stuck */
+static const int kTimeoutMs = 1000;
+
+M2MDevice::M2MDevice ()
+    : fd(-1),
+      mplane(false),
+      outputType(V4L2_BUF_TYPE_VIDEO_OUTPUT),
+      captureType(V4L2_BUF_TYPE_VIDEO_CAPTURE),
+      inFormat(0),
+      inWidth(0),
+      inHeight(0),
+      outFormat(0),
+      outWidth(0),
+      outHeight(0),
+      wantDmabuf(false),
+      configured(false),
+      inputDmabuf(false),
+      inputMem(NULL),
+      inputLength(0),
+      resultMem(NULL),
+      resultLength(0),
+      streaming(false)
+{
+}
+
+M2MDevice::~M2MDevice ()
+{
+    close();
+}
+
+bool M2MDevice::find (unsigned int input, unsigned int output, char *node, size_t size)
+{
+    for (int i = 0; i < 64; i++) {
+        char path[32];
+        M2MDevice device;
+
+        snprintf(path, sizeof(path), "/dev/video%d", i);
+        if (access(path, R_OK | W_OK) < 0)
+            continue;
+        if (device.open(path) < 0)
+            continue;
+        if (device.supports(input, output)) {
+            snprintf(node, size, "%s", path);
+            return true;
+        }
+    }
+    return false;
+}
+
+int M2MDevice::open (const char *node)
+{
+    struct v4l2_capability cap;
+
+    close();
+    fd = ::open(node, O_RDWR | O_NONBLOCK | O_CLOEXEC);
+    if (fd < 0)
+        return -1;
+
+    memset(&cap, 0, sizeof(cap));
+    if (ioctl(fd, VIDIOC_QUERYCAP, &cap) < 0) {
+        close();
+        return -1;
+    }
+
+    __u32 caps = (cap.capabilities & V4L2_CAP_DEVICE_CAPS) ? cap.device_caps : cap.capabilities;
+    if (caps & V4L2_CAP_VIDEO_M2M_MPLANE) {
+        mplane = true;
+        outputType = V4L2_BUF_TYPE_VIDEO_OUTPUT_MPLANE;
+        captureType = V4L2_BUF_TYPE_VIDEO_CAPTURE_MPLANE;
+    } else if (caps & V4L2_CAP_VIDEO_M2M) {
+        mplane = false;
+        outputType = V4L2_BUF_TYPE_VIDEO_OUTPUT;
+        captureType = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    } else {
+        close();
+        return -1;
+    }
+
+    ALOGI("open: %s (%s)%s", node, (const char *) cap.driver, mplane ? ", multi-planar" : "");
+    return 0;
+}
+
+void M2MDevice::close ()
+{
+    if (fd < 0)
+        return;
+    release();
+    ::close(fd);
+    fd = -1;
+}
+
+static bool hasFormat (int fd, unsigned int type, unsigned int fourcc)
+{
+    struct v4l2_fmtdesc desc;
+
+    for (unsigned int i = 0; ; i++) {
+        memset(&desc, 0, sizeof(desc));
+        desc.index = i;
+        desc.type = type;
+        if (ioctl(fd, VIDIOC_ENUM_FMT, &desc) < 0)
+            return false;
+        if (desc.pixelformat == fourcc)
+            return true;
+    }
+}
+
+bool M2MDevice::supports (unsigned int input, unsigned int output)
+{
+    return fd >= 0 && hasFormat(fd, outputType, input) && hasFormat(fd, captureType, output);
+}
+
+/* S_FMT on one queue; the driver's sizeimage goes into sizeimage */
+static int setFormat (int fd, bool mplane, unsigned int type, unsigned int fourcc,
+                      int width, int height, size_t *sizeimage)
+{
+    struct v4l2_format fmt;
+
+    memset(&fmt, 0, sizeof(fmt));
+    fmt.type = type;
+    if (mplane) {
+        fmt.fmt.pix_mp.width = width;
+        fmt.fmt.pix_mp.height = height;
+        fmt.fmt.pix_mp.pixelformat = fourcc;
+        fmt.fmt.pix_mp.field = V4L2_FIELD_NONE;
+        fmt.fmt.pix_mp.num_planes = 1;
+    } else {
+        fmt.fmt.pix.width = width;
+        fmt.fmt.pix.height = height;
+        fmt.fmt.pix.pixelformat = fourcc;
+        fmt.fmt.pix.field = V4L2_FIELD_NONE;
+    }
+    if (ioctl(fd, VIDIOC_S_FMT, &fmt) < 0) {
+        ALOGW("setFormat: %.4s %dx%d: %s", (const char *) &fourcc, width, height, strerror(errno));
+        return -1;
+    }
+
+    /* a scaler or encoder that cannot do the exact size is no use */
+    int w = mplane ? fmt.fmt.pix_mp.width : fmt.fmt.pix.width;
+    int h = mplane ? fmt.fmt.pix_mp.height : fmt.fmt.pix.height;
+    unsigned int got = mplane ? fmt.fmt.pix_mp.pixelformat : fmt.fmt.pix.pixelformat;
+    if (w != width || h != height || got != fourcc) {
+        ALOGW("setFormat: asked for %.4s %dx%d, got %.4s %dx%d", (const char *) &fourcc,
+              width, height, (const char *) &got, w, h);
+        return -1;
+    }
+    *sizeimage = mplane ? fmt.fmt.pix_mp.plane_fmt[0].sizeimage : fmt.fmt.pix.sizeimage;
+    return 0;
+}
+
+int M2MDevice::requestBuffers (unsigned int type, unsigned int memory, int count)
+{
+    struct v4l2_requestbuffers rb;
+
+    memset(&rb, 0, sizeof(rb));
+    rb.type = type;
+    rb.memory = memory;
+    rb.count = count;
+    if (ioctl(fd, VIDIOC_REQBUFS, &rb) < 0)
+        return -1;
+    return rb.count;
+}
+
+int M2MDevice::mapBuffer (unsigned int type, void **mem, size_t *length)
+{
+    struct v4l2_buffer buf;
+    struct v4l2_plane plane;
+
+    memset(&buf, 0, sizeof(buf));
+    memset(&plane, 0, sizeof(plane));
+    buf.type = type;
+    buf.memory = V4L2_MEMORY_MMAP;
+    buf.index = 0;
+    if (mplane) {
+        buf.m.planes = &plane;
+        buf.length = 1;
+    }
+    if (ioctl(fd, VIDIOC_QUERYBUF, &buf) < 0) {
+        ALOGE("mapBuffer: VIDIOC_QUERYBUF failed: %s", strerror(errno));
+        return -1;
+    }
+
+    *length = mplane ? plane.length : buf.length;
+    *mem = mmap(0, *length, PROT_READ | PROT_WRITE, MAP_SHARED, fd,
+                mplane ? plane.m.mem_offset : buf.m.offset);
+    if (*mem == MAP_FAILED) {
+        ALOGE("mapBuffer: mmap failed: %s", strerror(errno));
+        *mem = NULL;
+        *length = 0;
+        return -1;
+    }
+    return 0;
+}
+
+void M2MDevice::release ()
+{
+    if (streaming) {
+        enum v4l2_buf_type type = (enum v4l2_buf_type) outputType;
+        ioctl(fd, VIDIOC_STREAMOFF, &type);
+        type = (enum v4l2_buf_type) captureType;
+        ioctl(fd, VIDIOC_STREAMOFF, &type);
+        streaming = false;
+    }
+    if (inputMem)
+        munmap(inputMem, inputLength);
+    if (resultMem)
+        munmap(resultMem, resultLength);
+    inputMem = resultMem = NULL;
+    inputLength = resultLength = 0;
+
+    /* only queues we set up: find() opens capture nodes in use too.
+     * Freeing works whatever memory the buffers were requested with. */
+    if (configured) {
+        requestBuffers(outputType, V4L2_MEMORY_MMAP, 0);
+        requestBuffers(captureType, V4L2_MEMORY_MMAP, 0);
+    }
+    configured = false;
+    inputDmabuf = false;
+}
+
+int M2MDevice::configure (unsigned int input, int iw, int ih,
+                          unsigned int output, int ow, int oh, bool dmabuf)
+{
+    size_t inputSize, resultSize;
+
+    if (fd < 0)
+        return -1;
+    if (configured && input == inFormat && iw == inWidth && ih == inHeight &&
+        output == outFormat && ow == outWidth && oh == outHeight && dmabuf == wantDmabuf)
+        return 0;
+
+    release();
+    inFormat = input;
+    inWidth = iw;
+    inHeight = ih;
+    outFormat = output;
+    outWidth = ow;
+    outHeight = oh;
+    wantDmabuf = dmabuf;
+
+    if (setFormat(fd, mplane, outputType, input, iw, ih, &inputSize) < 0 ||
+        setFormat(fd, mplane, captureType, output, ow, oh, &resultSize) < 0)
+        return -1;
+    configured = true;
+
+    /* one buffer each way: frames are processed one at a time */
+#ifdef V4L2_MEMORY_DMABUF
+    if (dmabuf && requestBuffers(outputType, V4L2_MEMORY_DMABUF, 1) > 0)
+        inputDmabuf = true;
+#endif
+    if (!inputDmabuf) {
+        if (requestBuffers(outputType, V4L2_MEMORY_MMAP, 1) <= 0 ||
+            mapBuffer(outputType, &inputMem, &inputLength) < 0) {
+            ALOGE("configure: no input buffer");
+            release();
+            return -1;
+        }
+    }
+
+    if (requestBuffers(captureType, V4L2_MEMORY_MMAP, 1) <= 0 ||
+        mapBuffer(captureType, &resultMem, &resultLength) < 0) {
+        ALOGE("configure: no result buffer");
+        release();
+        return -1;
+    }
+
+    enum v4l2_buf_type type = (enum v4l2_buf_type) outputType;
+    if (ioctl(fd, VIDIOC_STREAMON, &type) < 0) {
+        ALOGE("configure: VIDIOC_STREAMON failed: %s", strerror(errno));
+        release();
+        return -1;
+    }
+    streaming = true;
+    type = (enum v4l2_buf_type) captureType;
+    if (ioctl(fd, VIDIOC_STREAMON, &type) < 0) {
+        ALOGE("configure: VIDIOC_STREAMON failed: %s", strerror(errno));
+        release();
+        return -1;
+    }
+
+    ALOGI("configure: %.4s %dx%d -> %.4s %dx%d, input %s", (const char *) &input, iw, ih,
+          (const char *) &output, ow, oh, inputDmabuf ? "imported" : "copied");
+    return 0;
+}
+
+int M2MDevice::setControl (unsigned int id, int value)
+{
+    struct v4l2_control ctrl;
+
+    if (fd < 0)
+        return -1;
+    memset(&ctrl, 0, sizeof(ctrl));
+    ctrl.id = id;
+    ctrl.value = value;
+    return ioctl(fd, VIDIOC_S_CTRL, &ctrl);
+}
+
+/* DQBUF on a non-blocking node, waiting up to kTimeoutMs */
+static int dequeue (int fd, struct v4l2_buffer *buf, short events)
+{
+    struct pollfd pfd;
+
+    for (;;) {
+        if (ioctl(fd, VIDIOC_DQBUF, buf) == 0)
+            return 0;
+        if (errno != EAGAIN)
+            return -1;
+
+        pfd.fd = fd;
+        pfd.events = events;
+        pfd.revents = 0;
+        int ret = poll(&pfd, 1, kTimeoutMs);
+        if (ret == 0)
+            errno = ETIMEDOUT;
+        if (ret <= 0 || (pfd.revents & POLLERR))
+            return -1;
+    }
+}
+
+int M2MDevice::process (const void *src, size_t size, int srcFd, void *dst, size_t capacity)
+{
+    struct v4l2_buffer in, out;
+    struct v4l2_plane inPlane, outPlane;
+
+    if (!configured)
+        return -1;
+    if (inputDmabuf ? srcFd < 0 : size > inputLength)
+        return -1;
+
+    memset(&in, 0, sizeof(in));
+    memset(&inPlane, 0, sizeof(inPlane));
+    in.type = outputType;
+    in.index = 0;
+    in.field = V4L2_FIELD_NONE;
+#ifdef V4L2_MEMORY_DMABUF
+    if (inputDmabuf) {
+        in.memory = V4L2_MEMORY_DMABUF;
+        inPlane.m.fd = srcFd;
+        in.m.fd = srcFd;
+        inPlane.length = size;
+        in.length = size;
+    } else
+#endif
+    {
+        in.memory = V4L2_MEMORY_MMAP;
+        memcpy(inputMem, src, size);
+    }
+    if (mplane) {
+        inPlane.bytesused = size;
+        in.m.planes = &inPlane;
+        in.length = 1;
+    } else {
+        in.bytesused = size;
+    }
+
+    memset(&out, 0, sizeof(out));
+    memset(&outPlane, 0, sizeof(outPlane));
+    out.type = captureType;
+    out.memory = V4L2_MEMORY_MMAP;
+    out.index = 0;
+    if (mplane) {
+        out.m.planes = &outPlane;
+        out.length = 1;
+    }
+
+    if (ioctl(fd, VIDIOC_QBUF, &out) < 0 || ioctl(fd, VIDIOC_QBUF, &in) < 0) {
+        ALOGE("process: VIDIOC_QBUF failed: %s", strerror(errno));
+        release();
+        return -1;
+    }
+    if (dequeue(fd, &out, POLLIN) < 0 || dequeue(fd, &in, POLLOUT) < 0) {
+        /* STREAMOFF in release() takes the buffers back */
+        ALOGE("process: VIDIOC_DQBUF failed: %s", strerror(errno));
+        release();
+        return -1;
+    }
+
+    size_t bytes = mplane ? outPlane.bytesused : out.bytesused;
+    if (out.flags & V4L2_BUF_FLAG_ERROR) {
+        ALOGW("process: the device flagged the frame as bad");
+        return -1;
+    }
+    if (bytes > capacity || bytes > resultLength) {
+        ALOGE("process: %zu byte result does not fit into %zu bytes", bytes, capacity);
+        return -1;
+    }
+    memcpy(dst, resultMem, bytes);
+    return bytes;
+}
+
+}; // namespace android
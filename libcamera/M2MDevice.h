@@ -0,0 +1,92 @@
+/*
+ *      This program is free software; you can redistribute it and/or modify
+ *      it under the terms of the GNU General Public License as published by
+ *      the Free Software Foundation; either version 2 of the License, or
+ *      (at your option) any later version.
+ *
+ * V4L2 memory-to-memory device (hardware JPEG encoder, scaler, colour
+ * converter) driven one frame at a time: the frame goes into the OUTPUT
+ * queue, by dma-buf when the caller has one or copied into a mapped
+ * buffer otherwise, and the result is copied out of the CAPTURE queue.
+ * Single and multi-planar drivers (one plane) are both handled. On a
+ * host, vim2m and vicodec provide such nodes.
+ */
+
+#ifndef _M2MDEVICE_H
+#define _M2MDEVICE_H
+
+#include <stddef.h>
+
+namespace android {
+
+class M2MDevice {
+
+public:
+    M2MDevice ();
+    ~M2MDevice ();
+
+    /* First /dev/video* mem2mem node that takes input and produces output
+     * (V4L2 fourccs); its path goes into node. The scan opens every node,
+     * so callers keep the result. */
+    static bool find (unsigned int input, unsigned int output, char *node, size_t size);
+
+    int open (const char *node);
+    void close ();
+    bool isOpen () const { return fd >= 0; }
+
+    /* Both formats are listed by the driver */
+    bool supports (unsigned int input, unsigned int output);
+
+    /* Set up for inWidth x inHeight input frames to outWidth x outHeight
+     * output, importing the input as dma-buf if dmabuf and the driver
+     * allows it. Nothing is reallocated when the setup is unchanged.
+     * Returns -1 if the driver refuses the formats or sizes. */
+    int configure (unsigned int input, int inWidth, int inHeight,
+                   unsigned int output, int outWidth, int outHeight, bool dmabuf);
+
+    /* Input frames are imported rather than copied */
+    bool importsDmabuf () const { return inputDmabuf; }
+
+    /* Control on the device (e.g. V4L2_CID_JPEG_COMPRESSION_QUALITY) */
+    int setControl (unsigned int id, int value);
+
+    /* One frame through the device: the size bytes at src, or the dma-buf
+     * srcFd if imported. The result is copied into dst. Returns its size,
+     * or -1 on failure, a timeout or if it does not fit capacity. */
+    int process (const void *src, size_t size, int srcFd, void *dst, size_t capacity);
+
+private:
+    int requestBuffers (unsigned int type, unsigned int memory, int count);
+    int mapBuffer (unsigned int type, void **mem, size_t *length);
+    void release ();
+
+    /* Not copyable: owns the node and its mappings */
+    M2MDevice (const M2MDevice &);
+    M2MDevice &operator= (const M2MDevice &);
+
+    int fd;
+    bool mplane;
+    unsigned int outputType;    /* the queue frames go into */
+    unsigned int captureType;   /* the queue results come from */
+
+    /* current setup, see configure */
+    unsigned int inFormat;
+    int inWidth;
+    int inHeight;
+    unsigned int outFormat;
+    int outWidth;
+    int outHeight;
+    bool wantDmabuf;
+    bool configured;
+
+    bool inputDmabuf;
+    void *inputMem;
+    size_t inputLength;
+    void *resultMem;
+    size_t resultLength;
+    bool streaming;
+};
+
+}; // namespace android
+
+#endif
@@ -0,0 +1,185 @@
+/*
+ *      This program is free software; you can redistribute it and/or modify
+ *      it under the terms of the GNU General Public License as published by
+ *      the Free Software Foundation; either version 2 of the License, or
+ *      (at your option) any later version.
+ *
+ */
+
+#define LOG_TAG "PreviewWriter"
+#include "CameraLog.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "PreviewWriter.h"
+#include "CameraStats.h"
+#include "convert.h"
+
+namespace android {
+
+PreviewWriter::PreviewWriter ()
+    : scratch(NULL),
+      scratchSize(0),
+      format(PIX_FMT_YUYV)
+{
+    reset();
+}
+
+PreviewWriter::~PreviewWriter ()
+{
+    free(scratch);
+}
+
+void PreviewWriter::reset ()
+{
+    chosen = -1;
+    frames = 0;
+    frameWidth = 0;
+    frameHeight = 0;
+    for (int i = 0; i < MODE_COUNT; i++)
+        best[i] = 0;
+    measured = NULL;
+}
+
+void PreviewWriter::setSourceFormat (PixelFormat fmt)
+{
+    if (fmt != format) {
+        format = fmt;
+        reset();
+    }
+}
+
+void PreviewWriter::buildPlans ()
+{
+    static const PixelFormat outs[] = { PIX_FMT_RGB565, PIX_FMT_NV21 };
+    char steps[128];
+
+    displayPlan.build(format, outs, 1, COLOR_BT601, RANGE_LIMITED, frameWidth, frameHeight);
+    callbackPlan.build(format, outs + 1, 1, COLOR_BT601, RANGE_LIMITED, frameWidth, frameHeight);
+    if (previewPlan.build(format, outs, 2, COLOR_BT601, RANGE_LIMITED, frameWidth, frameHeight)) {
+        previewPlan.describe(steps, sizeof(steps));
+        ALOGI("Preview %dx%d: %s", frameWidth, frameHeight, steps);
+    }
+}
+
+const char *PreviewWriter::modeName (int mode)
+{
+    switch (mode) {
+    case MODE_DIRECT:
+        return "direct";
+    case MODE_STREAM:
+        return "stream";
+    case MODE_BOUNCE:
+        return "bounce";
+    default:
+        return "measuring";
+    }
+}
+
+bool PreviewWriter::allocScratch (int size)
+{
+    void *p;
+
+    if (size <= scratchSize)
+        return true;
+
+    if (posix_memalign(&p, 64, size)) {
+        ALOGE("Unable to allocate %d byte preview scratch buffer", size);
+        return false;
+    }
+    free(scratch);
+    scratch = (unsigned char *) p;
+    scratchSize = size;
+    return true;
+}
+
+void PreviewWriter::choose ()
+{
+    chosen = MODE_DIRECT;
+    for (int i = 1; i < MODE_COUNT; i++)
+        if (best[i] && best[i] < best[chosen])
+            chosen = i;
+
+    ALOGI("Using %s preview writes (direct %lld us, stream %lld us, bounce %lld us)",
+          modeName(chosen), (long long) best[MODE_DIRECT] / 1000,
+          (long long) best[MODE_STREAM] / 1000, (long long) best[MODE_BOUNCE] / 1000);
+}
+
+void PreviewWriter::write (unsigned char *src, unsigned char *rgb565, unsigned char *yuv420sp,
+                           int width, int height)
+{
+    const ConvertPlan &plan = yuv420sp ? previewPlan : displayPlan;
+    unsigned char *dst[2] = { rgb565, yuv420sp };
+    int mode = chosen;
+    int64_t start = 0;
+
+    if (width != frameWidth || height != frameHeight) {
+        reset();
+        frameWidth = width;
+        frameHeight = height;
+        buildPlans();
+    }
+    if (!rgb565) {
+        /* nothing to measure: the write strategy is about the display */
+        if (yuv420sp && callbackPlan.valid())
+            callbackPlan.run(src, dst + 1, 0);
+        return;
+    }
+    if (!plan.valid())
+        return;
+
+    /* Round robin over the modes, keeping the fastest frame of each. The
+     * modes are compared on one plan: when a callback buffer comes or
+     * goes, the plan changes and the measuring starts over. */
+    if (mode < 0) {
+        if (measured != &plan) {
+            frames = 0;
+            for (int i = 0; i < MODE_COUNT; i++)
+                best[i] = 0;
+            measured = &plan;
+        }
+        mode = frames % MODE_COUNT;
+        start = cameraNowNs();
+    }
+
+    bool substituted = false;
+    if (mode == MODE_BOUNCE && !allocScratch(width * height * 2)) {
+        mode = MODE_STREAM;
+        substituted = true;
+    }
+
+    switch (mode) {
+    case MODE_DIRECT:
+        plan.run(src, dst, 0);
+        break;
+    case MODE_STREAM:
+        plan.run(src, dst, CONVERT_DST_UNCACHED);
+        break;
+    case MODE_BOUNCE:
+        dst[0] = scratch;
+        plan.run(src, dst, 0);
+        memcpy(rgb565, scratch, width * height * 2);
+        break;
+    }
+
+    if (chosen < 0) {
+        int64_t elapsed = cameraNowNs() - start;
+
+        /* a bounce frame written as stream is not a sample of either */
+        if (!substituted && (!best[mode] || elapsed < best[mode]))
+            best[mode] = elapsed;
+        if (++frames == kRounds * MODE_COUNT)
+            choose();
+    }
+}
+
+void PreviewWriter::dump (char *buf, size_t size) const
+{
+    snprintf(buf, size, "  preview writes: %s (direct %lld us, stream %lld us, bounce %lld us)\n",
+             modeName(chosen), (long long) best[MODE_DIRECT] / 1000,
+             (long long) best[MODE_STREAM] / 1000, (long long) best[MODE_BOUNCE] / 1000);
+}
+
+}; // namespace android
@@ -0,0 +1,79 @@
+/*
+ *      This program is free software; you can redistribute it and/or modify
+ *      it under the terms of the GNU General Public License as published by
+ *      the Free Software Foundation; either version 2 of the License, or
+ *      (at your option) any later version.
+ *
+ * Writes converted preview frames into gralloc buffers. Buffers locked for
+ * CPU writes may be cached or write-combined depending on the board, and
+ * partial line writes into write-combined memory are very slow, so the
+ * write strategy is measured on the first frames of every preview and the
+ * fastest one is kept.
+ */
+
+#ifndef _PREVIEWWRITER_H
+#define _PREVIEWWRITER_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "ConvertGraph.h"
+
+namespace android {
+
+class PreviewWriter {
+
+public:
+    enum Mode {
+        MODE_DIRECT,    /* convert straight into the buffer */
+        MODE_STREAM,    /* same, whole-line streaming stores */
+        MODE_BOUNCE,    /* convert into cached scratch, then bulk copy */
+        MODE_COUNT
+    };
+
+    PreviewWriter ();
+    ~PreviewWriter ();
+
+    /* Start measuring again, e.g. for a new preview session */
+    void reset ();
+
+    /* Capture format of the frames passed to write(), YUYV by default */
+    void setSourceFormat (PixelFormat format);
+
+    /* Convert a frame into RGB565 (the preview buffer) and optionally
+     * NV21 (yuv420sp, may be NULL), along the cheapest ConvertPlan.
+     * Without rgb565 only the NV21 copy, a cached buffer, is written. */
+    void write (unsigned char *src, unsigned char *rgb565, unsigned char *yuv420sp,
+                int width, int height);
+
+    /* Chosen mode, or -1 while still measuring */
+    int mode () const { return chosen; }
+    static const char *modeName (int mode);
+
+    /* One line for dump() into buf */
+    void dump (char *buf, size_t size) const;
+
+private:
+    enum { kRounds = 4 };
+
+    void choose ();
+    bool allocScratch (int size);
+    void buildPlans ();
+
+    int chosen;
+    int frames;
+    int frameWidth;
+    int frameHeight;
+    int64_t best[MODE_COUNT];   /* fastest frame per mode in ns, 0 if none */
+    const ConvertPlan *measured; /* plan the samples were taken on */
+    unsigned char *scratch;
+    int scratchSize;
+    PixelFormat format;
+    ConvertPlan displayPlan;    /* RGB565 */
+    ConvertPlan previewPlan;    /* RGB565 and NV21 */
+    ConvertPlan callbackPlan;   /* NV21 */
+};
+
+}; // namespace android
+
+#endif
@@ -0,0 +1,126 @@
+/*
+ *      This program is free software; you can redistribute it and/or modify
+ *      it under the terms of the GNU General Public License as published by
+ *      the Free Software Foundation; either version 2 of the License, or
+ *      (at your option) any later version.
+ *
+ */
+
+#define LOG_TAG "SnapshotEncoder"
+#include "CameraLog.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "CameraStats.h"
+#include "SnapshotEncoder.h"
+
+namespace android {
+
+SnapshotEncoder::SnapshotEncoder ()
+    : joinable(false),
+      inFlight(0),
+      device(NULL),
+      holdId(-1),
+      frame(NULL),
+      frameFd(-1),
+      format(PIX_FMT_YUYV),
+      width(0),
+      height(0),
+      quality(90),
+      callback(NULL),
+      user(NULL),
+      jpeg(NULL),
+      jpegCapacity(0),
+      encodeUs(0)
+{
+    encoder.useHardware(NULL);
+}
+
+SnapshotEncoder::~SnapshotEncoder ()
+{
+    wait();
+    free(jpeg);
+}
+
+bool SnapshotEncoder::busy () const
+{
+    return inFlight != 0;
+}
+
+bool SnapshotEncoder::submit (CaptureDevice *dev, int id, const void *src, int srcFd,
+                              PixelFormat fmt, int w, int h, int q, Callback cb, void *u)
+{
+    if (!__sync_bool_compare_and_swap(&inFlight, 0, 1))
+        return false;
+
+    /* the previous worker has finished; reap it */
+    if (joinable) {
+        pthread_join(thread, NULL);
+        joinable = false;
+    }
+
+    /* a 4:2:2 frame at quality 100 stays below its raw size */
+    size_t capacity = (size_t) w * h * 2;
+    if (capacity > jpegCapacity) {
+        free(jpeg);
+        jpeg = (unsigned char *) malloc(capacity);
+        jpegCapacity = jpeg ? capacity : 0;
+    }
+    if (!jpeg) {
+        __sync_lock_release(&inFlight);
+        return false;
+    }
+
+    device = dev;
+    holdId = id;
+    frame = (const unsigned char *) src;
+    frameFd = srcFd;
+    format = fmt;
+    width = w;
+    height = h;
+    quality = q;
+    callback = cb;
+    user = u;
+
+    if (pthread_create(&thread, NULL, threadMain, this) != 0) {
+        ALOGE("submit: unable to start the encoder thread");
+        __sync_lock_release(&inFlight);
+        return false;
+    }
+    joinable = true;
+    return true;
+}
+
+void SnapshotEncoder::wait ()
+{
+    if (joinable) {
+        pthread_join(thread, NULL);
+        joinable = false;
+    }
+}
+
+void *SnapshotEncoder::threadMain (void *arg)
+{
+    ((SnapshotEncoder *) arg)->run();
+    return NULL;
+}
+
+void SnapshotEncoder::run ()
+{
+    int64_t t0 = cameraNowNs();
+    int size = encoder.encode(frame, frameFd, format, width, height, quality, jpeg, jpegCapacity);
+
+    encodeUs = (cameraNowNs() - t0) / 1000;
+
+    /* back to the stream before the client gets to run */
+    device->ReleaseHeldFrame(holdId);
+    ALOGI("run: %dx%d snapshot, %d bytes in %lld us%s", width, height, size,
+          (long long) encodeUs, encoder.lastWasHardware() ? " (hardware)" : "");
+
+    if (callback)
+        callback(user, size > 0 ? jpeg : NULL, size > 0 ? size : -1);
+    __sync_lock_release(&inFlight);
+}
+
+}; // namespace android
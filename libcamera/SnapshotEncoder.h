@@ -0,0 +1,82 @@
+/*
+ *      This program is free software; you can redistribute it and/or modify
+ *      it under the terms of the GNU General Public License as published by
+ *      the Free Software Foundation; either version 2 of the License, or
+ *      (at your option) any later version.
+ *
+ * JPEG stills taken from a running stream (video snapshot). The capture
+ * thread hands over a frame the device holds; it is encoded on a worker
+ * thread and given back to the device when the encoder is done with it,
+ * so the stream keeps running on the remaining buffers meanwhile.
+ */
+
+#ifndef _SNAPSHOTENCODER_H
+#define _SNAPSHOTENCODER_H
+
+#include <pthread.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "CaptureDevice.h"
+#include "JpegEncoder.h"
+
+namespace android {
+
+class SnapshotEncoder {
+
+public:
+    /* Runs on the worker: the JPEG, or NULL and -1 if encoding failed */
+    typedef void (*Callback)(void *user, const unsigned char *jpeg, int size);
+
+    SnapshotEncoder ();
+    ~SnapshotEncoder ();
+
+    /* An encode is in flight */
+    bool busy () const;
+
+    /* Encode frame, held by device as holdId (CaptureDevice::HoldFrame),
+     * and also the dma-buf frameFd (-1 if none) a hardware encoder can
+     * import. Returns false, leaving the frame to the caller, if busy or
+     * the worker cannot start. */
+    bool submit (CaptureDevice *device, int holdId, const void *frame, int frameFd,
+                 PixelFormat format, int width, int height, int quality,
+                 Callback callback, void *user);
+
+    /* Until the last submitted snapshot is delivered */
+    void wait ();
+
+    /* Duration of the last encode in us */
+    int64_t lastEncodeUs () const { return encodeUs; }
+
+private:
+    static void *threadMain (void *arg);
+    void run ();
+
+    /* Not copyable: owns the worker */
+    SnapshotEncoder (const SnapshotEncoder &);
+    SnapshotEncoder &operator= (const SnapshotEncoder &);
+
+    pthread_t thread;
+    bool joinable;
+    volatile int inFlight;
+
+    CaptureDevice *device;
+    int holdId;
+    const unsigned char *frame;
+    int frameFd;                /* dma-buf of frame, -1 if none */
+    PixelFormat format;
+    int width;
+    int height;
+    int quality;
+    Callback callback;
+    void *user;
+
+    JpegEncoder encoder;
+    unsigned char *jpeg;
+    size_t jpegCapacity;
+    int64_t encodeUs;
+};
+
+}; // namespace android
+
+#endif
@@ -0,0 +1,142 @@
+/*
+ *      This program is free software; you can redistribute it and/or modify
+ *      it under the terms of the GNU General Public License as published by
+ *      the Free Software Foundation; either version 2 of the License, or
+ *      (at your option) any later version.
+ *
+ */
+
+#define LOG_TAG "Stabilizer"
+#include "CameraLog.h"
+
+#include <stdlib.h>
+
+#include "Stabilizer.h"
+#include "convert.h"
+
+namespace android {
+
+/* search range in reduced pixels: 32 frame pixels between two frames */
+static const int kSearchRange = 8;
+/* the smoothed path follows the camera by 1/8 of the gap per frame */
+static const int kSmoothShift = 3;
+
+Stabilizer::Stabilizer ()
+    : isEnabled(false),
+      order(PACKED422_YUYV),
+      width(0),
+      height(0),
+      outWidth(0),
+      outHeight(0),
+      marginX(0),
+      marginY(0),
+      smallWidth(0),
+      smallHeight(0),
+      current(0),
+      primed(false),
+      pathX(0),
+      pathY(0),
+      smoothX(0),
+      smoothY(0),
+      offsetX(0),
+      offsetY(0)
+{
+    small[0] = NULL;
+    small[1] = NULL;
+}
+
+Stabilizer::~Stabilizer ()
+{
+    free(small[0]);
+    free(small[1]);
+}
+
+void Stabilizer::cropSize (int w, int h, int margin, int *outW, int *outH)
+{
+    *outW = (w * (100 - 2 * margin) / 100) & ~15;
+    *outH = (h * (100 - 2 * margin) / 100) & ~15;
+    if (*outW < 16 || *outH < 16) {
+        *outW = w;
+        *outH = h;
+    }
+}
+
+bool Stabilizer::configure (PixelFormat format, int w, int h, int margin)
+{
+    isEnabled = false;
+    if (margin <= 0)
+        return true;
+
+    switch (format) {
+    case PIX_FMT_YUYV: order = PACKED422_YUYV; break;
+    case PIX_FMT_UYVY: order = PACKED422_UYVY; break;
+    case PIX_FMT_YVYU: order = PACKED422_YVYU; break;
+    case PIX_FMT_VYUY: order = PACKED422_VYUY; break;
+    default:
+        ALOGW("configure: cannot stabilize %s", pixelFormatName(format));
+        return false;
+    }
+
+    width = w;
+    height = h;
+    cropSize(w, h, margin, &outWidth, &outHeight);
+    marginX = ((w - outWidth) / 2) & ~1;
+    marginY = (h - outHeight) / 2;
+
+    free(small[0]);
+    free(small[1]);
+    smallWidth = w / 4;
+    smallHeight = h / 4;
+    small[0] = (unsigned char *) malloc(smallWidth * smallHeight);
+    small[1] = (unsigned char *) malloc(smallWidth * smallHeight);
+    if (!small[0] || !small[1])
+        return false;
+
+    current = 0;
+    primed = false;
+    pathX = pathY = 0;
+    smoothX = smoothY = 0;
+    offsetX = offsetY = 0;
+    isEnabled = true;
+    ALOGI("configure: %dx%d stabilized to %dx%d", w, h, outWidth, outHeight);
+    return true;
+}
+
+static int clampOffset (int v, int margin)
+{
+    return v < -margin ? -margin : (v > margin ? margin : v);
+}
+
+void Stabilizer::update (const unsigned char *frame)
+{
+    int dx, dy;
+
+    current ^= 1;
+    luma_downscale4(frame, order, width, height, small[current]);
+    if (!primed) {
+        primed = true;
+        return;
+    }
+
+    estimate_translation(small[current ^ 1], small[current], smallWidth, smallHeight,
+                         kSearchRange, &dx, &dy);
+    pathX += dx * 4;
+    pathY += dy * 4;
+    smoothX += (pathX * 16 - smoothX) >> kSmoothShift;
+    smoothY += (pathY * 16 - smoothY) >> kSmoothShift;
+
+    /* the window follows the shake, not the intended motion; at the edge
+     * of the margin the smoothed path is dragged along */
+    offsetX = clampOffset(pathX - smoothX / 16, marginX) & ~1;
+    offsetY = clampOffset(pathY - smoothY / 16, marginY);
+    smoothX = (pathX - offsetX) * 16;
+    smoothY = (pathY - offsetY) * 16;
+}
+
+void Stabilizer::convert (const unsigned char *frame, unsigned char *yuv420sp, int flags) const
+{
+    convertPacked422_window(frame, order, width, cropX(), cropY(), yuv420sp,
+                            outWidth, outHeight, flags);
+}
+
+}; // namespace android
@@ -0,0 +1,85 @@
+/*
+ *      This program is free software; you can redistribute it and/or modify
+ *      it under the terms of the GNU General Public License as published by
+ *      the Free Software Foundation; either version 2 of the License, or
+ *      (at your option) any later version.
+ *
+ * Electronic video stabilization by cropping. Every frame's translation
+ * against the previous one is estimated on reduced luma (motion.c) and
+ * added up into the camera path; a low-passed copy of the path is what the
+ * viewer should see, and the crop window moves by the difference, within
+ * the margin left around it. The window goes straight into the recording
+ * buffer's YUV420SP conversion, so the crop costs no pass of its own.
+ */
+
+#ifndef _STABILIZER_H
+#define _STABILIZER_H
+
+#include "ConvertKernels.h"
+
+namespace android {
+
+class Stabilizer {
+
+public:
+    Stabilizer ();
+    ~Stabilizer ();
+
+    /* Stabilized frame size for width x height frames with margin percent
+     * of each side kept in reserve; multiples of 16 */
+    static void cropSize (int width, int height, int margin, int *outWidth, int *outHeight);
+
+    /* For the packed 4:2:2 frames of one recording; margin 0 turns it
+     * off. False (and off) for other formats or out of memory. */
+    bool configure (PixelFormat format, int width, int height, int margin);
+
+    bool enabled () const { return isEnabled; }
+    void disable () { isEnabled = false; }
+
+    /* Estimate the motion of frame and move the window */
+    void update (const unsigned char *frame);
+
+    /* The window of frame to YUV420SP (convert.h flags) of outputSize() */
+    void convert (const unsigned char *frame, unsigned char *yuv420sp, int flags) const;
+
+    int outputWidth () const { return outWidth; }
+    int outputHeight () const { return outHeight; }
+    int outputSize () const { return outWidth * outHeight * 3 / 2; }
+
+    /* Window origin in the frame after the last update */
+    int cropX () const { return marginX + offsetX; }
+    int cropY () const { return marginY + offsetY; }
+
+private:
+    /* Not copyable: owns the reduced frames */
+    Stabilizer (const Stabilizer &);
+    Stabilizer &operator= (const Stabilizer &);
+
+    bool isEnabled;
+    int order;                  /* PACKED422_* */
+    int width;
+    int height;
+    int outWidth;
+    int outHeight;
+    int marginX;
+    int marginY;
+
+    /* reduced luma of the previous and current frame */
+    unsigned char *small[2];
+    int smallWidth;
+    int smallHeight;
+    int current;
+    bool primed;
+
+    /* camera path and its smoothed copy (x16) in frame pixels */
+    int pathX;
+    int pathY;
+    int smoothX;
+    int smoothY;
+    int offsetX;
+    int offsetY;
+};
+
+}; // namespace android
+
+#endif
@@ -0,0 +1,116 @@
+/*
+ *      This program is free software; you can redistribute it and/or modify
+ *      it under the terms of the GNU General Public License as published by
+ *      the Free Software Foundation; either version 2 of the License, or
+ *      (at your option) any later version.
+ *
+ */
+
+#define LOG_TAG "TemporalDenoise"
+#include "CameraLog.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "CameraStats.h"
+#include "TemporalDenoise.h"
+
+namespace android {
+
+/* Chroma noise is coarser and less visible when smeared, so it is
+ * filtered harder than luma */
+static const struct tnr_strength kStrength[] = {
+    { 0, 0, 1 },        /* LEVEL_OFF */
+    { 64, 96, 8 },      /* LEVEL_LOW: still areas average ~3 frames */
+    { 96, 112, 6 },     /* LEVEL_HIGH: ~4-8 frames, more motion tolerance */
+};
+
+TemporalDenoise::TemporalDenoise ()
+    : level(LEVEL_OFF),
+      layout(TNR_LUMA),
+      lumaBytes(0),
+      chromaBytes(0),
+      ref(NULL),
+      refCapacity(0),
+      primed(false),
+      processUs(0)
+{
+    strength = kStrength[LEVEL_OFF];
+}
+
+TemporalDenoise::~TemporalDenoise ()
+{
+    free(ref);
+}
+
+TemporalDenoise::Level TemporalDenoise::levelFromName (const char *name)
+{
+    if (name && !strcmp(name, "low"))
+        return LEVEL_LOW;
+    if (name && !strcmp(name, "high"))
+        return LEVEL_HIGH;
+    return LEVEL_OFF;
+}
+
+bool TemporalDenoise::configure (PixelFormat format, int width, int height, Level lvl)
+{
+    level = LEVEL_OFF;
+    primed = false;
+    if (lvl == LEVEL_OFF)
+        return true;
+
+    switch (format) {
+    case PIX_FMT_YUYV:
+    case PIX_FMT_YVYU:
+        layout = TNR_PACKED_Y_EVEN;
+        lumaBytes = width * height * 2;
+        chromaBytes = 0;
+        break;
+    case PIX_FMT_UYVY:
+    case PIX_FMT_VYUY:
+        layout = TNR_PACKED_Y_ODD;
+        lumaBytes = width * height * 2;
+        chromaBytes = 0;
+        break;
+    case PIX_FMT_NV12:
+    case PIX_FMT_NV21:
+        layout = TNR_LUMA;
+        lumaBytes = width * height;
+        chromaBytes = width * height / 2;
+        break;
+    default:
+        ALOGW("configure: no temporal denoise for %s", pixelFormatName(format));
+        return false;
+    }
+
+    size_t size = lumaBytes + chromaBytes;
+    if (size > refCapacity) {
+        free(ref);
+        ref = (unsigned char *) malloc(size);
+        refCapacity = ref ? size : 0;
+        if (!ref)
+            return false;
+    }
+
+    strength = kStrength[lvl];
+    level = lvl;
+    return true;
+}
+
+unsigned char *TemporalDenoise::process (const unsigned char *frame)
+{
+    int64_t t0 = cameraNowNs();
+
+    if (!primed) {
+        memcpy(ref, frame, lumaBytes + chromaBytes);
+        primed = true;
+    } else {
+        tnr_update(frame, ref, lumaBytes, layout, &strength);
+        if (chromaBytes)
+            tnr_update(frame + lumaBytes, ref + lumaBytes, chromaBytes, TNR_CHROMA, &strength);
+    }
+    processUs = (cameraNowNs() - t0) / 1000;
+    return ref;
+}
+
+}; // namespace android
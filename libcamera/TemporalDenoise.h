@@ -0,0 +1,73 @@
+/*
+ *      This program is free software; you can redistribute it and/or modify
+ *      it under the terms of the GNU General Public License as published by
+ *      the Free Software Foundation; either version 2 of the License, or
+ *      (at your option) any later version.
+ *
+ * Temporal noise reduction between capture and conversion, for low light
+ * preview. Each captured frame is blended into a reference kept in a
+ * buffer that lives across sessions; the reference is the denoised frame
+ * the converters read, so the capture buffer is left untouched and can go
+ * back to the driver (or to a snapshot) as it is.
+ */
+
+#ifndef _TEMPORALDENOISE_H
+#define _TEMPORALDENOISE_H
+
+#include <stdint.h>
+
+#include "ConvertKernels.h"
+#include "convert.h"
+
+namespace android {
+
+class TemporalDenoise {
+
+public:
+    enum Level {
+        LEVEL_OFF,
+        LEVEL_LOW,
+        LEVEL_HIGH
+    };
+
+    TemporalDenoise ();
+    ~TemporalDenoise ();
+
+    /* For the frames of one session. Packed 4:2:2 and NV12/NV21 are
+     * filtered; false (and off) for anything else or out of memory. */
+    bool configure (PixelFormat format, int width, int height, Level level);
+
+    bool enabled () const { return level != LEVEL_OFF; }
+
+    /* Blend frame into the reference and return it, valid until the next
+     * call or configure */
+    unsigned char *process (const unsigned char *frame);
+
+    /* Start over from the next frame, e.g. after an exposure jump */
+    void reset () { primed = false; }
+
+    /* Duration of the last process() in us */
+    int64_t lastUs () const { return processUs; }
+
+    static Level levelFromName (const char *name);
+
+private:
+    /* Not copyable: owns the reference */
+    TemporalDenoise (const TemporalDenoise &);
+    TemporalDenoise &operator= (const TemporalDenoise &);
+
+    Level level;
+    struct tnr_strength strength;
+    int layout;                 /* TNR_* of the first plane */
+    int lumaBytes;              /* first plane, or the whole packed frame */
+    int chromaBytes;            /* interleaved chroma plane, 0 if packed */
+
+    unsigned char *ref;
+    size_t refCapacity;
+    bool primed;
+    int64_t processUs;
+};
+
+}; // namespace android
+
+#endif
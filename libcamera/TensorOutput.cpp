@@ -0,0 +1,213 @@
+/*
+ *      This program is free software; you can redistribute it and/or modify
+ *      it under the terms of the GNU General Public License as published by
+ *      the Free Software Foundation; either version 2 of the License, or
+ *      (at your option) any later version.
+ *
+ */
+
+#define LOG_TAG "TensorOutput"
+#include "CameraLog.h"
+
+#include <string.h>
+
+#include "CameraStats.h"
+#include "TensorOutput.h"
+
+namespace android {
+
+TensorOutput::TensorOutput ()
+    : isEnabled(false),
+      decimation(1),
+      frames(0),
+      started(false),
+      quit(false),
+      pending(false),
+      inFlight(0),
+      device(NULL),
+      holdId(-1),
+      frame(NULL),
+      layout(PACKED422_YUYV),
+      width(0),
+      height(0),
+      dst(NULL),
+      callback(NULL),
+      user(NULL),
+      token(NULL),
+      convertUs(0)
+{
+    memset(&params, 0, sizeof(params));
+    params.type = TENSOR_FLOAT32;
+    for (int c = 0; c < 3; c++)
+        params.scale[c] = 1.0f;
+    job = params;
+    pthread_mutex_init(&lock, NULL);
+    pthread_cond_init(&wake, NULL);
+    pthread_cond_init(&done, NULL);
+}
+
+TensorOutput::~TensorOutput ()
+{
+    wait();
+    if (started) {
+        pthread_mutex_lock(&lock);
+        quit = true;
+        pthread_cond_signal(&wake);
+        pthread_mutex_unlock(&lock);
+        pthread_join(thread, NULL);
+    }
+    pthread_cond_destroy(&done);
+    pthread_cond_destroy(&wake);
+    pthread_mutex_destroy(&lock);
+}
+
+void TensorOutput::setSize (int w, int h)
+{
+    bool valid = w > 0 && h > 0 && w <= TENSOR_MAX_SIZE && h <= TENSOR_MAX_SIZE;
+
+    params.width = valid ? w : 0;
+    params.height = valid ? h : 0;
+}
+
+void TensorOutput::setCropOrigin (int x, int y)
+{
+    params.cropX = x > 0 ? x : 0;
+    params.cropY = y > 0 ? y : 0;
+}
+
+void TensorOutput::setCropSize (int w, int h)
+{
+    params.cropWidth = w > 0 ? w : 0;
+    params.cropHeight = h > 0 ? h : 0;
+}
+
+void TensorOutput::setType (int type, int flags)
+{
+    params.type = type == TENSOR_UINT8 ? TENSOR_UINT8 : TENSOR_FLOAT32;
+    params.flags = flags & TENSOR_BGR;
+}
+
+void TensorOutput::setNormalization (int channel, float mean, float std)
+{
+    if (channel < 0 || channel > 2 || std == 0.0f)
+        return;
+    params.mean[channel] = mean;
+    params.scale[channel] = 1.0f / std;
+}
+
+bool TensorOutput::accepts (PixelFormat format)
+{
+    switch (format) {
+    case PIX_FMT_YUYV:
+    case PIX_FMT_UYVY:
+    case PIX_FMT_YVYU:
+    case PIX_FMT_VYUY:
+    case PIX_FMT_NV12:
+    case PIX_FMT_NV21:
+        return true;
+    default:
+        return false;
+    }
+}
+
+bool TensorOutput::due ()
+{
+    return frames++ % decimation == 0;
+}
+
+bool TensorOutput::busy () const
+{
+    return inFlight != 0;
+}
+
+bool TensorOutput::submit (CaptureDevice *dev, int id, const void *src, PixelFormat format,
+                           int w, int h, void *out, Callback cb, void *u, void *t)
+{
+    int srcLayout;
+
+    switch (format) {
+    case PIX_FMT_YUYV: srcLayout = PACKED422_YUYV; break;
+    case PIX_FMT_UYVY: srcLayout = PACKED422_UYVY; break;
+    case PIX_FMT_YVYU: srcLayout = PACKED422_YVYU; break;
+    case PIX_FMT_VYUY: srcLayout = PACKED422_VYUY; break;
+    case PIX_FMT_NV12: srcLayout = TENSOR_SRC_NV12; break;
+    case PIX_FMT_NV21: srcLayout = TENSOR_SRC_NV21; break;
+    default:
+        return false;
+    }
+
+    if (!__sync_bool_compare_and_swap(&inFlight, 0, 1))
+        return false;
+
+    if (!started) {
+        if (pthread_create(&thread, NULL, threadMain, this) != 0) {
+            ALOGE("submit: unable to start the tensor thread");
+            __sync_lock_release(&inFlight);
+            return false;
+        }
+        started = true;
+    }
+
+    pthread_mutex_lock(&lock);
+    device = dev;
+    holdId = id;
+    frame = (const unsigned char *) src;
+    layout = srcLayout;
+    width = w;
+    height = h;
+    job = params;
+    dst = out;
+    callback = cb;
+    user = u;
+    token = t;
+    pending = true;
+    pthread_cond_signal(&wake);
+    pthread_mutex_unlock(&lock);
+    return true;
+}
+
+void TensorOutput::wait ()
+{
+    pthread_mutex_lock(&lock);
+    while (inFlight)
+        pthread_cond_wait(&done, &lock);
+    pthread_mutex_unlock(&lock);
+}
+
+void *TensorOutput::threadMain (void *arg)
+{
+    ((TensorOutput *) arg)->run();
+    return NULL;
+}
+
+void TensorOutput::run ()
+{
+    pthread_mutex_lock(&lock);
+    for (;;) {
+        while (!quit && !pending)
+            pthread_cond_wait(&wake, &lock);
+        if (quit)
+            break;
+        pending = false;
+        pthread_mutex_unlock(&lock);
+
+        int64_t t0 = cameraNowNs();
+        int ret = tensor_convert(frame, layout, width, height, &job, dst);
+        convertUs = (cameraNowNs() - t0) / 1000;
+
+        /* back to the stream before the client gets to run */
+        device->ReleaseHeldFrame(holdId);
+        if (ret < 0)
+            ALOGW("run: %dx%d window at %d,%d does not fit the %dx%d frame", job.cropWidth,
+                  job.cropHeight, job.cropX, job.cropY, width, height);
+        if (callback)
+            callback(user, token, ret == 0);
+
+        pthread_mutex_lock(&lock);
+        inFlight = 0;
+        pthread_cond_broadcast(&done);
+    }
+    pthread_mutex_unlock(&lock);
+}
+
+}; // namespace android
@@ -0,0 +1,118 @@
+/*
+ *      This program is free software; you can redistribute it and/or modify
+ *      it under the terms of the GNU General Public License as published by
+ *      the Free Software Foundation; either version 2 of the License, or
+ *      (at your option) any later version.
+ *
+ * Model input for on-device inference, made from the captured frame:
+ * cropped, resized and converted to planar RGB (bytes or normalized
+ * floats) in one pass (tensor.c). The capture thread hands over a frame
+ * the device holds and the destination; a worker thread that lives as
+ * long as the output fills it and gives the frame back, so the stream
+ * only waits for the hand over.
+ */
+
+#ifndef _TENSOROUTPUT_H
+#define _TENSOROUTPUT_H
+
+#include <pthread.h>
+#include <stdint.h>
+
+#include "CaptureDevice.h"
+#include "ConvertKernels.h"
+#include "convert.h"
+
+namespace android {
+
+class TensorOutput {
+
+public:
+    /* Runs on the worker when dst is filled, or with ok false if the
+     * window does not fit the frame */
+    typedef void (*Callback)(void *user, void *token, bool ok);
+
+    TensorOutput ();
+    ~TensorOutput ();
+
+    /* Setup, applied from the next submit. The output is off until it
+     * has a size of at most TENSOR_MAX_SIZE a side; a crop of 0 x 0 is
+     * the whole frame. */
+    void setEnabled (bool on) { isEnabled = on; }
+    void setSize (int width, int height);
+    void setCropOrigin (int x, int y);
+    void setCropSize (int width, int height);
+    /* TENSOR_UINT8 or TENSOR_FLOAT32, TENSOR_BGR flags */
+    void setType (int type, int flags);
+    /* Float output is (channel - mean) / std, channel 0..255 */
+    void setNormalization (int channel, float mean, float std);
+    void setDecimation (int every) { decimation = every > 1 ? every : 1; }
+
+    bool enabled () const { return isEnabled && frameSize() > 0; }
+    const struct tensor_params &parameters () const { return params; }
+
+    /* Packed 4:2:2, NV12 and NV21 frames can be converted */
+    static bool accepts (PixelFormat format);
+
+    /* Counts a frame; true if it is one of the output's */
+    bool due ();
+
+    /* Bytes submit writes */
+    size_t frameSize () const { return tensor_frame_size(&params); }
+
+    /* A frame is being converted */
+    bool busy () const;
+
+    /* Convert frame, held by device as holdId (CaptureDevice::HoldFrame),
+     * into dst of frameSize() bytes, then call callback with token.
+     * Returns false, leaving the frame to the caller, if busy or the
+     * worker cannot start. */
+    bool submit (CaptureDevice *device, int holdId, const void *frame, PixelFormat format,
+                 int width, int height, void *dst, Callback callback, void *user, void *token);
+
+    /* Until the last submitted frame is delivered */
+    void wait ();
+
+    /* Duration of the last conversion in us */
+    int64_t lastUs () const { return convertUs; }
+
+private:
+    static void *threadMain (void *arg);
+    void run ();
+
+    /* Not copyable: owns the worker */
+    TensorOutput (const TensorOutput &);
+    TensorOutput &operator= (const TensorOutput &);
+
+    bool isEnabled;
+    struct tensor_params params;
+    int decimation;
+    unsigned int frames;
+
+    pthread_t thread;
+    bool started;
+    pthread_mutex_t lock;
+    pthread_cond_t wake;        /* a job was posted, or quit */
+    pthread_cond_t done;        /* the job finished */
+    bool quit;
+    bool pending;               /* the job is set and not yet taken */
+    volatile int inFlight;
+
+    /* the job, set by submit */
+    CaptureDevice *device;
+    int holdId;
+    const unsigned char *frame;
+    int layout;                 /* PACKED422_* or TENSOR_SRC_* */
+    int width;
+    int height;
+    struct tensor_params job;
+    void *dst;
+    Callback callback;
+    void *user;
+    void *token;
+
+    int64_t convertUs;
+};
+
+}; // namespace android
+
+#endif
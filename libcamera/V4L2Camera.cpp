@@ -9,23 +9,28 @@
  */
 
 #define LOG_TAG "V4L2Camera"
-#include <utils/Log.h>
-#include <utils/threads.h>
+#include "CameraLog.h"
+
+#include <errno.h>
 #include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
 
 #include "V4L2Camera.h"
 
-extern "C" { /* Android jpeglib.h missed extern "C" */
-#include <jpeglib.h>
-     void convertYUYVtoRGB565(unsigned char *buf, unsigned char *rgb, int width, int height);
-}
-
 namespace android {
 
 V4L2Camera::V4L2Camera ()
-    : nQueued(0), nDequeued(0)
+    : bufferCount(NB_BUFFER), nQueued(0), nDequeued(0), timeline(NULL), firstFrame(false)
 {
     videoIn = (struct vdIn *) calloc (1, sizeof (struct vdIn));
+    for (int i = 0; i < MAX_BUFFERS; i++)
+        videoIn->dmabuf[i] = -1;
+    /* stills go to a V4L2 JPEG encoder if the SoC has one */
+    jpegEncoder.useHardware(NULL);
 }
 
 V4L2Camera::~V4L2Camera()
@@ -33,10 +38,39 @@ V4L2Camera::~V4L2Camera()
     free(videoIn);
 }
 
+/* Row length the converters assume for single plane formats, 0 for
+ * planar or unknown ones */
+static unsigned int packedLineBytes (unsigned int fourcc, int width)
+{
+    PixelFormat format = pixelFormatFromFourcc(fourcc);
+
+    switch (format) {
+    case PIX_FMT_NV12:
+    case PIX_FMT_NV21:
+    case PIX_FMT_I420:
+    case PIX_FMT_YV12:
+    case PIX_FMT_COUNT:
+        return 0;
+    default:
+        return pixelFormatFrameSize(format, width, 1);
+    }
+}
+
 int V4L2Camera::Open (const char *device, int width, int height, int pixelformat)
 {
     int ret;
 
+    if ((ret = OpenDevice(device)) < 0)
+        return ret;
+    if ((ret = SetFormat(width, height, pixelformat)) < 0)
+        close(fd);
+    return ret;
+}
+
+int V4L2Camera::OpenDevice (const char *device)
+{
+    int ret;
+
     if ((fd = open(device, O_RDWR)) == -1) {
         ALOGE("ERROR opening V4L interface: %s", strerror(errno));
     return -1;
@@ -45,19 +79,41 @@ int V4L2Camera::Open (const char *device, int width, int height, int pixelformat
     ret = ioctl (fd, VIDIOC_QUERYCAP, &videoIn->cap);
     if (ret < 0) {
         ALOGE("Error opening device: unable to query device.");
+        close(fd);
         return -1;
     }
 
     if ((videoIn->cap.capabilities & V4L2_CAP_VIDEO_CAPTURE) == 0) {
         ALOGE("Error opening device: video capture not supported.");
+        close(fd);
+        return -1;
+    }
+
+    /* mem2mem scalers and encoders have a capture queue too */
+    __u32 caps = (videoIn->cap.capabilities & V4L2_CAP_DEVICE_CAPS) ?
+                 videoIn->cap.device_caps : videoIn->cap.capabilities;
+    if (caps & (V4L2_CAP_VIDEO_M2M | V4L2_CAP_VIDEO_M2M_MPLANE | V4L2_CAP_VIDEO_OUTPUT)) {
+        ALOGI("Open: %s is a mem2mem device, not a camera", device);
+        close(fd);
         return -1;
     }
 
     if (!(videoIn->cap.capabilities & V4L2_CAP_STREAMING)) {
         ALOGE("Capture device does not support streaming i/o");
+        close(fd);
         return -1;
     }
 
+    if (timeline)
+        timeline->mark(SessionTimeline::OPEN);
+
+    return 0;
+}
+
+int V4L2Camera::SetFormat (int width, int height, int pixelformat)
+{
+    int ret;
+
     videoIn->width = width;
     videoIn->height = height;
     videoIn->framesizeIn = (width * height << 1);
@@ -70,10 +126,38 @@ int V4L2Camera::Open (const char *device, int width, int height, int pixelformat
 
     ret = ioctl(fd, VIDIOC_S_FMT, &videoIn->format);
     if (ret < 0) {
-        ALOGE("Open: VIDIOC_S_FMT Failed: %s", strerror(errno));
+        ALOGE("SetFormat: VIDIOC_S_FMT Failed: %s", strerror(errno));
         return ret;
     }
 
+    /* S_FMT may adjust the request; the caller sizes its buffers from
+     * width and height, so only a different pixel format is acceptable */
+    if ((int) videoIn->format.fmt.pix.width != width ||
+        (int) videoIn->format.fmt.pix.height != height) {
+        ALOGE("SetFormat: %dx%d not supported, driver offers %ux%u", width, height,
+              videoIn->format.fmt.pix.width, videoIn->format.fmt.pix.height);
+        return -1;
+    }
+    if (videoIn->format.fmt.pix.pixelformat != (unsigned int) pixelformat)
+        ALOGW("SetFormat: driver chose %.4s instead of %.4s",
+              (const char *) &videoIn->format.fmt.pix.pixelformat, (const char *) &pixelformat);
+    videoIn->formatIn = videoIn->format.fmt.pix.pixelformat;
+    /* Bayer and other formats are not two bytes per pixel, and the
+     * converters walk rows without padding */
+    unsigned int lineBytes = packedLineBytes(videoIn->formatIn, width);
+    if (lineBytes && videoIn->format.fmt.pix.bytesperline &&
+        videoIn->format.fmt.pix.bytesperline != lineBytes) {
+        ALOGE("SetFormat: %.4s rows padded to %u bytes are not supported",
+              (const char *) &videoIn->formatIn, videoIn->format.fmt.pix.bytesperline);
+        return -1;
+    }
+    if (videoIn->format.fmt.pix.sizeimage)
+        videoIn->framesizeIn = videoIn->format.fmt.pix.sizeimage;
+    else if (lineBytes)
+        videoIn->framesizeIn = lineBytes * height;
+    if (timeline)
+        timeline->mark(SessionTimeline::S_FMT);
+
     return 0;
 }
 
@@ -82,22 +166,33 @@ void V4L2Camera::Close ()
     close(fd);
 }
 
+unsigned int V4L2Camera::GetPixelFormat ()
+{
+    return videoIn->formatIn;
+}
+
 int V4L2Camera::Init()
 {
     int ret;
 
-    /* Check if camera can handle NB_BUFFER buffers */
+    /* Check if camera can handle bufferCount buffers */
     videoIn->rb.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
     videoIn->rb.memory = V4L2_MEMORY_MMAP;
-    videoIn->rb.count = NB_BUFFER;
+    videoIn->rb.count = bufferCount;
 
     ret = ioctl(fd, VIDIOC_REQBUFS, &videoIn->rb);
     if (ret < 0) {
         ALOGE("Init: VIDIOC_REQBUFS failed: %s", strerror(errno));
         return ret;
     }
+    /* the driver may round the count either way */
+    videoIn->nBuffers = videoIn->rb.count < MAX_BUFFERS ? videoIn->rb.count : MAX_BUFFERS;
+    if (videoIn->nBuffers != bufferCount)
+        ALOGW("Init: asked for %d buffers, got %d", bufferCount, videoIn->nBuffers);
+    if (timeline)
+        timeline->mark(SessionTimeline::REQBUFS);
 
-    for (int i = 0; i < NB_BUFFER; i++) {
+    for (int i = 0; i < videoIn->nBuffers; i++) {
 
         memset (&videoIn->buf, 0, sizeof (struct v4l2_buffer));
 
@@ -123,6 +218,21 @@ int V4L2Camera::Init()
             return -1;
         }
 
+        /* for importers in this process (mem2mem converter, JPEG
+         * encoder); read only, as they never write the frame */
+#ifdef VIDIOC_EXPBUF
+        struct v4l2_exportbuffer expbuf;
+
+        memset(&expbuf, 0, sizeof(expbuf));
+        expbuf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+        expbuf.index = i;
+        expbuf.flags = O_RDONLY | O_CLOEXEC;
+        if (ioctl(fd, VIDIOC_EXPBUF, &expbuf) == 0)
+            videoIn->dmabuf[i] = expbuf.fd;
+        else if (i == 0)
+            ALOGI("Init: VIDIOC_EXPBUF not supported (%s)", strerror(errno));
+#endif
+
         ret = ioctl(fd, VIDIOC_QBUF, &videoIn->buf);
         if (ret < 0) {
             ALOGE("Init: VIDIOC_QBUF Failed");
@@ -131,6 +241,8 @@ int V4L2Camera::Init()
 
         nQueued++;
     }
+    if (timeline)
+        timeline->mark(SessionTimeline::MMAP);
 
     return 0;
 }
@@ -154,9 +266,14 @@ void V4L2Camera::Uninit ()
     nDequeued = 0;
 
     /* Unmap buffers */
-    for (int i = 0; i < NB_BUFFER; i++)
+    for (int i = 0; i < videoIn->nBuffers; i++) {
         if (munmap(videoIn->mem[i], videoIn->buf.length) < 0)
             ALOGE("Uninit: Unmap failed");
+        if (videoIn->dmabuf[i] >= 0)
+            close(videoIn->dmabuf[i]);
+        videoIn->dmabuf[i] = -1;
+    }
+    videoIn->nBuffers = 0;
 }
 
 int V4L2Camera::StartStreaming ()
@@ -174,6 +291,9 @@ int V4L2Camera::StartStreaming ()
         }
 
         videoIn->isStreaming = true;
+        firstFrame = true;
+        if (timeline)
+            timeline->mark(SessionTimeline::STREAMON);
     }
 
     return 0;
@@ -214,6 +334,7 @@ void * V4L2Camera::GrabPreviewFrame ()
         return NULL;
     }
     nDequeued++;
+    markFirstFrame();
     return  videoIn->mem[videoIn->buf.index];
 }
 
@@ -221,86 +342,95 @@ void V4L2Camera::ReleasePreviewFrame ()
 {
     int ret;
     ret = ioctl(fd, VIDIOC_QBUF, &videoIn->buf);
-    nQueued++;
+    __sync_fetch_and_add(&nQueued, 1);
     if (ret < 0) {
         ALOGE("GrabPreviewFrame: VIDIOC_QBUF Failed");
         return;
     }
 }
 
+int V4L2Camera::HoldFrame ()
+{
+    return videoIn->buf.index;
+}
 
-sp<IMemory> V4L2Camera::GrabRawFrame ()
+void V4L2Camera::ReleaseHeldFrame (int id)
 {
-    sp<MemoryHeapBase> memHeap = new MemoryHeapBase(videoIn->width * videoIn->height * 2);
-    sp<MemoryBase> memBase = new MemoryBase(memHeap, 0, videoIn->width * videoIn->height * 2);
+    /* videoIn->buf belongs to the capture thread */
+    struct v4l2_buffer buf;
+
+    memset(&buf, 0, sizeof(buf));
+    buf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    buf.memory = V4L2_MEMORY_MMAP;
+    buf.index = id;
+    if (ioctl(fd, VIDIOC_QBUF, &buf) < 0) {
+        ALOGE("ReleaseHeldFrame: VIDIOC_QBUF Failed: %s", strerror(errno));
+        return;
+    }
+    __sync_fetch_and_add(&nQueued, 1);
+}
 
-    // Not yet implemented, do I have to?
+int64_t V4L2Camera::GetFrameTimestamp ()
+{
+#ifdef V4L2_BUF_FLAG_TIMESTAMP_MASK
+    if ((videoIn->buf.flags & V4L2_BUF_FLAG_TIMESTAMP_MASK) != V4L2_BUF_FLAG_TIMESTAMP_MONOTONIC)
+        return 0;
+#else
+    return 0;
+#endif
 
-    return memBase;
+    return (int64_t) videoIn->buf.timestamp.tv_sec * 1000000000LL +
+           (int64_t) videoIn->buf.timestamp.tv_usec * 1000LL;
 }
 
-// a helper class for jpeg compression in memory
-class MemoryStream {
-public:
-    MemoryStream(char* buf, size_t sz);
-    ~MemoryStream() { closeStream(); }
-
-    void closeStream();
-    size_t getOffset() const { return bytesWritten; }
-    operator FILE *() { return file; }
-
-private:
-    static int runThread(void *);
-    int readPipe();
-
-    char *buffer;
-    size_t size;
-    size_t bytesWritten;
-    int pipefd[2];
-    FILE *file;
-    Mutex lock;
-    Condition exitedCondition;
-};
-
-MemoryStream::MemoryStream(char* buf, size_t sz)
-    : buffer(buf), size(sz), bytesWritten(0)
+unsigned int V4L2Camera::GetFrameSequence ()
 {
-    if ((file = pipe(pipefd) ? NULL : fdopen(pipefd[1], "w")))
-        createThread(runThread, this);
+    return videoIn->buf.sequence;
 }
 
-void MemoryStream::closeStream()
+size_t V4L2Camera::GetFrameSize ()
 {
-    if (file) {
-        AutoMutex l(lock);
-        fclose(file);
-        file = NULL;
-        exitedCondition.wait(lock);
-    }
+    return videoIn->buf.bytesused ? videoIn->buf.bytesused : videoIn->framesizeIn;
 }
 
-int MemoryStream::runThread(void *self)
+int V4L2Camera::GetFrameFd ()
 {
-    return static_cast<MemoryStream *>(self)->readPipe();
+    return videoIn->dmabuf[videoIn->buf.index];
 }
 
-int MemoryStream::readPipe()
+void V4L2Camera::SetTimeline (SessionTimeline *t)
 {
-    char *buf = buffer;
-    ssize_t sz;
-    while ((sz = read(pipefd[0], buf, size - bytesWritten)) > 0) {
-        bytesWritten += sz;
-        buf += sz;
-    }
-    close(pipefd[0]);
-    AutoMutex l(lock);
-    exitedCondition.signal();
-    return 0;
+    timeline = t;
+}
+
+void V4L2Camera::markFirstFrame ()
+{
+    if (firstFrame && timeline)
+        timeline->mark(SessionTimeline::FIRST_FRAME);
+    firstFrame = false;
+}
+
+int V4L2Camera::GetQueuedBuffers ()
+{
+    return nQueued - nDequeued;
+}
+
+void V4L2Camera::SetBufferCount (int count)
+{
+    if (count < 2)
+        count = 2;
+    bufferCount = count < MAX_BUFFERS ? count : MAX_BUFFERS;
+}
+
+int V4L2Camera::GetBufferCount ()
+{
+    return videoIn->nBuffers;
 }
 
-camera_memory_t*  V4L2Camera::GrabJpegFrame (camera_request_memory   mRequestMemory)
+int V4L2Camera::GrabJpegFrame (void *jpeg, size_t size)
 {
     int ret;
+    int jpegSize;
 
     videoIn->buf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
     videoIn->buf.memory = V4L2_MEMORY_MMAP;
@@ -309,106 +439,67 @@ camera_memory_t*  V4L2Camera::GrabJpegFrame (camera_request_memory   mRequestMem
     ret = ioctl(fd, VIDIOC_DQBUF, &videoIn->buf);
     if (ret < 0) {
         ALOGE("GrabJpegFrame: VIDIOC_DQBUF Failed");
-        return NULL;
+        return -1;
     }
     nDequeued++;
+    markFirstFrame();
 
     ALOGI("GrabJpegFrame: Generated a frame from capture device");
 
-    /* Enqueue buffer */
+    jpegSize = jpegEncoder.encode((unsigned char *)videoIn->mem[videoIn->buf.index],
+                                  videoIn->dmabuf[videoIn->buf.index],
+                                  pixelFormatFromFourcc(videoIn->formatIn),
+                                  videoIn->width, videoIn->height, 100,
+                                  (unsigned char *)jpeg, size);
+
+    /* Enqueue buffer once the encoder is done with it */
     ret = ioctl(fd, VIDIOC_QBUF, &videoIn->buf);
     if (ret < 0) {
         ALOGE("GrabJpegFrame: VIDIOC_QBUF Failed");
-        return NULL;
+        return -1;
     }
     nQueued++;
 
-    size_t bytesused = videoIn->buf.bytesused;
-    if (char *tmpBuf = new char[bytesused]) {
-        MemoryStream strm(tmpBuf, bytesused);
-        saveYUYVtoJPEG((unsigned char *)videoIn->mem[videoIn->buf.index], videoIn->width, videoIn->height, strm, 100);
-        strm.closeStream();
-        size_t fileSize = strm.getOffset();
-         camera_memory_t* picture = mRequestMemory(-1,fileSize,1,NULL);
-        memcpy(picture->data, tmpBuf, fileSize);
-        delete[] tmpBuf;
-
-        return picture;
-    }
-
-    return NULL;
+    return jpegSize;
 }
 
-int V4L2Camera::saveYUYVtoJPEG (unsigned char *inputBuffer, int width, int height, FILE *file, int quality)
+int V4L2Camera::GetControl (unsigned int id, int *value)
 {
-    struct jpeg_compress_struct cinfo;
-    struct jpeg_error_mgr jerr;
-    JSAMPROW row_pointer[1];
-    unsigned char *line_buffer, *yuyv;
-    int z;
-    int fileSize;
-
-    line_buffer = (unsigned char *) calloc (width * 3, 1);
-    yuyv = inputBuffer;
-
-    cinfo.err = jpeg_std_error (&jerr);
-    jpeg_create_compress (&cinfo);
-    jpeg_stdio_dest (&cinfo, file);
+    struct v4l2_control ctrl;
 
-    ALOGI("JPEG PICTURE WIDTH AND HEIGHT: %dx%d", width, height);
-
-    cinfo.image_width = width;
-    cinfo.image_height = height;
-    cinfo.input_components = 3;
-    cinfo.in_color_space = JCS_RGB;
-
-    jpeg_set_defaults (&cinfo);
-    jpeg_set_quality (&cinfo, quality, TRUE);
-
-    jpeg_start_compress (&cinfo, TRUE);
-
-    z = 0;
-    while (cinfo.next_scanline < cinfo.image_height) {
-        int x;
-        unsigned char *ptr = line_buffer;
-
-        for (x = 0; x < width; x++) {
-            int r, g, b;
-            int y, u, v;
-
-            if (!z)
-                y = yuyv[0] << 8;
-            else
-                y = yuyv[2] << 8;
-
-            u = yuyv[1] - 128;
-            v = yuyv[3] - 128;
-
-            r = (y + (359 * v)) >> 8;
-            g = (y - (88 * u) - (183 * v)) >> 8;
-            b = (y + (454 * u)) >> 8;
-
-            *(ptr++) = (r > 255) ? 255 : ((r < 0) ? 0 : r);
-            *(ptr++) = (g > 255) ? 255 : ((g < 0) ? 0 : g);
-            *(ptr++) = (b > 255) ? 255 : ((b < 0) ? 0 : b);
+    memset(&ctrl, 0, sizeof(ctrl));
+    ctrl.id = id;
+    if (ioctl(fd, VIDIOC_G_CTRL, &ctrl) < 0)
+        return -1;
+    *value = ctrl.value;
+    return 0;
+}
 
-            if (z++) {
-                z = 0;
-                yuyv += 4;
-            }
-        }
+int V4L2Camera::SetControl (unsigned int id, int value)
+{
+    struct v4l2_control ctrl;
 
-        row_pointer[0] = line_buffer;
-        jpeg_write_scanlines (&cinfo, row_pointer, 1);
+    memset(&ctrl, 0, sizeof(ctrl));
+    ctrl.id = id;
+    ctrl.value = value;
+    if (ioctl(fd, VIDIOC_S_CTRL, &ctrl) < 0) {
+        ALOGW("SetControl: 0x%x = %d failed: %s", id, value, strerror(errno));
+        return -1;
     }
+    return 0;
+}
 
-    jpeg_finish_compress (&cinfo);
-    fileSize = ftell(file);
-    jpeg_destroy_compress (&cinfo);
-
-    free (line_buffer);
+int V4L2Camera::QueryControl (unsigned int id, int *minimum, int *maximum)
+{
+    struct v4l2_queryctrl query;
 
-    return fileSize;
+    memset(&query, 0, sizeof(query));
+    query.id = id;
+    if (ioctl(fd, VIDIOC_QUERYCTRL, &query) < 0 || (query.flags & V4L2_CTRL_FLAG_DISABLED))
+        return -1;
+    *minimum = query.minimum;
+    *maximum = query.maximum;
+    return 0;
 }
 
 }; // namespace android
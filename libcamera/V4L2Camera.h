@@ -12,12 +12,25 @@
 #define _V4L2CAMERA_H
 
 #define NB_BUFFER 4
+/* upper bound for SetBufferCount */
+#define MAX_BUFFERS 16
 
-#include <binder/MemoryBase.h>
-#include <binder/MemoryHeapBase.h>
-#include <linux/videodev.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <linux/videodev2.h>
+
+/* MIPI packed raw, missing from older kernel headers */
+#ifndef V4L2_PIX_FMT_SBGGR10P
+#define V4L2_PIX_FMT_SBGGR10P v4l2_fourcc('p', 'B', 'A', 'A')
+#endif
+#ifndef V4L2_PIX_FMT_SBGGR12P
+#define V4L2_PIX_FMT_SBGGR12P v4l2_fourcc('p', 'B', 'C', 'C')
+#endif
+
+#include "CameraStats.h"
+#include "CaptureDevice.h"
+#include "JpegEncoder.h"
 
-#include <hardware/camera.h>
 namespace android {
 
 struct vdIn {
@@ -25,7 +38,9 @@ struct vdIn {
     struct v4l2_format format;
     struct v4l2_buffer buf;
     struct v4l2_requestbuffers rb;
-    void *mem[NB_BUFFER];
+    int nBuffers;               /* granted by VIDIOC_REQBUFS */
+    void *mem[MAX_BUFFERS];
+    int dmabuf[MAX_BUFFERS];    /* VIDIOC_EXPBUF, -1 if unsupported */
     bool isStreaming;
     int width;
     int height;
@@ -33,7 +48,7 @@ struct vdIn {
     int framesizeIn;
 };
 
-class V4L2Camera {
+class V4L2Camera : public CaptureDevice {
 
 public:
     V4L2Camera();
@@ -41,6 +56,13 @@ public:
 
     int Open (const char *device, int width, int height, int pixelformat);
     void Close ();
+    unsigned int GetPixelFormat ();
+
+    /* Open in two steps, to try several formats on one node: OpenDevice
+     * fails unless the node is a streaming camera, and a failed SetFormat
+     * leaves it open for the next attempt */
+    int OpenDevice (const char *device);
+    int SetFormat (int width, int height, int pixelformat);
 
     int Init ();
     void Uninit ();
@@ -50,20 +72,46 @@ public:
 
     void * GrabPreviewFrame ();
     void ReleasePreviewFrame ();
-    sp<IMemory> GrabRawFrame ();
-    camera_memory_t*   GrabJpegFrame (camera_request_memory   mRequestMemory);
+    int HoldFrame ();
+    void ReleaseHeldFrame (int id);
+
+    int64_t GetFrameTimestamp ();
+    unsigned int GetFrameSequence ();
+    size_t GetFrameSize ();
+    int GetFrameFd ();
+    int GrabJpegFrame (void *jpeg, size_t size);
+
+    int GetControl (unsigned int id, int *value);
+    int SetControl (unsigned int id, int value);
+    int QueryControl (unsigned int id, int *minimum, int *maximum);
+
+    /* Buffers currently queued in the driver */
+    int GetQueuedBuffers ();
+
+    /* Buffers to request at the next Init (NB_BUFFER by default, at most
+     * MAX_BUFFERS); frames held by the client need buffers beyond the
+     * ones that keep the stream going */
+    void SetBufferCount (int count);
+    /* Buffers the driver actually granted, valid after Init */
+    int GetBufferCount ();
+
+    /* Startup milestones (open .. first frame) are marked here if set */
+    void SetTimeline (SessionTimeline *timeline);
 
 private:
+    void markFirstFrame ();
+
     struct vdIn *videoIn;
     int fd;
+    int bufferCount;
 
-    int nQueued;
+    volatile int nQueued;      /* ReleaseHeldFrame may run on another thread */
     int nDequeued;
 
-    int saveYUYVtoJPEG (unsigned char *inputBuffer, int width, int height, FILE *file, int quality);
+    SessionTimeline *timeline;
+    bool firstFrame;
 
-    void convert(unsigned char *buf, unsigned char *rgb, int width, int height);
-    void yuv_to_rgb16(unsigned char y, unsigned char u, unsigned char v, unsigned char *rgb);
+    JpegEncoder jpegEncoder;
 };
 
 }; // namespace android
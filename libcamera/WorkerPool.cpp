@@ -0,0 +1,153 @@
+/*
+ *      This program is free software; you can redistribute it and/or modify
+ *      it under the terms of the GNU General Public License as published by
+ *      the Free Software Foundation; either version 2 of the License, or
+ *      (at your option) any later version.
+ *
+ */
+
+#define LOG_TAG "WorkerPool"
+#include "CameraLog.h"
+
+#include <unistd.h>
+
+#include "WorkerPool.h"
+
+namespace android {
+
+WorkerPool::WorkerPool ()
+    : nThreads(0),
+      quit(false),
+      generation(0),
+      job(NULL),
+      arg(NULL),
+      parts(0),
+      nextPart(0),
+      partsLeft(0),
+      active(0)
+{
+    pthread_mutex_init(&lock, NULL);
+    pthread_cond_init(&wake, NULL);
+    pthread_cond_init(&idle, NULL);
+}
+
+WorkerPool::~WorkerPool ()
+{
+    stop();
+    pthread_cond_destroy(&idle);
+    pthread_cond_destroy(&wake);
+    pthread_mutex_destroy(&lock);
+}
+
+int WorkerPool::start (int count)
+{
+    if (nThreads)
+        return nThreads;
+
+    if (count <= 0) {
+        long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        count = cpus > 1 ? (int) cpus - 1 : 0;
+    }
+    if (count > MAX_THREADS)
+        count = MAX_THREADS;
+
+    quit = false;
+    for (; nThreads < count; nThreads++) {
+        if (pthread_create(&threads[nThreads], NULL, threadMain, this) != 0) {
+            ALOGW("start: only %d of %d workers started", nThreads, count);
+            break;
+        }
+    }
+    return nThreads;
+}
+
+void WorkerPool::stop ()
+{
+    pthread_mutex_lock(&lock);
+    quit = true;
+    pthread_cond_broadcast(&wake);
+    pthread_mutex_unlock(&lock);
+
+    for (int i = 0; i < nThreads; i++)
+        pthread_join(threads[i], NULL);
+    nThreads = 0;
+}
+
+void WorkerPool::run (Job j, void *a, int n)
+{
+    if (n <= 0)
+        return;
+    if (!nThreads) {
+        for (int i = 0; i < n; i++)
+            j(a, i, n);
+        return;
+    }
+
+    pthread_mutex_lock(&lock);
+    job = j;
+    arg = a;
+    parts = n;
+    nextPart = 0;
+    partsLeft = n;
+    generation++;
+    pthread_cond_broadcast(&wake);
+    pthread_mutex_unlock(&lock);
+
+    runParts();
+
+    /* no worker may still be claiming parts when the next job is posted */
+    pthread_mutex_lock(&lock);
+    while (partsLeft || active)
+        pthread_cond_wait(&idle, &lock);
+    pthread_mutex_unlock(&lock);
+}
+
+/* Claim parts until none are left; the last one out wakes run() */
+void WorkerPool::runParts ()
+{
+    int part, done = 0;
+
+    while ((part = __sync_fetch_and_add(&nextPart, 1)) < parts) {
+        job(arg, part, parts);
+        done++;
+    }
+    if (!done)
+        return;
+
+    pthread_mutex_lock(&lock);
+    partsLeft -= done;
+    if (!partsLeft)
+        pthread_cond_signal(&idle);
+    pthread_mutex_unlock(&lock);
+}
+
+void *WorkerPool::threadMain (void *arg)
+{
+    ((WorkerPool *) arg)->work();
+    return NULL;
+}
+
+void WorkerPool::work ()
+{
+    unsigned int seen = 0;
+
+    pthread_mutex_lock(&lock);
+    for (;;) {
+        while (!quit && seen == generation)
+            pthread_cond_wait(&wake, &lock);
+        if (quit)
+            break;
+        seen = generation;
+        active++;
+        pthread_mutex_unlock(&lock);
+
+        runParts();
+
+        pthread_mutex_lock(&lock);
+        if (!--active)
+            pthread_cond_signal(&idle);
+    }
+    pthread_mutex_unlock(&lock);
+}
+
+}; // namespace android
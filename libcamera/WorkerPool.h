@@ -0,0 +1,69 @@
+/*
+ *      This program is free software; you can redistribute it and/or modify
+ *      it under the terms of the GNU General Public License as published by
+ *      the Free Software Foundation; either version 2 of the License, or
+ *      (at your option) any later version.
+ *
+ * A few long lived threads for data parallel image work. run() splits a
+ * job into parts that the workers and the calling thread pick up in turn,
+ * and returns once all of them are done.
+ */
+
+#ifndef _WORKERPOOL_H
+#define _WORKERPOOL_H
+
+#include <pthread.h>
+
+namespace android {
+
+class WorkerPool {
+
+public:
+    enum { MAX_THREADS = 8 };
+
+    /* Called once for every part in 0..parts-1, from any thread */
+    typedef void (*Job)(void *arg, int part, int parts);
+
+    WorkerPool ();
+    ~WorkerPool ();
+
+    /* Start threads workers besides the caller; 0 uses one per online CPU
+     * but the caller's. Returns the number started. */
+    int start (int threads);
+    void stop ();
+
+    /* Threads run() spreads over, the caller included */
+    int size () const { return nThreads + 1; }
+
+    /* One job at a time; without workers the caller runs every part */
+    void run (Job job, void *arg, int parts);
+
+private:
+    static void *threadMain (void *arg);
+    void work ();
+    void runParts ();
+
+    /* Not copyable: owns the threads */
+    WorkerPool (const WorkerPool &);
+    WorkerPool &operator= (const WorkerPool &);
+
+    pthread_t threads[MAX_THREADS];
+    int nThreads;
+
+    pthread_mutex_t lock;
+    pthread_cond_t wake;        /* a job was posted, or stop */
+    pthread_cond_t idle;        /* the last part finished, or a worker left it */
+    bool quit;
+    unsigned int generation;
+
+    Job job;
+    void *arg;
+    int parts;
+    volatile int nextPart;
+    int partsLeft;
+    int active;                 /* workers inside runParts */
+};
+
+}; // namespace android
+
+#endif
@@ -0,0 +1,98 @@
+/*
+ *      This program is free software; you can redistribute it and/or modify
+ *      it under the terms of the GNU General Public License as published by
+ *      the Free Software Foundation; either version 2 of the License, or
+ *      (at your option) any later version.
+ *
+ * Small helpers shared by the host benchmarks: monotonic and CPU clocks,
+ * a per-thread hardware cycle counter and percentiles.
+ */
+
+#ifndef _BENCHUTIL_H
+#define _BENCHUTIL_H
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+
+#include <algorithm>
+#include <vector>
+
+namespace bench {
+
+static inline int64_t nowNs()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t) ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static inline int64_t cpuTimeNs()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+    return (int64_t) ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+/* CPU cycles spent by the calling thread, via perf. valid() is false when
+ * the kernel or sandbox does not expose the counter. */
+class CycleCounter {
+public:
+    CycleCounter() : fd(-1)
+    {
+        struct perf_event_attr attr;
+
+        memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        attr.type = PERF_TYPE_HARDWARE;
+        attr.config = PERF_COUNT_HW_CPU_CYCLES;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        fd = syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+    }
+    ~CycleCounter()
+    {
+        if (fd >= 0)
+            close(fd);
+    }
+
+    bool valid() const { return fd >= 0; }
+
+    uint64_t read() const
+    {
+        uint64_t count = 0;
+        if (fd < 0 || ::read(fd, &count, sizeof(count)) != sizeof(count))
+            return 0;
+        return count;
+    }
+
+private:
+    int fd;
+};
+
+/* p in [0, 100]; sorts a copy of the samples */
+static inline double percentile(std::vector<double> samples, double p)
+{
+    if (samples.empty())
+        return 0;
+    std::sort(samples.begin(), samples.end());
+    size_t i = (size_t) ((p / 100.0) * (samples.size() - 1) + 0.5);
+    return samples[i];
+}
+
+static inline void *alignedAlloc(size_t size)
+{
+    void *p = NULL;
+    if (posix_memalign(&p, 64, size))
+        return NULL;
+    return p;
+}
+
+}; // namespace bench
+
+#endif
@@ -0,0 +1,480 @@
+/*
+ *      This program is free software; you can redistribute it and/or modify
+ *      it under the terms of the GNU General Public License as published by
+ *      the Free Software Foundation; either version 2 of the License, or
+ *      (at your option) any later version.
+ *
+ * End-to-end capture benchmark. Drives V4L2Camera through the same steps
+ * as CameraHardware::previewThread (DQBUF, YUYV->RGB565 for the display,
+ * YUYV->YUV420SP for the preview callback, QBUF) and reports per-stage
+ * timings, fps, capture-to-release latency and CPU usage.
+ *
+ * Without camera hardware use the vivid test driver ("modprobe vivid") or
+ * a v4l2loopback node; with -p the benchmark feeds the loopback itself.
+ * -F replays a raw file through FakeCamera instead, with deterministic
+ * pacing, jitter and drops.
+ *
+ * -T writes the same per-frame trace markers as the HAL, -v prints the
+ * CameraStats block the HAL reports from dump(). -N runs the temporal
+ * denoise between capture and conversion, as the HAL's "temporal-nr".
+ * -J also JPEG encodes every measured frame, on a V4L2 mem2mem encoder
+ * (the node given, or the first one found with "auto") handed the
+ * capture buffer's dma-buf, or with libjpeg where there is none. -M
+ * does the display conversion on a V4L2 mem2mem converter the same way
+ * ("modprobe vim2m" provides one on any host).
+ *
+ *   capture_bench [-d /dev/videoN] [-s WxH] [-n frames] [-p fps] [-N low|high]
+ *                 [-J node|auto|sw] [-M node|auto]
+ *   capture_bench -F frames.yuv [-f yuyv|nv12|mjpeg] [-r fps] [-j us] [-D %]
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <linux/videodev2.h>
+
+#include "BenchUtil.h"
+#include "CameraStats.h"
+#include "CameraTrace.h"
+#include "ConvertGraph.h"
+#include "FakeCamera.h"
+#include "JpegEncoder.h"
+#include "M2MConverter.h"
+#include "TemporalDenoise.h"
+#include "V4L2Camera.h"
+#include "convert.h"
+
+using namespace android;
+using namespace bench;
+
+namespace {
+
+enum Stage {
+    STAGE_DQBUF,
+    STAGE_CONVERT,
+    STAGE_CALLBACK,
+    STAGE_QBUF,
+    STAGE_COUNT
+};
+
+static const char *kStageNames[STAGE_COUNT] = {
+    "dqbuf wait", "convert", "callback", "qbuf",
+};
+
+static bool queryDriver(const char *node, char *driver, size_t size)
+{
+    struct v4l2_capability cap;
+    int fd = open(node, O_RDWR | O_NONBLOCK);
+
+    if (fd < 0)
+        return false;
+    memset(&cap, 0, sizeof(cap));
+    bool ok = ioctl(fd, VIDIOC_QUERYCAP, &cap) == 0;
+    close(fd);
+    if (!ok)
+        return false;
+
+    __u32 caps = (cap.capabilities & V4L2_CAP_DEVICE_CAPS) ? cap.device_caps : cap.capabilities;
+    snprintf(driver, size, "%s", (const char *) cap.driver);
+    return (caps & (V4L2_CAP_VIDEO_CAPTURE | V4L2_CAP_VIDEO_OUTPUT)) != 0;
+}
+
+/* First vivid or v4l2loopback node, which is what we want on a host */
+static bool findTestNode(char *node, size_t size)
+{
+    for (int i = 0; i < 64; i++) {
+        char path[32], driver[32];
+        snprintf(path, sizeof(path), "/dev/video%d", i);
+        if (!queryDriver(path, driver, sizeof(driver)))
+            continue;
+        if (!strcmp(driver, "vivid") || !strcmp(driver, "v4l2 loopback")) {
+            snprintf(node, size, "%s", path);
+            return true;
+        }
+    }
+    return false;
+}
+
+/* Writes a moving YUYV pattern into a v4l2loopback node at a fixed rate */
+struct Producer {
+    const char *node;
+    int width;
+    int height;
+    int fps;
+    volatile bool stop;
+    pthread_t thread;
+
+    static void *run(void *self);
+};
+
+void *Producer::run(void *self)
+{
+    Producer *p = (Producer *) self;
+    struct v4l2_format fmt;
+    size_t size = (size_t) p->width * p->height * 2;
+    int fd = open(p->node, O_WRONLY);
+
+    if (fd < 0) {
+        fprintf(stderr, "producer: cannot open %s: %s\n", p->node, strerror(errno));
+        return NULL;
+    }
+
+    memset(&fmt, 0, sizeof(fmt));
+    fmt.type = V4L2_BUF_TYPE_VIDEO_OUTPUT;
+    fmt.fmt.pix.width = p->width;
+    fmt.fmt.pix.height = p->height;
+    fmt.fmt.pix.pixelformat = V4L2_PIX_FMT_YUYV;
+    fmt.fmt.pix.sizeimage = size;
+    fmt.fmt.pix.field = V4L2_FIELD_NONE;
+    if (ioctl(fd, VIDIOC_S_FMT, &fmt) < 0)
+        fprintf(stderr, "producer: VIDIOC_S_FMT failed: %s\n", strerror(errno));
+
+    unsigned char *frame = (unsigned char *) malloc(size);
+    int64_t period = 1000000000LL / p->fps;
+    int64_t next = nowNs();
+
+    for (unsigned int n = 0; !p->stop; n++) {
+        for (size_t i = 0; i < size; i++)
+            frame[i] = (unsigned char) (i + n * 4);
+        if (write(fd, frame, size) != (ssize_t) size)
+            break;
+
+        next += period;
+        int64_t wait = next - nowNs();
+        if (wait > 0) {
+            struct timespec ts = { (time_t) (wait / 1000000000LL), (long) (wait % 1000000000LL) };
+            nanosleep(&ts, NULL);
+        }
+    }
+
+    free(frame);
+    close(fd);
+    return NULL;
+}
+
+static bool parseFormat(const char *name, int *format)
+{
+    if (!strcmp(name, "yuyv"))
+        *format = V4L2_PIX_FMT_YUYV;
+    else if (!strcmp(name, "nv12"))
+        *format = V4L2_PIX_FMT_NV12;
+    else if (!strcmp(name, "mjpeg"))
+        *format = V4L2_PIX_FMT_MJPEG;
+    else
+        return false;
+    return true;
+}
+
+static void usage(const char *prog)
+{
+    fprintf(stderr,
+            "usage: %s [-d node] [-s WxH] [-n frames] [-p fps]\n"
+            "       %s -F file [-f format] [-r fps] [-j us] [-D percent] [-S seed]\n"
+            "  -d  capture node (default: first vivid or v4l2loopback node)\n"
+            "  -s  frame size (default 640x480)\n"
+            "  -n  frames to measure after a 10 frame warm-up (default 300)\n"
+            "  -p  feed a v4l2loopback node with a test pattern at this rate\n"
+            "  -F  replay this file with FakeCamera instead of a video node\n"
+            "  -f  file format: yuyv (default), nv12 or mjpeg\n"
+            "  -r  replay rate in fps, 0 for as fast as possible (default 30)\n"
+            "  -j  replay jitter, +/- microseconds\n"
+            "  -D  percentage of frames to drop, 0 to 99\n"
+            "  -S  seed for jitter and drops\n"
+            "  -N  temporal denoise before conversion: low or high\n"
+            "  -J  JPEG encode every frame: on a mem2mem node, auto or sw\n"
+            "  -M  display conversion on a mem2mem node, or auto\n"
+            "  -T  emit trace_marker slices (record with perfetto or trace-cmd)\n"
+            "  -v  also print the dump() statistics block\n", prog, prog);
+}
+
+}; // anonymous namespace
+
+int main(int argc, char **argv)
+{
+    char node[32] = "";
+    int width = 640, height = 480;
+    int frames = 300;
+    int producerFps = 0;
+    const char *fakeFile = NULL;
+    int format = V4L2_PIX_FMT_YUYV;
+    int fakeFps = 30, fakeJitter = 0, fakeDrop = 0;
+    unsigned int fakeSeed = 1;
+    const int warmup = 10;
+    bool dumpStats = false;
+    TemporalDenoise::Level denoiseLevel = TemporalDenoise::LEVEL_OFF;
+    const char *jpegMode = NULL;
+    const char *m2mNode = NULL;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "d:s:n:p:F:f:r:j:D:S:N:J:M:Tvh")) != -1) {
+        switch (opt) {
+        case 'd': snprintf(node, sizeof(node), "%s", optarg); break;
+        case 's':
+            if (sscanf(optarg, "%dx%d", &width, &height) != 2) {
+                usage(argv[0]);
+                return 1;
+            }
+            break;
+        case 'n': frames = atoi(optarg); break;
+        case 'p': producerFps = atoi(optarg); break;
+        case 'F': fakeFile = optarg; break;
+        case 'f':
+            if (!parseFormat(optarg, &format)) {
+                usage(argv[0]);
+                return 1;
+            }
+            break;
+        case 'r': fakeFps = atoi(optarg); break;
+        case 'j': fakeJitter = atoi(optarg); break;
+        case 'D':
+            fakeDrop = atoi(optarg);
+            if (fakeDrop < 0 || fakeDrop > 99) {
+                usage(argv[0]);
+                return 1;
+            }
+            break;
+        case 'S': fakeSeed = strtoul(optarg, NULL, 0); break;
+        case 'N': denoiseLevel = TemporalDenoise::levelFromName(optarg); break;
+        case 'J': jpegMode = optarg; break;
+        case 'M': m2mNode = optarg; break;
+        case 'T': CameraTrace::setEnabled(true); break;
+        case 'v': dumpStats = true; break;
+        default:
+            usage(argv[0]);
+            return opt == 'h' ? 0 : 1;
+        }
+    }
+
+    if (fakeFile) {
+        snprintf(node, sizeof(node), "%s", fakeFile);
+    } else if (!node[0] && !findTestNode(node, sizeof(node))) {
+        fprintf(stderr, "no vivid or v4l2loopback node found; try 'modprobe vivid' or pass -d\n");
+        return 1;
+    }
+
+    Producer producer;
+    memset(&producer, 0, sizeof(producer));
+    if (producerFps > 0) {
+        producer.node = node;
+        producer.width = width;
+        producer.height = height;
+        producer.fps = producerFps;
+        pthread_create(&producer.thread, NULL, Producer::run, &producer);
+        /* v4l2loopback only exposes capture once a producer set the format */
+        struct timespec ts = { 0, 200000000 };
+        nanosleep(&ts, NULL);
+    }
+
+    CameraStats stats;
+    V4L2Camera v4l2;
+    FakeCamera fake;
+    CaptureDevice &camera = fakeFile ? (CaptureDevice &) fake : (CaptureDevice &) v4l2;
+
+    fake.SetFrameRate(fakeFps);
+    fake.SetJitter(fakeJitter);
+    fake.SetDropRate(fakeDrop);
+    fake.SetSeed(fakeSeed);
+
+    stats.previewStart.start();
+    v4l2.SetTimeline(&stats.previewStart);
+    int64_t tOpen = nowNs();
+    if (camera.Open(node, width, height, format) < 0) {
+        fprintf(stderr, "cannot open %s at %dx%d\n", node, width, height);
+        return 1;
+    }
+    if (camera.Init() < 0 || camera.StartStreaming() < 0) {
+        fprintf(stderr, "cannot start streaming on %s\n", node);
+        camera.Close();
+        return 1;
+    }
+    int64_t tStreaming = nowNs();
+
+    PixelFormat captureFormat = pixelFormatFromFourcc(camera.GetPixelFormat());
+
+    TemporalDenoise denoise;
+    if (!denoise.configure(captureFormat, width, height, denoiseLevel))
+        fprintf(stderr, "no temporal denoise for this format\n");
+
+    /* convert whatever the driver negotiated, as PreviewWriter does */
+    const PixelFormat outs[2] = { PIX_FMT_RGB565, PIX_FMT_NV21 };
+    ConvertPlan displayPlan, callbackPlan;
+    if (!displayPlan.build(captureFormat, outs, 1, COLOR_BT601, RANGE_LIMITED, width, height) ||
+        !callbackPlan.build(captureFormat, outs + 1, 1, COLOR_BT601, RANGE_LIMITED, width, height))
+        fprintf(stderr, "no software conversion from the negotiated format\n");
+
+    unsigned char *display = (unsigned char *) alignedAlloc((size_t) width * height * 2);
+    unsigned char *callback = (unsigned char *) alignedAlloc((size_t) width * height * 3 / 2);
+
+    JpegEncoder jpegEncoder;
+    std::vector<unsigned char> jpeg;
+    int jpegHardware = 0, jpegFailed = 0;
+    if (jpegMode) {
+        if (strcmp(jpegMode, "sw"))
+            jpegEncoder.useHardware(strcmp(jpegMode, "auto") ? jpegMode : NULL);
+        jpeg.resize((size_t) width * height * 2);
+    }
+
+    M2MConverter converter;
+    int m2mFrames = 0;
+    if (m2mNode)
+        converter.enable(strcmp(m2mNode, "auto") ? m2mNode : NULL);
+
+    std::vector<double> stage[STAGE_COUNT];
+    std::vector<double> latency;
+    double stageTotal[STAGE_COUNT] = { 0 };
+    unsigned int firstSeq = 0, lastSeq = 0;
+    int64_t tStart = 0, cpuStart = 0;
+    int64_t tFirstFrame = 0;
+
+    for (int i = 0; i < warmup + frames; i++) {
+        if (i == warmup) {
+            tStart = nowNs();
+            cpuStart = cpuTimeNs();
+        }
+
+        int64_t t0 = nowNs();
+        CAMERA_TRACE_BEGIN("dqbuf", i);
+        void *frame = camera.GrabPreviewFrame();
+        CAMERA_TRACE_END();
+        if (!frame) {
+            fprintf(stderr, "frame %d: dequeue failed\n", i);
+            break;
+        }
+        int64_t t1 = nowNs();
+        if (!tFirstFrame)
+            tFirstFrame = t1;
+        int64_t captured = camera.GetFrameTimestamp();
+        unsigned int seq = camera.GetFrameSequence();
+
+        CAMERA_TRACE_COUNTER("camera.v4l2Sequence", seq);
+
+        unsigned char *src = (unsigned char *) frame;
+        if (denoise.enabled()) {
+            CAMERA_TRACE_BEGIN("denoise", i);
+            src = denoise.process(src);
+            CAMERA_TRACE_END();
+            if (i >= warmup)
+                stats.denoise.add(denoise.lastUs());
+        }
+
+        CAMERA_TRACE_BEGIN("convert rgb565", i);
+        if (converter.convert(src, src == frame ? camera.GetFrameFd() : -1, captureFormat,
+                              width, height, display, (size_t) width * height * 2,
+                              PIX_FMT_RGB565, width, height))
+            m2mFrames += i >= warmup;
+        else if (displayPlan.valid())
+            displayPlan.run(src, &display, 0);
+        CAMERA_TRACE_END();
+        int64_t t2 = nowNs();
+        CAMERA_TRACE_BEGIN("convert yuv420sp", i);
+        if (callbackPlan.valid())
+            callbackPlan.run(src, &callback, 0);
+        CAMERA_TRACE_END();
+        int64_t t3 = nowNs();
+        int64_t tq = t3;
+        if (jpegMode && i >= warmup) {
+            /* the frame as captured, so the encoder can import it */
+            CAMERA_TRACE_BEGIN("jpeg", i);
+            int size = jpegEncoder.encode((unsigned char *) frame, camera.GetFrameFd(),
+                                          captureFormat, width, height, 90, &jpeg[0], jpeg.size());
+            CAMERA_TRACE_END();
+            int64_t tj = nowNs();
+            if (size > 0) {
+                stats.jpegEncode.add((tj - t3) / 1000);
+                stats.jpegSize.add(size);
+                jpegHardware += jpegEncoder.lastWasHardware();
+            } else {
+                jpegFailed++;
+            }
+            tq = tj;
+        }
+        CAMERA_TRACE_BEGIN("qbuf", i);
+        camera.ReleasePreviewFrame();
+        CAMERA_TRACE_END();
+        int64_t t4 = nowNs();
+
+        if (i < warmup)
+            continue;
+
+        stats.frameCaptured(seq);
+        stats.dqbufWait.add((t1 - t0) / 1000);
+        stats.conversion.add((t3 - t1) / 1000);
+        stats.frameDisplayed();
+        stats.frameDelivered();
+        if (i == warmup)
+            firstSeq = seq;
+        lastSeq = seq;
+
+        double d[STAGE_COUNT] = { (t1 - t0) / 1e6, (t2 - t1) / 1e6, (t3 - t2) / 1e6, (t4 - tq) / 1e6 };
+        for (int s = 0; s < STAGE_COUNT; s++) {
+            stage[s].push_back(d[s]);
+            stageTotal[s] += d[s];
+        }
+        if (captured)
+            latency.push_back((t4 - captured) / 1e6);
+    }
+
+    int64_t wall = nowNs() - tStart;
+    int64_t cpu = cpuTimeNs() - cpuStart;
+    int measured = (int) stage[STAGE_DQBUF].size();
+
+    camera.Uninit();
+    camera.StopStreaming();
+    camera.Close();
+
+    if (producerFps > 0) {
+        producer.stop = true;
+        pthread_join(producer.thread, NULL);
+    }
+
+    free(display);
+    free(callback);
+
+    if (measured == 0) {
+        fprintf(stderr, "no frames captured\n");
+        return 1;
+    }
+
+    char driver[32] = "fake";
+    if (!fakeFile)
+        queryDriver(node, driver, sizeof(driver));
+
+    printf("device      %s (%s) %dx%d %.4s\n", node, driver, width, height, (const char *) &format);
+    printf("startup     open->streamon %.1f ms, streamon->first frame %.1f ms\n",
+           (tStreaming - tOpen) / 1e6, (tFirstFrame - tStreaming) / 1e6);
+    printf("frames      %d measured, %u dropped by driver\n",
+           measured, lastSeq - firstSeq + 1 - measured);
+    printf("throughput  %.2f fps\n", measured / (wall / 1e9));
+    printf("cpu         %.1f%% of one core, %.2f ms per frame\n",
+           100.0 * cpu / wall, cpu / 1e6 / measured);
+    if (!latency.empty())
+        printf("latency     capture->qbuf p50 %.2f ms  p99 %.2f ms\n",
+               percentile(latency, 50), percentile(latency, 99));
+    else
+        printf("latency     n/a (driver timestamps are not CLOCK_MONOTONIC)\n");
+
+    if (m2mNode)
+        printf("m2m         %d of %d frames converted on %s\n", m2mFrames, measured,
+               converter.node()[0] ? converter.node() : "no device");
+    if (jpegMode)
+        printf("jpeg        %d of %d frames on the hardware encoder, %d failed\n",
+               jpegHardware, measured, jpegFailed);
+
+    printf("\n%-12s %10s %10s %10s %10s\n", "stage", "mean ms", "p50 ms", "p99 ms", "max ms");
+    for (int s = 0; s < STAGE_COUNT; s++)
+        printf("%-12s %10.3f %10.3f %10.3f %10.3f\n", kStageNames[s],
+               stageTotal[s] / measured, percentile(stage[s], 50),
+               percentile(stage[s], 99), percentile(stage[s], 100));
+
+    if (dumpStats) {
+        printf("\n");
+        fflush(stdout);
+        stats.dump(1);
+    }
+
+    return 0;
+}
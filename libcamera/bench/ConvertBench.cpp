@@ -0,0 +1,892 @@
+/*
+ *      This program is free software; you can redistribute it and/or modify
+ *      it under the terms of the GNU General Public License as published by
+ *      the Free Software Foundation; either version 2 of the License, or
+ *      (at your option) any later version.
+ *
+ * Colour conversion micro-benchmark. Runs every kernel variant built into
+ * the core over the usual preview/picture sizes, checks the output against
+ * a straightforward reference and reports Mpixel/s, cycles/pixel and
+ * bytes/cycle (the last two need perf cycle counters).
+ *
+ *   convert_bench [-k kernel] [-v variant] [-r WxH] [-t seconds] [-c]
+ */
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "BenchUtil.h"
+#include "ConvertGraph.h"
+#include "Stabilizer.h"
+#include "WorkerPool.h"
+#include "convert.h"
+
+using namespace android;
+using namespace bench;
+
+namespace {
+
+enum OutFormat {
+    OUT_RGB565,
+    OUT_RGB888,
+    OUT_YUV420SP,
+    OUT_RGB565_YUV420SP,    /* both, RGB565 first: the preview + callback pair */
+    OUT_YUYV,
+    OUT_RAW8,
+    OUT_RAW16,
+};
+
+typedef void (*convert_fn)(unsigned char *in, unsigned char *out, int width, int height);
+
+static void rgb565Tiled(unsigned char *in, unsigned char *out, int width, int height)
+{
+    convertYUYVtoRGB565_tiled(in, out, width, height, 0);
+}
+
+static void rgb565TiledNT(unsigned char *in, unsigned char *out, int width, int height)
+{
+    convertYUYVtoRGB565_tiled(in, out, width, height, CONVERT_DST_UNCACHED);
+}
+
+static void yuv420spTiled(unsigned char *in, unsigned char *out, int width, int height)
+{
+    yuyv422_to_yuv420sp_tiled(in, out, width, height, 0);
+}
+
+static void yuv420spTiledNT(unsigned char *in, unsigned char *out, int width, int height)
+{
+    yuyv422_to_yuv420sp_tiled(in, out, width, height, CONVERT_DST_UNCACHED);
+}
+
+static void previewPairC(unsigned char *in, unsigned char *out, int width, int height)
+{
+    convertYUYVtoRGB565(in, out, width, height);
+    yuyv422_to_yuv420sp(in, out + width * height * 2, width, height);
+}
+
+static void previewPairTiled(unsigned char *in, unsigned char *out, int width, int height)
+{
+    convertYUYV_tiled(in, out, out + width * height * 2, width, height, 0);
+}
+
+static void previewPairTiledNT(unsigned char *in, unsigned char *out, int width, int height)
+{
+    convertYUYV_tiled(in, out, out + width * height * 2, width, height, CONVERT_DST_UNCACHED);
+}
+
+static void rgb565Template(unsigned char *in, unsigned char *out, int width, int height)
+{
+    findConvertKernel(PIX_FMT_YUYV, PIX_FMT_RGB565, COLOR_BT601, RANGE_LIMITED)(in, out, width, height);
+}
+
+static void rgb888Template(unsigned char *in, unsigned char *out, int width, int height)
+{
+    findConvertKernel(PIX_FMT_YUYV, PIX_FMT_RGB888, COLOR_BT601, RANGE_FULL)(in, out, width, height);
+}
+
+static void yuv420spTemplate(unsigned char *in, unsigned char *out, int width, int height)
+{
+    findConvertKernel(PIX_FMT_YUYV, PIX_FMT_NV21, COLOR_BT601, RANGE_LIMITED)(in, out, width, height);
+}
+
+static void previewPairGraph(unsigned char *in, unsigned char *out, int width, int height)
+{
+    static const PixelFormat outs[] = { PIX_FMT_RGB565, PIX_FMT_NV21 };
+    static ConvertPlan plan;
+    static int planWidth, planHeight;
+    unsigned char *dst[] = { out, out + width * height * 2 };
+
+    if (width != planWidth || height != planHeight) {
+        plan.build(PIX_FMT_YUYV, outs, 2, COLOR_BT601, RANGE_LIMITED, width, height);
+        planWidth = width;
+        planHeight = height;
+    }
+    plan.run(in, dst, 0);
+}
+
+/* Other packed 4:2:2 orders; the input is reordered from the YUYV test frame */
+#define PACKED422_WRAPPERS(NAME, ORDER, FORMAT) \
+static void NAME##RGB565Tiled(unsigned char *in, unsigned char *out, int width, int height) \
+{ \
+    convertPacked422_tiled(in, ORDER, out, NULL, width, height, 0); \
+} \
+static void NAME##YUV420SPTiled(unsigned char *in, unsigned char *out, int width, int height) \
+{ \
+    convertPacked422_tiled(in, ORDER, NULL, out, width, height, 0); \
+} \
+static void NAME##RGB565Template(unsigned char *in, unsigned char *out, int width, int height) \
+{ \
+    findConvertKernel(FORMAT, PIX_FMT_RGB565, COLOR_BT601, RANGE_LIMITED)(in, out, width, height); \
+}
+
+PACKED422_WRAPPERS(uyvy, PACKED422_UYVY, PIX_FMT_UYVY)
+PACKED422_WRAPPERS(yvyu, PACKED422_YVYU, PIX_FMT_YVYU)
+PACKED422_WRAPPERS(vyuy, PACKED422_VYUY, PIX_FMT_VYUY)
+
+/* Bayer input is the test frame taken as raw samples; the SIMD demosaic
+ * and unpackers must match the C ones exactly */
+#define BAYER_WRAPPERS(NAME, BITS, PACKING, PATTERN) \
+static const struct raw_format NAME##Format = { BITS, PACKING, PATTERN, 0, 256 }; \
+static void NAME##C(unsigned char *in, unsigned char *out, int width, int height) \
+{ \
+    bayer_to_yuyv_c(in, &NAME##Format, out, width, height, DEMOSAIC_EDGE_AWARE); \
+} \
+static void NAME##Simd(unsigned char *in, unsigned char *out, int width, int height) \
+{ \
+    bayer_to_yuyv(in, &NAME##Format, out, width, height, DEMOSAIC_EDGE_AWARE); \
+}
+
+BAYER_WRAPPERS(sbggr8, 8, RAW_UNPACKED, BAYER_BGGR)
+BAYER_WRAPPERS(sbggr10, 10, RAW_UNPACKED, BAYER_BGGR)
+BAYER_WRAPPERS(sgrbg10, 10, RAW_UNPACKED, BAYER_GRBG)
+BAYER_WRAPPERS(sbggr10p, 10, RAW_MIPI, BAYER_BGGR)
+BAYER_WRAPPERS(sbggr12p, 12, RAW_MIPI, BAYER_BGGR)
+
+static void sbggr8Bilinear(unsigned char *in, unsigned char *out, int width, int height)
+{
+    bayer_to_yuyv(in, &sbggr8Format, out, width, height, 0);
+}
+
+static void sbggr8BilinearC(unsigned char *in, unsigned char *out, int width, int height)
+{
+    bayer_to_yuyv_c(in, &sbggr8Format, out, width, height, 0);
+}
+
+/* Whole frames through the row unpackers; 8 bit output with a typical
+ * black level and 1.5x gain */
+#define UNPACK_WRAPPERS(NAME, BITS, BLACK) \
+static const struct raw_format NAME##Raw = { BITS, RAW_MIPI, BAYER_BGGR, BLACK, 384 }; \
+static void NAME##To16(unsigned char *in, unsigned char *out, int width, int height) \
+{ \
+    for (int y = 0; y < height; y++) \
+        raw_unpack_row16(in + y * raw_row_bytes(&NAME##Raw, width), &NAME##Raw, \
+                         (unsigned short *) out + y * width, width); \
+} \
+static void NAME##To8(unsigned char *in, unsigned char *out, int width, int height) \
+{ \
+    for (int y = 0; y < height; y++) \
+        raw_unpack_row8(in + y * raw_row_bytes(&NAME##Raw, width), &NAME##Raw, out + y * width, width); \
+} \
+static void NAME##To8C(unsigned char *in, unsigned char *out, int width, int height) \
+{ \
+    for (int y = 0; y < height; y++) \
+        raw_unpack_row8_c(in + y * raw_row_bytes(&NAME##Raw, width), &NAME##Raw, out + y * width, width); \
+}
+
+UNPACK_WRAPPERS(mipi10, 10, 64)
+UNPACK_WRAPPERS(mipi12, 12, 256)
+
+/* Bit by bit from the CSI-2 layout */
+static void refMipi10(unsigned char *in, unsigned char *out, int width, int height)
+{
+    unsigned short *dst = (unsigned short *) out;
+
+    for (int i = 0; i < width * height; i++) {
+        const unsigned char *group = in + i / 4 * 5;
+        dst[i] = (group[i % 4] << 2) | ((group[4] >> (2 * (i % 4))) & 3);
+    }
+}
+
+static void refMipi12(unsigned char *in, unsigned char *out, int width, int height)
+{
+    unsigned short *dst = (unsigned short *) out;
+
+    for (int i = 0; i < width * height; i++) {
+        const unsigned char *group = in + i / 2 * 3;
+        dst[i] = (group[i % 2] << 4) | ((group[2] >> (4 * (i % 2))) & 0xf);
+    }
+}
+
+/* A three frame bracket around the test frame: luma halved, as is, doubled */
+static const unsigned char *const *bracketOf(const unsigned char *in, int width, int height)
+{
+    static std::vector<unsigned char> under, over;
+    static const unsigned char *frames[3];
+    static const unsigned char *source;
+    size_t size = (size_t) width * height * 2;
+
+    if (source != in || under.size() != size) {
+        under.assign(in, in + size);
+        over.assign(in, in + size);
+        for (size_t i = 0; i < size; i += 2) {
+            under[i] = in[i] / 2;
+            over[i] = std::min(in[i] * 2, 255);
+        }
+        frames[0] = &under[0];
+        frames[1] = in;
+        frames[2] = &over[0];
+        source = in;
+    }
+    return frames;
+}
+
+static void fuse3C(unsigned char *in, unsigned char *out, int width, int height)
+{
+    exposure_fuse_yuyv_c(bracketOf(in, width, height), 3, out, width, height);
+}
+
+static void fuse3Simd(unsigned char *in, unsigned char *out, int width, int height)
+{
+    exposure_fuse_yuyv(bracketOf(in, width, height), 3, out, width, height);
+}
+
+struct FuseStripes {
+    const unsigned char *const *src;
+    unsigned char *dst;
+    int width;
+    int height;
+};
+
+static void fuseStripe(void *arg, int part, int parts)
+{
+    const FuseStripes *job = (const FuseStripes *) arg;
+    int y0 = job->height * part / parts;
+    int y1 = job->height * (part + 1) / parts;
+    size_t offset = (size_t) y0 * job->width * 2;
+    const unsigned char *src[3];
+
+    for (int i = 0; i < 3; i++)
+        src[i] = job->src[i] + offset;
+    exposure_fuse_yuyv(src, 3, job->dst + offset, job->width, y1 - y0);
+}
+
+static void fuse3Pool(unsigned char *in, unsigned char *out, int width, int height)
+{
+    static WorkerPool pool;
+    FuseStripes job = { bracketOf(in, width, height), out, width, height };
+
+    pool.start(0);
+    pool.run(fuseStripe, &job, std::min(pool.size() * 4, height));
+}
+
+/* Temporal denoise of the test frame against a previous frame that is
+ * mostly the same plus noise, with a moving band; out starts as that
+ * previous frame (the copy is part of the timing) and ends as the update */
+static const unsigned char *previousOf(const unsigned char *in, int width, int height)
+{
+    static std::vector<unsigned char> previous;
+    static const unsigned char *source;
+    size_t size = (size_t) width * height * 2;
+
+    if (source != in || previous.size() != size) {
+        unsigned int seed = 7;
+
+        previous.assign(in, in + size);
+        for (size_t i = 0; i < size; i++) {
+            seed = seed * 1103515245 + 12345;
+            int noise = (int) ((seed >> 16) & 7) - 4;
+            if (i / (width * 2) % 64 < 8)
+                noise *= 16;
+            previous[i] = std::min(std::max(in[i] + noise, 0), 255);
+        }
+        source = in;
+    }
+    return &previous[0];
+}
+
+static const struct tnr_strength kTnrHigh = { 96, 112, 6 };
+
+static void tnrYUYVC(unsigned char *in, unsigned char *out, int width, int height)
+{
+    memcpy(out, previousOf(in, width, height), (size_t) width * height * 2);
+    tnr_update_c(in, out, width * height * 2, TNR_PACKED_Y_EVEN, &kTnrHigh);
+}
+
+static void tnrYUYVSimd(unsigned char *in, unsigned char *out, int width, int height)
+{
+    memcpy(out, previousOf(in, width, height), (size_t) width * height * 2);
+    tnr_update(in, out, width * height * 2, TNR_PACKED_Y_EVEN, &kTnrHigh);
+}
+
+/* Stabilized recording frame: the window at (16, 8) of the crop size,
+ * against cropping the YUYV first and converting that; the rest of out
+ * stays zero */
+static void stabWindowNV21(unsigned char *in, unsigned char *out, int width, int height)
+{
+    int cw, ch;
+
+    Stabilizer::cropSize(width, height, 8, &cw, &ch);
+    convertPacked422_window(in, PACKED422_YUYV, width, 16, 8, out, cw, ch, 0);
+}
+
+static void stabWindowRef(unsigned char *in, unsigned char *out, int width, int height)
+{
+    int cw, ch;
+
+    Stabilizer::cropSize(width, height, 8, &cw, &ch);
+    std::vector<unsigned char> crop((size_t) cw * ch * 2);
+    for (int y = 0; y < ch; y++)
+        memcpy(&crop[(size_t) y * cw * 2], in + ((size_t) (y + 8) * width + 16) * 2, cw * 2);
+    memset(out, 0, (size_t) width * height * 3 / 2);
+    yuyv422_to_yuv420sp_c(&crop[0], out, cw, ch);
+}
+
+/* Global motion of the test frame moved by (12, -8): the reduced luma of
+ * the moved frame is part of the timing, that of the original is not
+ * (the stabilizer keeps it from the frame before). out[0], out[1] get
+ * the motion in reduced pixels, offset by 128. */
+static const int kShiftX = 12, kShiftY = -8;
+
+struct MotionPair {
+    std::vector<unsigned char> moved;
+    std::vector<unsigned char> prev;
+    std::vector<unsigned char> cur;
+};
+
+static MotionPair &motionPairOf(const unsigned char *in, int width, int height)
+{
+    static MotionPair pair;
+    static const unsigned char *source;
+    size_t size = (size_t) width * height * 2;
+
+    if (source != in || pair.moved.size() != size) {
+        pair.moved.resize(size);
+        for (int y = 0; y < height; y++) {
+            int sy = std::min(std::max(y - kShiftY, 0), height - 1);
+            for (int x = 0; x < width; x += 2) {
+                int sx = std::min(std::max(x - kShiftX, 0), width - 2);
+                memcpy(&pair.moved[((size_t) y * width + x) * 2], in + ((size_t) sy * width + sx) * 2, 4);
+            }
+        }
+        pair.prev.resize((size_t) (width / 4) * (height / 4));
+        pair.cur.resize(pair.prev.size());
+        luma_downscale4(in, PACKED422_YUYV, width, height, &pair.prev[0]);
+        source = in;
+    }
+    return pair;
+}
+
+static void motionC(unsigned char *in, unsigned char *out, int width, int height)
+{
+    MotionPair &pair = motionPairOf(in, width, height);
+    int dx, dy;
+
+    luma_downscale4(&pair.moved[0], PACKED422_YUYV, width, height, &pair.cur[0]);
+    estimate_translation_c(&pair.prev[0], &pair.cur[0], width / 4, height / 4, 8, &dx, &dy);
+    out[0] = dx + 128;
+    out[1] = dy + 128;
+}
+
+static void motionSimd(unsigned char *in, unsigned char *out, int width, int height)
+{
+    MotionPair &pair = motionPairOf(in, width, height);
+    int dx, dy;
+
+    luma_downscale4(&pair.moved[0], PACKED422_YUYV, width, height, &pair.cur[0]);
+    estimate_translation(&pair.prev[0], &pair.cur[0], width / 4, height / 4, 8, &dx, &dy);
+    out[0] = dx + 128;
+    out[1] = dy + 128;
+}
+
+static void motionRef(unsigned char *in, unsigned char *out, int width, int height)
+{
+    memset(out, 0, (size_t) width * height);
+    out[0] = kShiftX / 4 + 128;
+    out[1] = kShiftY / 4 + 128;
+}
+
+/* Callback stream frames a quarter of the size each way, against box
+ * averages computed separately; the rest of out stays zero */
+#define DOWNSCALE_KERNEL(NAME, FORMAT) \
+static void NAME(unsigned char *in, unsigned char *out, int width, int height) \
+{ \
+    packed422_downscale(in, PACKED422_YUYV, width, height, out, width / 4, height / 4, FORMAT); \
+}
+
+DOWNSCALE_KERNEL(downscaleGrey, DOWNSCALE_GREY)
+DOWNSCALE_KERNEL(downscaleNV21, DOWNSCALE_NV21)
+DOWNSCALE_KERNEL(downscaleRGB888, DOWNSCALE_RGB888)
+
+/* Average of sample (0 Y, 1 U, 3 V of the pixel's pair) over the size x
+ * size box at (x, y) */
+static int boxAverage(const unsigned char *in, int width, int x, int y, int size, int sample)
+{
+    int sum = 0;
+
+    for (int j = 0; j < size; j++) {
+        for (int i = 0; i < size; i++) {
+            const unsigned char *p = in + ((size_t) (y + j) * width + x + i) * 2;
+            sum += sample ? (p - ((x + i) & 1) * 2)[sample] : p[0];
+        }
+    }
+    return (sum + size * size / 2) / (size * size);
+}
+
+static void refDownscale(unsigned char *in, unsigned char *out, int width, int height, int format)
+{
+    int w = width / 4, h = height / 4;
+
+    memset(out, 0, downscale_frame_size(format, width, height));
+    for (int y = 0; y < h; y++) {
+        for (int x = 0; x < w; x++) {
+            int l = boxAverage(in, width, x * 4, y * 4, 4, 0);
+
+            if (format != DOWNSCALE_RGB888) {
+                out[y * w + x] = l;
+                continue;
+            }
+            double u = boxAverage(in, width, x * 4, y * 4, 4, 1) - 128;
+            double v = boxAverage(in, width, x * 4, y * 4, 4, 3) - 128;
+            unsigned char *d = out + (y * w + x) * 3;
+            d[0] = std::min(std::max((int) floor(1.164 * (l - 16) + 1.596 * v), 0), 255);
+            d[1] = std::min(std::max((int) floor(1.164 * (l - 16) - 0.391 * u - 0.813 * v), 0), 255);
+            d[2] = std::min(std::max((int) floor(1.164 * (l - 16) + 2.018 * u), 0), 255);
+        }
+    }
+    if (format == DOWNSCALE_NV21) {
+        unsigned char *vu = out + w * h;
+        for (int y = 0; y < h / 2; y++) {
+            for (int x = 0; x < w / 2; x++) {
+                vu[y * w + x * 2] = boxAverage(in, width, x * 8, y * 8, 8, 3);
+                vu[y * w + x * 2 + 1] = boxAverage(in, width, x * 8, y * 8, 8, 1);
+            }
+        }
+    }
+}
+
+static void downscaleGreyRef(unsigned char *in, unsigned char *out, int width, int height)
+{
+    refDownscale(in, out, width, height, DOWNSCALE_GREY);
+}
+
+static void downscaleNV21Ref(unsigned char *in, unsigned char *out, int width, int height)
+{
+    refDownscale(in, out, width, height, DOWNSCALE_NV21);
+}
+
+static void downscaleRGB888Ref(unsigned char *in, unsigned char *out, int width, int height)
+{
+    refDownscale(in, out, width, height, DOWNSCALE_RGB888);
+}
+
+/* Model input: the centre square of the frame at half its side, the
+ * ImageNet normalization for floats. NV12 sources are converted from the
+ * test frame once, outside the timing. */
+static void tensorParams(struct tensor_params *p, int width, int height, int type)
+{
+    static const float mean[3] = { 123.675f, 116.28f, 103.53f };
+    static const float std[3] = { 58.395f, 57.12f, 57.375f };
+
+    memset(p, 0, sizeof(*p));
+    p->cropX = (width - height) / 2;
+    p->cropWidth = height;
+    p->cropHeight = height;
+    p->width = height / 2;
+    p->height = height / 2;
+    p->type = type;
+    for (int c = 0; c < 3; c++) {
+        p->mean[c] = mean[c];
+        p->scale[c] = 1.0f / std[c];
+    }
+}
+
+static const unsigned char *nv12Of(const unsigned char *in, int width, int height)
+{
+    static std::vector<unsigned char> nv12;
+    static const unsigned char *source;
+
+    if (source != in || nv12.size() != (size_t) width * height * 3 / 2) {
+        nv12.resize((size_t) width * height * 3 / 2);
+        yuyv422_to_yuv420sp_tiled((unsigned char *) in, &nv12[0], width, height, CONVERT_NV12);
+        source = in;
+    }
+    return &nv12[0];
+}
+
+#define TENSOR_KERNEL(NAME, TYPE, NV12, FN) \
+static void NAME(unsigned char *in, unsigned char *out, int width, int height) \
+{ \
+    struct tensor_params p; \
+    tensorParams(&p, width, height, TYPE); \
+    memset(out, 0, (size_t) width * height * 3); \
+    if (NV12) \
+        FN(nv12Of(in, width, height), TENSOR_SRC_NV12, width, height, &p, out); \
+    else \
+        FN(in, PACKED422_YUYV, width, height, &p, out); \
+}
+
+TENSOR_KERNEL(tensorU8C, TENSOR_UINT8, 0, tensor_convert_c)
+TENSOR_KERNEL(tensorU8Simd, TENSOR_UINT8, 0, tensor_convert)
+TENSOR_KERNEL(tensorF32C, TENSOR_FLOAT32, 0, tensor_convert_c)
+TENSOR_KERNEL(tensorF32Simd, TENSOR_FLOAT32, 0, tensor_convert)
+TENSOR_KERNEL(tensorNV12F32C, TENSOR_FLOAT32, 1, tensor_convert_c)
+TENSOR_KERNEL(tensorNV12F32Simd, TENSOR_FLOAT32, 1, tensor_convert)
+
+struct Kernel {
+    const char *name;
+    const char *variant;
+    convert_fn fn;
+    OutFormat out;
+    int tolerance;      /* max per channel/byte difference to the reference */
+    int order;          /* PACKED422_* byte order of the input, YUYV if omitted */
+    convert_fn ref;     /* reference for formats without a model below */
+};
+
+/* Kernels with an SSE2 body whose "simd" entry point elsewhere (ARM)
+ * runs a portable loop left to the compiler's vectoriser, listed as
+ * "vec": demosaic, denoise, tensor */
+#ifdef __SSE2__
+#define VEC "simd"
+#else
+#define VEC "vec"
+#endif
+
+static const Kernel kKernels[] = {
+    { "yuyv_to_rgb565",   "c",    convertYUYVtoRGB565,      OUT_RGB565,   0 },
+    { "yuyv_to_rgb888",   "c",    convertYUYVtoRGB888,      OUT_RGB888,   0 },
+    { "yuyv_to_yuv420sp", "c",    yuyv422_to_yuv420sp_c,    OUT_YUV420SP, 0 },
+#ifdef HAVE_NEON_CONVERT
+    { "yuyv_to_yuv420sp", "neon", yuyv422_to_yuv420sp_neon, OUT_YUV420SP, 0 },
+#endif
+    { "yuyv_to_rgb565",   "tiled",    rgb565Tiled,        OUT_RGB565,   1 },
+    { "yuyv_to_rgb565",   "tiled-nt", rgb565TiledNT,      OUT_RGB565,   1 },
+    { "yuyv_to_yuv420sp", "tiled",    yuv420spTiled,      OUT_YUV420SP, 0 },
+    { "yuyv_to_yuv420sp", "tiled-nt", yuv420spTiledNT,    OUT_YUV420SP, 0 },
+    { "preview_pair",     "c",        previewPairC,       OUT_RGB565_YUV420SP, 0 },
+    { "preview_pair",     "tiled",    previewPairTiled,   OUT_RGB565_YUV420SP, 1 },
+    { "preview_pair",     "tiled-nt", previewPairTiledNT, OUT_RGB565_YUV420SP, 1 },
+    { "yuyv_to_rgb565",   "template", rgb565Template,     OUT_RGB565,   1 },
+    { "yuyv_to_rgb888",   "template", rgb888Template,     OUT_RGB888,   1 },
+    { "yuyv_to_yuv420sp", "template", yuv420spTemplate,   OUT_YUV420SP, 0 },
+    { "preview_pair",     "graph",    previewPairGraph,   OUT_RGB565_YUV420SP, 1 },
+    { "uyvy_to_rgb565",   "tiled",    uyvyRGB565Tiled,    OUT_RGB565,   1, PACKED422_UYVY },
+    { "uyvy_to_rgb565",   "template", uyvyRGB565Template, OUT_RGB565,   1, PACKED422_UYVY },
+    { "uyvy_to_yuv420sp", "tiled",    uyvyYUV420SPTiled,  OUT_YUV420SP, 0, PACKED422_UYVY },
+    { "yvyu_to_rgb565",   "tiled",    yvyuRGB565Tiled,    OUT_RGB565,   1, PACKED422_YVYU },
+    { "yvyu_to_rgb565",   "template", yvyuRGB565Template, OUT_RGB565,   1, PACKED422_YVYU },
+    { "yvyu_to_yuv420sp", "tiled",    yvyuYUV420SPTiled,  OUT_YUV420SP, 0, PACKED422_YVYU },
+    { "vyuy_to_rgb565",   "tiled",    vyuyRGB565Tiled,    OUT_RGB565,   1, PACKED422_VYUY },
+    { "vyuy_to_rgb565",   "template", vyuyRGB565Template, OUT_RGB565,   1, PACKED422_VYUY },
+    { "vyuy_to_yuv420sp", "tiled",    vyuyYUV420SPTiled,  OUT_YUV420SP, 0, PACKED422_VYUY },
+    { "sbggr8_to_yuyv",   "c",        sbggr8C,            OUT_YUYV,     0, 0, sbggr8C },
+    { "sbggr8_to_yuyv",   VEC,        sbggr8Simd,         OUT_YUYV,     0, 0, sbggr8C },
+    { "sbggr8_to_yuyv",   "bilinear", sbggr8Bilinear,     OUT_YUYV,     0, 0, sbggr8BilinearC },
+    { "sbggr10_to_yuyv",  "c",        sbggr10C,           OUT_YUYV,     0, 0, sbggr10C },
+    { "sbggr10_to_yuyv",  VEC,        sbggr10Simd,        OUT_YUYV,     0, 0, sbggr10C },
+    { "sgrbg10_to_yuyv",  VEC,        sgrbg10Simd,        OUT_YUYV,     0, 0, sgrbg10C },
+    { "sbggr10p_to_yuyv", "c",        sbggr10pC,          OUT_YUYV,     0, 0, sbggr10pC },
+    { "sbggr10p_to_yuyv", VEC,        sbggr10pSimd,       OUT_YUYV,     0, 0, sbggr10pC },
+    { "sbggr12p_to_yuyv", VEC,        sbggr12pSimd,       OUT_YUYV,     0, 0, sbggr12pC },
+    { "mipi10_to_raw16",  "swar",     mipi10To16,         OUT_RAW16,    0, 0, refMipi10 },
+    { "mipi12_to_raw16",  "swar",     mipi12To16,         OUT_RAW16,    0, 0, refMipi12 },
+    { "mipi10_to_raw8",   "c",        mipi10To8C,         OUT_RAW8,     0, 0, mipi10To8C },
+    { "mipi10_to_raw8",   "simd",     mipi10To8,          OUT_RAW8,     0, 0, mipi10To8C },
+    { "mipi12_to_raw8",   "simd",     mipi12To8,          OUT_RAW8,     0, 0, mipi12To8C },
+    { "tnr_yuyv",         "c",        tnrYUYVC,           OUT_YUYV,     0, 0, tnrYUYVC },
+    { "tnr_yuyv",         VEC,        tnrYUYVSimd,        OUT_YUYV,     0, 0, tnrYUYVC },
+    { "fuse3_yuyv",       "c",        fuse3C,             OUT_YUYV,     0, 0, fuse3C },
+    { "fuse3_yuyv",       "simd",     fuse3Simd,          OUT_YUYV,     0, 0, fuse3C },
+    { "fuse3_yuyv",       "pool",     fuse3Pool,          OUT_YUYV,     0, 0, fuse3C },
+    { "stab_window_nv21", "tiled",    stabWindowNV21,     OUT_YUV420SP, 0, 0, stabWindowRef },
+    { "motion_estimate",  "c",        motionC,            OUT_RAW8,     0, 0, motionRef },
+    { "motion_estimate",  "simd",     motionSimd,         OUT_RAW8,     0, 0, motionRef },
+    { "downscale4_grey",  "c",        downscaleGrey,      OUT_RAW8,     0, 0, downscaleGreyRef },
+    { "downscale4_nv21",  "c",        downscaleNV21,      OUT_YUV420SP, 0, 0, downscaleNV21Ref },
+    { "downscale4_rgb888", "c",       downscaleRGB888,    OUT_RGB888,   1, 0, downscaleRGB888Ref },
+    { "tensor_yuyv_u8",   "c",        tensorU8C,          OUT_RGB888,   0, 0, tensorU8C },
+    { "tensor_yuyv_u8",   VEC,        tensorU8Simd,       OUT_RGB888,   0, 0, tensorU8C },
+    { "tensor_yuyv_f32",  "c",        tensorF32C,         OUT_RGB888,   0, 0, tensorF32C },
+    { "tensor_yuyv_f32",  VEC,        tensorF32Simd,      OUT_RGB888,   0, 0, tensorF32C },
+    { "tensor_nv12_f32",  "c",        tensorNV12F32C,     OUT_RGB888,   0, 0, tensorNV12F32C },
+    { "tensor_nv12_f32",  VEC,        tensorNV12F32Simd,  OUT_RGB888,   0, 0, tensorNV12F32C },
+};
+
+struct Resolution {
+    const char *name;
+    int width;
+    int height;
+};
+
+static const Resolution kResolutions[] = {
+    { "QVGA",  320,  240 },
+    { "VGA",   640,  480 },
+    { "720p",  1280, 720 },
+    { "1080p", 1920, 1080 },
+    { "4K",    3840, 2160 },
+};
+
+static size_t outSize(OutFormat fmt, int width, int height)
+{
+    switch (fmt) {
+    case OUT_RGB565:   return (size_t) width * height * 2;
+    case OUT_RGB888:   return (size_t) width * height * 3;
+    case OUT_YUV420SP: return (size_t) width * height * 3 / 2;
+    case OUT_RGB565_YUV420SP: return (size_t) width * height * 7 / 2;
+    case OUT_YUYV:     return (size_t) width * height * 2;
+    case OUT_RAW8:     return (size_t) width * height;
+    case OUT_RAW16:    return (size_t) width * height * 2;
+    }
+    return 0;
+}
+
+static inline int clamp255(int v)
+{
+    return v > 255 ? 255 : (v < 0 ? 0 : v);
+}
+
+/* The per-pixel floating point conversion the RGB565 kernel started from */
+static void refRGB565(const unsigned char *in, unsigned char *out, int width, int height)
+{
+    for (int i = 0; i < width * height; i++) {
+        int y = in[i * 2];
+        int u = in[(i & ~1) * 2 + 1];
+        int v = in[(i & ~1) * 2 + 3];
+        int r = 1.164 * (y - 16) + 1.596 * (v - 128);
+        int g = 1.164 * (y - 16) - 0.813 * (v - 128) - 0.391 * (u - 128);
+        int b = 1.164 * (y - 16) + 2.018 * (u - 128);
+        int rgb16 = ((clamp255(r) >> 3) << 11) | ((clamp255(g) >> 2) << 5) | (clamp255(b) >> 3);
+        out[i * 2] = rgb16 & 0xff;
+        out[i * 2 + 1] = rgb16 >> 8;
+    }
+}
+
+/* The integer loop that used to live in saveYUYVtoJPEG */
+static void refRGB888(const unsigned char *in, unsigned char *out, int width, int height)
+{
+    for (int i = 0; i < width * height; i++) {
+        int y = in[i * 2] << 8;
+        int u = in[(i & ~1) * 2 + 1] - 128;
+        int v = in[(i & ~1) * 2 + 3] - 128;
+        out[i * 3 + 0] = clamp255((y + (359 * v)) >> 8);
+        out[i * 3 + 1] = clamp255((y - (88 * u) - (183 * v)) >> 8);
+        out[i * 3 + 2] = clamp255((y + (454 * u)) >> 8);
+    }
+}
+
+/* NV21 with chroma of each row pair averaged (truncating), as convert.S */
+static void refYUV420SP(const unsigned char *in, unsigned char *out, int width, int height)
+{
+    unsigned char *uv = out + width * height;
+
+    for (int y = 0; y < height; y++)
+        for (int x = 0; x < width; x++)
+            out[y * width + x] = in[(y * width + x) * 2];
+
+    for (int y = 0; y < height; y += 2) {
+        const unsigned char *r0 = in + y * width * 2;
+        const unsigned char *r1 = r0 + width * 2;
+        for (int x = 0; x < width; x += 2) {
+            *uv++ = (r0[x * 2 + 3] + r1[x * 2 + 3]) >> 1;
+            *uv++ = (r0[x * 2 + 1] + r1[x * 2 + 1]) >> 1;
+        }
+    }
+}
+
+static void reference(OutFormat fmt, const unsigned char *in, unsigned char *out, int width, int height)
+{
+    switch (fmt) {
+    case OUT_RGB565:   refRGB565(in, out, width, height); break;
+    case OUT_RGB888:   refRGB888(in, out, width, height); break;
+    case OUT_YUV420SP: refYUV420SP(in, out, width, height); break;
+    case OUT_RGB565_YUV420SP:
+        refRGB565(in, out, width, height);
+        refYUV420SP(in, out + width * height * 2, width, height);
+        break;
+    case OUT_YUYV:
+    case OUT_RAW8:
+    case OUT_RAW16:
+        break;
+    }
+}
+
+/* Largest difference between two outputs, per colour channel for RGB565 */
+static int maxDiff(OutFormat fmt, const unsigned char *a, const unsigned char *b, size_t size)
+{
+    int worst = 0;
+
+    if (fmt == OUT_RGB565_YUV420SP) {
+        size_t rgbSize = size / 7 * 4;
+        return std::max(maxDiff(OUT_RGB565, a, b, rgbSize),
+                        maxDiff(OUT_YUV420SP, a + rgbSize, b + rgbSize, size - rgbSize));
+    }
+
+    if (fmt == OUT_RGB565) {
+        for (size_t i = 0; i < size; i += 2) {
+            int pa = a[i] | (a[i + 1] << 8);
+            int pb = b[i] | (b[i + 1] << 8);
+            int d0 = abs((pa >> 11) - (pb >> 11));
+            int d1 = abs(((pa >> 5) & 0x3f) - ((pb >> 5) & 0x3f));
+            int d2 = abs((pa & 0x1f) - (pb & 0x1f));
+            worst = std::max(worst, std::max(d0, std::max(d1, d2)));
+        }
+    } else {
+        for (size_t i = 0; i < size; i++)
+            worst = std::max(worst, abs(a[i] - b[i]));
+    }
+    return worst;
+}
+
+/* Smooth gradients plus noise so both clamping paths get exercised */
+static void fillYUYV(unsigned char *buf, int width, int height)
+{
+    unsigned int seed = 0x1234567;
+
+    for (int y = 0; y < height; y++) {
+        for (int x = 0; x < width * 2; x++) {
+            seed = seed * 1103515245 + 12345;
+            int noise = (seed >> 16) & 0x1f;
+            int v = (x & 1) ? ((x * 255 / (width * 2)) ^ (y & 0x80)) : (y * 255 / height);
+            buf[y * width * 2 + x] = (v + noise) & 0xff;
+        }
+    }
+}
+
+/* Copy a YUYV frame into another packed 4:2:2 byte order */
+static void reorderYUYV(const unsigned char *yuyv, unsigned char *out, int order, int width, int height)
+{
+    static const int offsets[4][4] = {
+        { 0, 1, 2, 3 }, { 1, 0, 3, 2 }, { 0, 3, 2, 1 }, { 1, 2, 3, 0 },
+    };
+    const int *o = offsets[order];
+
+    for (int i = 0; i < width * height * 2; i += 4) {
+        out[i + o[0]] = yuyv[i];
+        out[i + o[1]] = yuyv[i + 1];
+        out[i + o[2]] = yuyv[i + 2];
+        out[i + o[3]] = yuyv[i + 3];
+    }
+}
+
+static void usage(const char *prog)
+{
+    fprintf(stderr,
+            "usage: %s [-k kernel] [-v variant] [-r WxH] [-t seconds] [-c]\n"
+            "  -k  only run kernels whose name contains this string\n"
+            "  -v  only run this variant (c, neon, vec, ...)\n"
+            "  -r  run a single resolution instead of QVGA..4K\n"
+            "  -t  minimum measuring time per case (default 0.25)\n"
+            "  -c  CSV output\n"
+            "  -l  list kernels and exit\n", prog);
+}
+
+}; // anonymous namespace
+
+int main(int argc, char **argv)
+{
+    const char *kernelFilter = NULL;
+    const char *variantFilter = NULL;
+    double minSeconds = 0.25;
+    bool csv = false;
+    int customWidth = 0, customHeight = 0;
+    int opt;
+    int failures = 0;
+
+    while ((opt = getopt(argc, argv, "k:v:r:t:clh")) != -1) {
+        switch (opt) {
+        case 'k': kernelFilter = optarg; break;
+        case 'v': variantFilter = optarg; break;
+        case 'r':
+            if (sscanf(optarg, "%dx%d", &customWidth, &customHeight) != 2 ||
+                customWidth <= 0 || customHeight <= 0 || (customWidth % 16) || (customHeight % 2)) {
+                fprintf(stderr, "bad resolution %s (width multiple of 16, even height)\n", optarg);
+                return 1;
+            }
+            break;
+        case 't': minSeconds = atof(optarg); break;
+        case 'c': csv = true; break;
+        case 'l':
+            for (size_t k = 0; k < sizeof(kKernels) / sizeof(kKernels[0]); k++)
+                printf("%s %s\n", kKernels[k].name, kKernels[k].variant);
+            return 0;
+        default:
+            usage(argv[0]);
+            return opt == 'h' ? 0 : 1;
+        }
+    }
+
+    std::vector<Resolution> resolutions;
+    if (customWidth) {
+        Resolution r = { "custom", customWidth, customHeight };
+        resolutions.push_back(r);
+    } else {
+        resolutions.assign(kResolutions, kResolutions + sizeof(kResolutions) / sizeof(kResolutions[0]));
+    }
+
+    CycleCounter cycles;
+
+    if (csv)
+        printf("kernel,variant,width,height,mpix_per_s,cycles_per_pixel,bytes_per_cycle,max_diff,status\n");
+    else
+        printf("%-20s %-8s %-11s %10s %10s %10s %6s\n",
+               "kernel", "variant", "size", "Mpix/s", "cyc/pix", "B/cyc", "check");
+
+    for (size_t r = 0; r < resolutions.size(); r++) {
+        int width = resolutions[r].width;
+        int height = resolutions[r].height;
+        size_t inSize = (size_t) width * height * 2;
+
+        unsigned char *yuyv = (unsigned char *) alignedAlloc(inSize);
+        unsigned char *in = (unsigned char *) alignedAlloc(inSize);
+        fillYUYV(yuyv, width, height);
+
+        for (size_t k = 0; k < sizeof(kKernels) / sizeof(kKernels[0]); k++) {
+            const Kernel &kernel = kKernels[k];
+
+            if (kernelFilter && !strstr(kernel.name, kernelFilter))
+                continue;
+            if (variantFilter && strcmp(kernel.variant, variantFilter))
+                continue;
+
+            size_t size = outSize(kernel.out, width, height);
+            unsigned char *out = (unsigned char *) alignedAlloc(size);
+            unsigned char *ref = (unsigned char *) alignedAlloc(size);
+
+            reorderYUYV(yuyv, in, kernel.order, width, height);
+            if (kernel.ref)
+                kernel.ref(in, ref, width, height);
+            else
+                reference(kernel.out, yuyv, ref, width, height);
+            memset(out, 0, size);
+            kernel.fn(in, out, width, height);
+            int diff = maxDiff(kernel.out, out, ref, size);
+            bool ok = diff <= kernel.tolerance;
+            if (!ok)
+                failures++;
+
+            int iterations = 0;
+            uint64_t c0 = cycles.read();
+            int64_t t0 = nowNs();
+            int64_t elapsed;
+            do {
+                kernel.fn(in, out, width, height);
+                iterations++;
+                elapsed = nowNs() - t0;
+            } while (elapsed < minSeconds * 1e9 || iterations < 3);
+            uint64_t c1 = cycles.read();
+
+            double pixels = (double) width * height * iterations;
+            double mpix = pixels / (elapsed / 1e3);
+            double cpp = cycles.valid() ? (c1 - c0) / pixels : 0;
+            double bpc = cycles.valid() && c1 > c0 ?
+                         (double) (inSize + size) * iterations / (c1 - c0) : 0;
+
+            if (csv) {
+                printf("%s,%s,%d,%d,%.1f,%.3f,%.3f,%d,%s\n", kernel.name, kernel.variant,
+                       width, height, mpix, cpp, bpc, diff, ok ? "ok" : "FAIL");
+            } else {
+                char sizeStr[32];
+                snprintf(sizeStr, sizeof(sizeStr), "%dx%d", width, height);
+                printf("%-20s %-8s %-11s %10.1f ", kernel.name, kernel.variant, sizeStr, mpix);
+                if (cycles.valid())
+                    printf("%10.3f %10.3f ", cpp, bpc);
+                else
+                    printf("%10s %10s ", "-", "-");
+                printf("%6s\n", ok ? "ok" : "FAIL");
+            }
+            fflush(stdout);
+
+            free(out);
+            free(ref);
+        }
+
+        free(in);
+        free(yuyv);
+    }
+
+    if (!cycles.valid() && !csv)
+        printf("\n(cycle counters unavailable: perf_event_open failed)\n");
+
+    return failures ? 2 : 0;
+}
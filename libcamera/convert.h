@@ -0,0 +1,218 @@
+/*
+ *      This program is free software; you can redistribute it and/or modify
+ *      it under the terms of the GNU General Public License as published by
+ *      the Free Software Foundation; either version 2 of the License, or
+ *      (at your option) any later version.
+ *
+ * Colour conversion kernels shared by the HAL and the host tools.
+ */
+
+#ifndef _CONVERT_H
+#define _CONVERT_H
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* YUYV 4:2:2 -> RGB565, one 16 bit pixel per source pixel */
+void convertYUYVtoRGB565(unsigned char *buf, unsigned char *rgb, int width, int height);
+
+/* YUYV 4:2:2 -> packed RGB888, as fed to libjpeg */
+void convertYUYVtoRGB888(unsigned char *buf, unsigned char *rgb, int width, int height);
+
+/* YUYV 4:2:2 -> YUV420 semi-planar (NV21, V first), width multiple of 8 */
+void yuyv422_to_yuv420sp(unsigned char *in, unsigned char *out, int width, int height);
+
+void yuyv422_to_yuv420sp_c(unsigned char *in, unsigned char *out, int width, int height);
+#ifdef HAVE_NEON_CONVERT
+void yuyv422_to_yuv420sp_neon(unsigned char *in, unsigned char *out, int width, int height);
+#endif
+
+/*
+ * Cache-blocked variants for large frames (tiledconvert.c). flags describe
+ * the destination memory; CONVERT_DST_UNCACHED for write-combined or
+ * uncached buffers (gralloc without SW_READ/WRITE_OFTEN) makes them write
+ * whole cache lines and never read the destination back.
+ */
+#define CONVERT_DST_UNCACHED    0x1
+/* Write NV12 (U first) instead of NV21 */
+#define CONVERT_NV12            0x2
+
+/* Byte orders of packed 4:2:2 input: bit 0 puts Y in the odd bytes, bit 1
+ * puts V before U */
+#define PACKED422_YUYV  0
+#define PACKED422_UYVY  1
+#define PACKED422_YVYU  2
+#define PACKED422_VYUY  3
+
+void convertYUYVtoRGB565_tiled(unsigned char *buf, unsigned char *rgb, int width, int height, int flags);
+void yuyv422_to_yuv420sp_tiled(unsigned char *in, unsigned char *out, int width, int height, int flags);
+/* RGB565 and YUV420SP from one pass over the source; either may be NULL */
+void convertYUYV_tiled(unsigned char *buf, unsigned char *rgb565, unsigned char *yuv420sp,
+                       int width, int height, int flags);
+void convertPacked422_tiled(unsigned char *buf, int order, unsigned char *rgb565,
+                            unsigned char *yuv420sp, int width, int height, int flags);
+/* YUV420SP of the width x height window at (x0, y0) of a frame srcWidth
+ * pixels wide, e.g. a crop that moves from frame to frame; x0 even */
+void convertPacked422_window(const unsigned char *buf, int order, int srcWidth, int x0, int y0,
+                             unsigned char *yuv420sp, int width, int height, int flags);
+
+/* Bayer colour filter layouts, named by the top-left 2x2 in raster order */
+#define BAYER_BGGR  0
+#define BAYER_GBRG  1
+#define BAYER_GRBG  2
+#define BAYER_RGGB  3
+
+/* Raw sample packing: one byte per 8 bit sample or 16 bit little endian
+ * containers, or MIPI CSI-2 packed 10/12 bit */
+#define RAW_UNPACKED    0
+#define RAW_MIPI        1
+
+struct raw_format {
+    int bits;       /* significant bits per sample: 8, 10 or 12 */
+    int packing;
+    int pattern;    /* BAYER_* */
+    int black;      /* black level in sample units, subtracted first */
+    int gain;       /* 8.8 fixed point, 256 is unity */
+};
+
+/* Bytes of one row without padding. MIPI 10 bit rows are a multiple of 4
+ * samples, 12 bit rows a multiple of 2. */
+int raw_row_bytes(const struct raw_format *fmt, int width);
+
+/* One row to samples right aligned in 16 bits; black and gain ignored
+ * (rawunpack.c) */
+void raw_unpack_row16(const unsigned char *src, const struct raw_format *fmt,
+                      unsigned short *dst, int width);
+/* One row to 8 bits after black level and gain */
+void raw_unpack_row8(const unsigned char *src, const struct raw_format *fmt,
+                     unsigned char *dst, int width);
+void raw_unpack_row8_c(const unsigned char *src, const struct raw_format *fmt,
+                       unsigned char *dst, int width);
+
+/* Take green at red and blue sites along the flatter direction */
+#define DEMOSAIC_EDGE_AWARE     0x1
+
+/*
+ * Bayer -> YUYV 4:2:2, BT.601 limited range (demosaic.c). Rows are
+ * unpacked one at a time as the demosaic reaches them. Returns -1 if out
+ * of memory.
+ */
+int bayer_to_yuyv(const unsigned char *raw, const struct raw_format *fmt, unsigned char *yuyv,
+                  int width, int height, int flags);
+int bayer_to_yuyv_c(const unsigned char *raw, const struct raw_format *fmt, unsigned char *yuyv,
+                    int width, int height, int flags);
+
+#define FUSE_MAX_FRAMES 8
+
+/*
+ * Exposure fusion of n (1..FUSE_MAX_FRAMES) YUYV frames of one scene into
+ * dst, weighting every pixel by how well exposed it is (fusion.c). Rows
+ * are independent, so stripes can be fused in parallel.
+ */
+void exposure_fuse_yuyv(const unsigned char *const *src, int n, unsigned char *dst,
+                        int width, int height);
+void exposure_fuse_yuyv_c(const unsigned char *const *src, int n, unsigned char *dst,
+                          int width, int height);
+
+/* Which bytes of a buffer are luma: all, none, or every other one */
+#define TNR_LUMA            0
+#define TNR_CHROMA          1
+#define TNR_PACKED_Y_EVEN   2   /* YUYV, YVYU */
+#define TNR_PACKED_Y_ODD    3   /* UYVY, VYUY */
+
+struct tnr_strength {
+    int luma;       /* share of the reference where still, 0..128 */
+    int chroma;
+    int motion;     /* share lost per step of difference, 1..127 */
+};
+
+/*
+ * Temporal denoise (denoise.c): blend bytes of the current frame into the
+ * reference, the previous output, in place. The reference is the
+ * denoised frame.
+ */
+void tnr_update(const unsigned char *cur, unsigned char *ref, int bytes, int layout,
+                const struct tnr_strength *s);
+void tnr_update_c(const unsigned char *cur, unsigned char *ref, int bytes, int layout,
+                  const struct tnr_strength *s);
+
+/* Luma of packed 4:2:2 (PACKED422_* order) reduced by 4 in both
+ * directions into dst, (width / 4) x (height / 4) (motion.c) */
+void luma_downscale4(const unsigned char *src, int order, int width, int height, unsigned char *dst);
+
+/*
+ * Translation (dx, dy) within +-range taking prev to cur, two luma images
+ * of width x height: the median over textured blocks, each matched by
+ * full search. Returns the number of blocks used; with none the motion is
+ * 0, 0.
+ */
+int estimate_translation(const unsigned char *prev, const unsigned char *cur, int width, int height,
+                         int range, int *dx, int *dy);
+int estimate_translation_c(const unsigned char *prev, const unsigned char *cur, int width, int height,
+                           int range, int *dx, int *dy);
+
+/* Output formats of packed422_downscale */
+#define DOWNSCALE_GREY      0   /* luma only */
+#define DOWNSCALE_NV21      1   /* even width and height */
+#define DOWNSCALE_RGB888    2
+
+/* Bytes of a width x height frame in a DOWNSCALE_* format */
+int downscale_frame_size(int format, int width, int height);
+
+/*
+ * Packed 4:2:2 (PACKED422_* order) of srcWidth x srcHeight reduced to
+ * width x height by box averaging and converted to format, BT.601 limited
+ * range for RGB (downscale.c). Returns -1 for an invalid size or if out of
+ * memory.
+ */
+int packed422_downscale(const unsigned char *src, int order, int srcWidth, int srcHeight,
+                        unsigned char *dst, int width, int height, int format);
+
+/* Sources of tensor_convert besides the PACKED422_* orders */
+#define TENSOR_SRC_NV12     4
+#define TENSOR_SRC_NV21     5
+
+/* Element types of the tensor planes */
+#define TENSOR_UINT8        0
+#define TENSOR_FLOAT32      1
+
+/* Planes in B, G, R order instead of R, G, B */
+#define TENSOR_BGR          0x1
+
+/* Largest output width or height */
+#define TENSOR_MAX_SIZE     4096
+
+struct tensor_params {
+    int cropX;          /* window of the frame, rounded down to even */
+    int cropY;
+    int cropWidth;      /* 0 to the right or bottom edge */
+    int cropHeight;
+    int width;          /* output */
+    int height;
+    int type;           /* TENSOR_UINT8, TENSOR_FLOAT32 */
+    int flags;
+    float mean[3];      /* float output: (rgb - mean) * scale, R G B, */
+    float scale[3];     /* rgb in 0..255 */
+};
+
+/* Bytes of the three planes, 0 for a size outside 1..TENSOR_MAX_SIZE */
+size_t tensor_frame_size(const struct tensor_params *p);
+
+/*
+ * Crop, bilinear resize and conversion of a frame (layout PACKED422_* or
+ * TENSOR_SRC_*) to planar RGB, BT.601 limited range (tensor.c). Returns
+ * -1 for an invalid size, a window outside the frame or if out of memory.
+ */
+int tensor_convert(const unsigned char *src, int layout, int srcWidth, int srcHeight,
+                   const struct tensor_params *p, void *dst);
+int tensor_convert_c(const unsigned char *src, int layout, int srcWidth, int srcHeight,
+                     const struct tensor_params *p, void *dst);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
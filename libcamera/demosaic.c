@@ -0,0 +1,321 @@
+/*
+ *      This program is free software; you can redistribute it and/or modify
+ *      it under the terms of the GNU General Public License as published by
+ *      the Free Software Foundation; either version 2 of the License, or
+ *      (at your option) any later version.
+ *
+ * Bayer -> YUYV demosaic for sensors without an ISP.
+ *
+ * Rows are unpacked to 8 bits (rawunpack.c, applying black level and
+ * gain) into a three row ring with mirrored borders (mirroring by two
+ * keeps the colour filter phase), then every pixel gets its missing
+ * colours by bilinear interpolation. With DEMOSAIC_EDGE_AWARE
+ * green at red/blue sites comes from the direction with the smaller
+ * gradient instead of all four neighbours. RGB is converted to BT.601
+ * limited range YUYV in 7 bit fixed point, chroma from the average of
+ * each pixel pair.
+ *
+ * The SSE2 path uses the same rounding as the C code and produces
+ * identical output. Without SSE2 the C row is specialised on the colour
+ * layout so the compiler can vectorise it.
+ */
+
+#include <stdlib.h>
+
+#include "convert.h"
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+/* bytes of border on each side of a ring row; SIMD reads one past */
+#define PAD 16
+
+static inline int avg(int a, int b)
+{
+    return (a + b + 1) >> 1;
+}
+
+static inline int absdiff(int a, int b)
+{
+    return a > b ? a - b : b - a;
+}
+
+/*
+ * Colour layout of one row: g_even if green sits at even columns, red if
+ * the other colour of the row is red.
+ */
+static void row_layout(int pattern, int y, int *g_even, int *red)
+{
+    /* top-left 2x2 in raster order: B G / G R, G B / R G, G R / B G, R G / G B */
+    static const unsigned char layouts[4][2][2] = {
+        { { 0, 0 }, { 1, 1 } },     /* BGGR */
+        { { 1, 0 }, { 0, 1 } },     /* GBRG */
+        { { 1, 1 }, { 0, 0 } },     /* GRBG */
+        { { 0, 1 }, { 1, 0 } },     /* RGGB */
+    };
+
+    *g_even = layouts[pattern][y & 1][0];
+    *red = layouts[pattern][y & 1][1];
+}
+
+static inline void put_pair(unsigned char *out, int r0, int g0, int b0, int r1, int g1, int b1)
+{
+    int r = avg(r0, r1);
+    int g = avg(g0, g1);
+    int b = avg(b0, b1);
+
+    out[0] = ((33 * r0 + 65 * g0 + 13 * b0 + 64) >> 7) + 16;
+    out[1] = ((-19 * r - 37 * g + 56 * b + 64) >> 7) + 128;
+    out[2] = ((33 * r1 + 65 * g1 + 13 * b1 + 64) >> 7) + 16;
+    out[3] = ((56 * r - 47 * g - 9 * b + 64) >> 7) + 128;
+}
+
+static void demosaic_row_c(const unsigned char *a, const unsigned char *c, const unsigned char *b,
+                           int x0, int width, int g_even, int red, int edge, unsigned char *out)
+{
+    int x, i;
+
+    for (x = x0; x < width; x += 2) {
+        int rgb[2][3];
+
+        for (i = 0; i < 2; i++) {
+            int p = x + i;
+            int h = avg(c[p - 1], c[p + 1]);
+            int v = avg(a[p], b[p]);
+            int own, other, g;
+
+            if (((p & 1) == 0) == g_even) {
+                g = c[p];
+                own = h;
+                other = v;
+            } else {
+                int dh = absdiff(c[p - 1], c[p + 1]);
+                int dv = absdiff(a[p], b[p]);
+
+                if (edge && dh < dv)
+                    g = h;
+                else if (edge && dv < dh)
+                    g = v;
+                else
+                    g = avg(h, v);
+                own = c[p];
+                other = avg(avg(a[p - 1], a[p + 1]), avg(b[p - 1], b[p + 1]));
+            }
+            rgb[i][0] = red ? own : other;
+            rgb[i][1] = g;
+            rgb[i][2] = red ? other : own;
+        }
+        put_pair(out + x * 2, rgb[0][0], rgb[0][1], rgb[0][2], rgb[1][0], rgb[1][1], rgb[1][2]);
+    }
+}
+
+#ifdef __SSE2__
+
+/* 8 pixels of 16 bit R G B to 16 bytes of YUYV */
+static inline __m128i yuyv_8(__m128i r, __m128i g, __m128i b)
+{
+    const __m128i round = _mm_set1_epi16(64);
+    __m128i y, u, v, ra, ga, ba;
+
+    y = _mm_add_epi16(_mm_add_epi16(_mm_mullo_epi16(r, _mm_set1_epi16(33)),
+                                    _mm_mullo_epi16(g, _mm_set1_epi16(65))),
+                      _mm_add_epi16(_mm_mullo_epi16(b, _mm_set1_epi16(13)), round));
+    y = _mm_add_epi16(_mm_srli_epi16(y, 7), _mm_set1_epi16(16));
+
+    /* pair averages land in the even lanes */
+    ra = _mm_avg_epu16(r, _mm_srli_epi32(r, 16));
+    ga = _mm_avg_epu16(g, _mm_srli_epi32(g, 16));
+    ba = _mm_avg_epu16(b, _mm_srli_epi32(b, 16));
+    u = _mm_sub_epi16(_mm_add_epi16(_mm_mullo_epi16(ba, _mm_set1_epi16(56)), round),
+                      _mm_add_epi16(_mm_mullo_epi16(ra, _mm_set1_epi16(19)),
+                                    _mm_mullo_epi16(ga, _mm_set1_epi16(37))));
+    v = _mm_sub_epi16(_mm_add_epi16(_mm_mullo_epi16(ra, _mm_set1_epi16(56)), round),
+                      _mm_add_epi16(_mm_mullo_epi16(ga, _mm_set1_epi16(47)),
+                                    _mm_mullo_epi16(ba, _mm_set1_epi16(9))));
+    u = _mm_add_epi16(_mm_srai_epi16(u, 7), _mm_set1_epi16(128));
+    v = _mm_add_epi16(_mm_srai_epi16(v, 7), _mm_set1_epi16(128));
+
+    /* U in even lanes, V moved into odd lanes, then above Y */
+    u = _mm_or_si128(_mm_and_si128(u, _mm_set1_epi32(0x0000ffff)), _mm_slli_epi32(v, 16));
+    return _mm_or_si128(y, _mm_slli_epi16(u, 8));
+}
+
+static inline __m128i load(const unsigned char *p)
+{
+    return _mm_loadu_si128((const __m128i *) p);
+}
+
+static int demosaic_row_sse2(const unsigned char *a, const unsigned char *c, const unsigned char *b,
+                             int width, int g_even, int red, int edge, unsigned char *out)
+{
+    const __m128i even = _mm_set1_epi16(0x00ff);
+    const __m128i gmask = g_even ? even : _mm_xor_si128(even, _mm_set1_epi8(-1));
+    const __m128i zero = _mm_setzero_si128();
+    int x;
+
+    for (x = 0; x + 16 <= width; x += 16) {
+        __m128i cl = load(c + x - 1), cc = load(c + x), cr = load(c + x + 1);
+        __m128i ac = load(a + x), bc = load(b + x);
+        __m128i h = _mm_avg_epu8(cl, cr);
+        __m128i v = _mm_avg_epu8(ac, bc);
+        __m128i diag = _mm_avg_epu8(_mm_avg_epu8(load(a + x - 1), load(a + x + 1)),
+                                    _mm_avg_epu8(load(b + x - 1), load(b + x + 1)));
+        __m128i gx = _mm_avg_epu8(h, v);
+        __m128i g, own, other, r8, b8;
+
+        if (edge) {
+            __m128i dh = _mm_or_si128(_mm_subs_epu8(cl, cr), _mm_subs_epu8(cr, cl));
+            __m128i dv = _mm_or_si128(_mm_subs_epu8(ac, bc), _mm_subs_epu8(bc, ac));
+            __m128i m = _mm_max_epu8(dh, dv);
+            /* dh < dv exactly when the larger one is not dh */
+            __m128i useh = _mm_andnot_si128(_mm_cmpeq_epi8(m, dh), _mm_set1_epi8(-1));
+            __m128i usev = _mm_andnot_si128(_mm_cmpeq_epi8(m, dv), _mm_set1_epi8(-1));
+
+            gx = _mm_or_si128(_mm_and_si128(useh, h), _mm_andnot_si128(useh, gx));
+            gx = _mm_or_si128(_mm_and_si128(usev, v), _mm_andnot_si128(usev, gx));
+        }
+
+        g = _mm_or_si128(_mm_and_si128(gmask, cc), _mm_andnot_si128(gmask, gx));
+        own = _mm_or_si128(_mm_and_si128(gmask, h), _mm_andnot_si128(gmask, cc));
+        other = _mm_or_si128(_mm_and_si128(gmask, v), _mm_andnot_si128(gmask, diag));
+        r8 = red ? own : other;
+        b8 = red ? other : own;
+
+        _mm_storeu_si128((__m128i *) (out + x * 2),
+                         yuyv_8(_mm_unpacklo_epi8(r8, zero), _mm_unpacklo_epi8(g, zero),
+                                _mm_unpacklo_epi8(b8, zero)));
+        _mm_storeu_si128((__m128i *) (out + x * 2 + 16),
+                         yuyv_8(_mm_unpackhi_epi8(r8, zero), _mm_unpackhi_epi8(g, zero),
+                                _mm_unpackhi_epi8(b8, zero)));
+    }
+    return x;
+}
+
+#else
+
+/*
+ * demosaic_row_c with the colour sites of the pixel pair and the options
+ * fixed: called with constants, each instance is a loop without branches
+ * that the compiler can vectorise.
+ */
+static inline void demosaic_pairs(const unsigned char *a, const unsigned char *c,
+                                  const unsigned char *b, int width, unsigned char *out,
+                                  const int g_even, const int red, const int edge)
+{
+    int x, i;
+
+    for (x = 0; x + 2 <= width; x += 2) {
+        int rgb[2][3];
+
+        for (i = 0; i < 2; i++) {
+            int p = x + i;
+            int h = avg(c[p - 1], c[p + 1]);
+            int v = avg(a[p], b[p]);
+            int own, other, g;
+
+            if (i == g_even) {
+                int dh = absdiff(c[p - 1], c[p + 1]);
+                int dv = absdiff(a[p], b[p]);
+
+                g = edge && dh < dv ? h : (edge && dv < dh ? v : avg(h, v));
+                own = c[p];
+                other = avg(avg(a[p - 1], a[p + 1]), avg(b[p - 1], b[p + 1]));
+            } else {
+                g = c[p];
+                own = h;
+                other = v;
+            }
+            rgb[i][0] = red ? own : other;
+            rgb[i][1] = g;
+            rgb[i][2] = red ? other : own;
+        }
+        put_pair(out + x * 2, rgb[0][0], rgb[0][1], rgb[0][2], rgb[1][0], rgb[1][1], rgb[1][2]);
+    }
+}
+
+static int demosaic_row_generic(const unsigned char *a, const unsigned char *c, const unsigned char *b,
+                                int width, int g_even, int red, int edge, unsigned char *out)
+{
+    switch ((g_even ? 4 : 0) | (red ? 2 : 0) | (edge ? 1 : 0)) {
+    case 0: demosaic_pairs(a, c, b, width, out, 0, 0, 0); break;
+    case 1: demosaic_pairs(a, c, b, width, out, 0, 0, 1); break;
+    case 2: demosaic_pairs(a, c, b, width, out, 0, 1, 0); break;
+    case 3: demosaic_pairs(a, c, b, width, out, 0, 1, 1); break;
+    case 4: demosaic_pairs(a, c, b, width, out, 1, 0, 0); break;
+    case 5: demosaic_pairs(a, c, b, width, out, 1, 0, 1); break;
+    case 6: demosaic_pairs(a, c, b, width, out, 1, 1, 0); break;
+    default: demosaic_pairs(a, c, b, width, out, 1, 1, 1); break;
+    }
+    return width & ~1;
+}
+
+#endif /* __SSE2__ */
+
+static int demosaic(const unsigned char *raw, const struct raw_format *fmt, unsigned char *yuyv,
+                    int width, int height, int flags, int simd)
+{
+    int stride = width + 2 * PAD;
+    int rowBytes = raw_row_bytes(fmt, width);
+    unsigned char *ring = malloc(stride * 3);
+    unsigned char *rows[3];
+    int loaded[3] = { -1, -1, -1 };
+    int edge = flags & DEMOSAIC_EDGE_AWARE;
+    int y, i;
+
+    if (!ring)
+        return -1;
+    for (i = 0; i < 3; i++)
+        rows[i] = ring + i * stride + PAD;
+
+    for (y = 0; y < height; y++) {
+        /* mirror at the top and bottom, keeping the row parity */
+        int n[3];
+        int g_even, red, x = 0;
+
+        n[0] = y > 0 ? y - 1 : 1;
+        n[1] = y;
+        n[2] = y + 1 < height ? y + 1 : height - 2;
+        for (i = 0; i < 3; i++) {
+            unsigned char *row = rows[n[i] % 3];
+
+            if (loaded[n[i] % 3] == n[i])
+                continue;
+            if (simd)
+                raw_unpack_row8(raw + n[i] * rowBytes, fmt, row, width);
+            else
+                raw_unpack_row8_c(raw + n[i] * rowBytes, fmt, row, width);
+            row[-1] = row[1];
+            row[width] = row[width - 2];
+            loaded[n[i] % 3] = n[i];
+        }
+
+        row_layout(fmt->pattern, y, &g_even, &red);
+#ifdef __SSE2__
+        if (simd)
+            x = demosaic_row_sse2(rows[n[0] % 3], rows[n[1] % 3], rows[n[2] % 3],
+                                  width, g_even, red, edge, yuyv + y * width * 2);
+#else
+        if (simd)
+            x = demosaic_row_generic(rows[n[0] % 3], rows[n[1] % 3], rows[n[2] % 3],
+                                     width, g_even, red, edge, yuyv + y * width * 2);
+#endif
+        demosaic_row_c(rows[n[0] % 3], rows[n[1] % 3], rows[n[2] % 3],
+                       x, width, g_even, red, edge, yuyv + y * width * 2);
+    }
+
+    free(ring);
+    return 0;
+}
+
+int bayer_to_yuyv(const unsigned char *raw, const struct raw_format *fmt, unsigned char *yuyv,
+                  int width, int height, int flags)
+{
+    return demosaic(raw, fmt, yuyv, width, height, flags, 1);
+}
+
+int bayer_to_yuyv_c(const unsigned char *raw, const struct raw_format *fmt, unsigned char *yuyv,
+                    int width, int height, int flags)
+{
+    return demosaic(raw, fmt, yuyv, width, height, flags, 0);
+}
@@ -0,0 +1,110 @@
+/*
+ *      This program is free software; you can redistribute it and/or modify
+ *      it under the terms of the GNU General Public License as published by
+ *      the Free Software Foundation; either version 2 of the License, or
+ *      (at your option) any later version.
+ *
+ * Temporal noise reduction: a recursive filter per byte,
+ *
+ *   ref = (cur * (128 - a) + ref * a + 64) >> 7
+ *
+ * where the reference holds the previous output and a, the share of the
+ * reference, starts from the strength and drops by the motion gain for
+ * every step of |cur - ref|. Still areas average over several frames;
+ * anything that moves takes the new frame and does not ghost. Luma and
+ * chroma bytes get their own strength.
+ *
+ * One pass reads both buffers and writes the reference, sixteen bytes at a
+ * time with SSE2. Elsewhere the bytes are taken in luma/chroma pairs, so
+ * each lane of the loop has a fixed strength and the compiler vectorises
+ * it (vld2/vst2 on NEON). The output is identical to the C code.
+ */
+
+#include "convert.h"
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+static inline int blend(int cur, int ref, int strength, int motion)
+{
+    int d = cur > ref ? cur - ref : ref - cur;
+    int a = strength - d * motion;
+
+    if (a < 0)
+        a = 0;
+    return (cur * (128 - a) + ref * a + 64) >> 7;
+}
+
+/* blend() in 16 bit steps: d * motion, the weights and the sum all stay
+ * below 2^15, which lets the compiler use 16 bit lanes */
+static inline unsigned char blend16(unsigned char cur, unsigned char ref,
+                                    unsigned short strength, unsigned short motion)
+{
+    unsigned short d = cur > ref ? cur - ref : ref - cur;
+    unsigned short t = d * motion;
+    unsigned short a = t < strength ? strength - t : 0;
+
+    return (unsigned short) (cur * (128 - a) + ref * a + 64) >> 7;
+}
+
+static void update(const unsigned char *cur, unsigned char *ref, int bytes, int layout,
+                   const struct tnr_strength *s, int simd)
+{
+    int even = layout == TNR_CHROMA || layout == TNR_PACKED_Y_ODD ? s->chroma : s->luma;
+    int odd = layout == TNR_LUMA || layout == TNR_PACKED_Y_ODD ? s->luma : s->chroma;
+    int x = 0;
+
+#ifdef __SSE2__
+    if (simd) {
+        const __m128i zero = _mm_setzero_si128();
+        const __m128i strength = _mm_set_epi16(odd, even, odd, even, odd, even, odd, even);
+        const __m128i motion = _mm_set1_epi16(s->motion);
+        const __m128i full = _mm_set1_epi16(128);
+        const __m128i round = _mm_set1_epi16(64);
+
+        for (; x + 16 <= bytes; x += 16) {
+            __m128i c = _mm_loadu_si128((const __m128i *) (cur + x));
+            __m128i r = _mm_loadu_si128((const __m128i *) (ref + x));
+            __m128i d = _mm_or_si128(_mm_subs_epu8(c, r), _mm_subs_epu8(r, c));
+            __m128i a, lo, hi;
+
+            a = _mm_subs_epu16(strength, _mm_mullo_epi16(_mm_unpacklo_epi8(d, zero), motion));
+            lo = _mm_add_epi16(_mm_mullo_epi16(_mm_unpacklo_epi8(c, zero), _mm_sub_epi16(full, a)),
+                               _mm_mullo_epi16(_mm_unpacklo_epi8(r, zero), a));
+            a = _mm_subs_epu16(strength, _mm_mullo_epi16(_mm_unpackhi_epi8(d, zero), motion));
+            hi = _mm_add_epi16(_mm_mullo_epi16(_mm_unpackhi_epi8(c, zero), _mm_sub_epi16(full, a)),
+                               _mm_mullo_epi16(_mm_unpackhi_epi8(r, zero), a));
+            lo = _mm_srli_epi16(_mm_add_epi16(lo, round), 7);
+            hi = _mm_srli_epi16(_mm_add_epi16(hi, round), 7);
+            _mm_storeu_si128((__m128i *) (ref + x), _mm_packus_epi16(lo, hi));
+        }
+    }
+#else
+    if (simd) {
+        unsigned short strength[16];
+        unsigned short motion = s->motion;
+        int i;
+
+        for (i = 0; i < 16; i++)
+            strength[i] = i & 1 ? odd : even;
+        for (; x + 16 <= bytes; x += 16)
+            for (i = 0; i < 16; i++)
+                ref[x + i] = blend16(cur[x + i], ref[x + i], strength[i], motion);
+    }
+#endif
+    for (; x < bytes; x++)
+        ref[x] = blend(cur[x], ref[x], x & 1 ? odd : even, s->motion);
+}
+
+void tnr_update(const unsigned char *cur, unsigned char *ref, int bytes, int layout,
+                const struct tnr_strength *s)
+{
+    update(cur, ref, bytes, layout, s, 1);
+}
+
+void tnr_update_c(const unsigned char *cur, unsigned char *ref, int bytes, int layout,
+                  const struct tnr_strength *s)
+{
+    update(cur, ref, bytes, layout, s, 0);
+}
@@ -0,0 +1,160 @@
+/*
+ *      This program is free software; you can redistribute it and/or modify
+ *      it under the terms of the GNU General Public License as published by
+ *      the Free Software Foundation; either version 2 of the License, or
+ *      (at your option) any later version.
+ *
+ * Reduced callback frames: packed 4:2:2 scaled down to any smaller size
+ * and converted to Y only, NV21 or RGB888 in the same pass.
+ *
+ * Every output pixel is the average of the box of source pixels it covers,
+ * so small frames taken from large ones do not alias. The source is read
+ * once, row by row: each row is summed into per-column accumulators of the
+ * output row it falls in, and the output row is written when its last
+ * source row is in. Only the accumulators, a few KB, are written besides
+ * the output, which is what keeps this far cheaper than converting the
+ * whole frame and scaling it afterwards.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "convert.h"
+
+/* BT.601 limited range, 2^14 fixed point */
+#define C_Y   19071
+#define C_RV  26149
+#define C_GU  6406
+#define C_GV  13320
+#define C_BU  33063
+
+static inline int clamp8(int v)
+{
+    return v > 255 ? 255 : (v < 0 ? 0 : v);
+}
+
+/* Byte offsets of Y0, U, Y1, V for each PACKED422_* order */
+static const unsigned char offsets[4][4] = {
+    { 0, 1, 2, 3 },     /* YUYV */
+    { 1, 0, 3, 2 },     /* UYVY */
+    { 0, 3, 2, 1 },     /* YVYU */
+    { 1, 2, 3, 0 },     /* VYUY */
+};
+
+int downscale_frame_size(int format, int width, int height)
+{
+    switch (format) {
+    case DOWNSCALE_GREY:
+        return width * height;
+    case DOWNSCALE_NV21:
+        return width * height * 3 / 2;
+    case DOWNSCALE_RGB888:
+        return width * height * 3;
+    }
+    return 0;
+}
+
+/* Sum one source row into the accumulators of the output columns */
+static void sum_row(const unsigned char *row, const unsigned char *o, const int *xs, int width,
+                    int chroma, int *ysum, int *usum, int *vsum)
+{
+    /* Y1 is always two bytes after Y0, so luma is every other byte */
+    const unsigned char *luma = row + o[0];
+    int x, sx;
+
+    for (x = 0; x < width; x++) {
+        int ys = 0, us = 0, vs = 0;
+
+        for (sx = xs[x]; sx < xs[x + 1]; sx++)
+            ys += luma[sx * 2];
+        ysum[x] += ys;
+        if (!chroma)
+            continue;
+        /* one chroma pair per two pixels, counted once per pixel so the
+         * weights match the luma box */
+        for (sx = xs[x]; sx < xs[x + 1]; sx++) {
+            const unsigned char *p = row + (sx & ~1) * 2;
+
+            us += p[o[1]];
+            vs += p[o[3]];
+        }
+        usum[x] += us;
+        vsum[x] += vs;
+    }
+}
+
+int packed422_downscale(const unsigned char *src, int order, int srcWidth, int srcHeight,
+                        unsigned char *dst, int width, int height, int format)
+{
+    const unsigned char *o = offsets[order & 3];
+    int chroma = format != DOWNSCALE_GREY;
+    unsigned char *vu = dst + width * height;
+    int *xs, *ysum, *usum, *vsum;
+    int x, y, sy;
+
+    if (width <= 0 || height <= 0 || width > srcWidth || height > srcHeight)
+        return -1;
+    if (format == DOWNSCALE_NV21 && ((width | height) & 1))
+        return -1;
+
+    xs = malloc((width + 1 + 3 * width) * sizeof(int));
+    if (!xs)
+        return -1;
+    ysum = xs + width + 1;
+    usum = ysum + width;
+    vsum = usum + width;
+    for (x = 0; x <= width; x++)
+        xs[x] = (int) ((long long) x * srcWidth / width);
+
+    for (y = 0; y < height; y++) {
+        int y0 = (int) ((long long) y * srcHeight / height);
+        int y1 = (int) ((long long) (y + 1) * srcHeight / height);
+
+        memset(ysum, 0, width * sizeof(int));
+        /* NV21 chroma covers two output rows */
+        if (format != DOWNSCALE_NV21 || !(y & 1)) {
+            memset(usum, 0, width * sizeof(int));
+            memset(vsum, 0, width * sizeof(int));
+        }
+        for (sy = y0; sy < y1; sy++)
+            sum_row(src + (size_t) sy * srcWidth * 2, o, xs, width, chroma, ysum, usum, vsum);
+
+        switch (format) {
+        case DOWNSCALE_GREY:
+        case DOWNSCALE_NV21:
+            for (x = 0; x < width; x++) {
+                int n = (xs[x + 1] - xs[x]) * (y1 - y0);
+
+                dst[y * width + x] = (ysum[x] + n / 2) / n;
+            }
+            if (format == DOWNSCALE_NV21 && (y & 1)) {
+                int rows = y1 - (int) ((long long) (y - 1) * srcHeight / height);
+                unsigned char *c = vu + (y / 2) * width;
+
+                for (x = 0; x < width; x += 2) {
+                    int n = (xs[x + 2] - xs[x]) * rows;
+
+                    c[x] = (vsum[x] + vsum[x + 1] + n / 2) / n;
+                    c[x + 1] = (usum[x] + usum[x + 1] + n / 2) / n;
+                }
+            }
+            break;
+        case DOWNSCALE_RGB888:
+            for (x = 0; x < width; x++) {
+                int n = (xs[x + 1] - xs[x]) * (y1 - y0);
+                int l = ((ysum[x] + n / 2) / n - 16) * C_Y;
+                int u = (usum[x] + n / 2) / n - 128;
+                int v = (vsum[x] + n / 2) / n - 128;
+                unsigned char *d = dst + (y * width + x) * 3;
+
+                d[0] = clamp8((l + C_RV * v) >> 14);
+                d[1] = clamp8((l - C_GU * u - C_GV * v) >> 14);
+                d[2] = clamp8((l + C_BU * u) >> 14);
+            }
+            break;
+        }
+    }
+
+    free(xs);
+    return 0;
+}
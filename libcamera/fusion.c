@@ -0,0 +1,190 @@
+/*
+ *      This program is free software; you can redistribute it and/or modify
+ *      it under the terms of the GNU General Public License as published by
+ *      the Free Software Foundation; either version 2 of the License, or
+ *      (at your option) any later version.
+ *
+ * Exposure fusion of a bracket of YUYV frames.
+ *
+ * Every output pixel is the average of the frames weighted by how well
+ * exposed they are there: a hat function of luma, 255 at mid grey and
+ * falling quadratically to 1 at black and white. Chroma takes the mean
+ * weight of its pixel pair. This is the single scale form of Mertens'
+ * fusion (well-exposedness only, no pyramid), which is cheap enough for
+ * full size stills and keeps the sequence free of halos.
+ *
+ * Weights are normalised with one float reciprocal per byte, then the
+ * blend runs in saturating 16 bit fixed point. The SSE2 path does the same
+ * arithmetic and produces identical output.
+ */
+
+#include <string.h>
+
+#include "convert.h"
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+static inline int hat(int y)
+{
+    int d = y - 128;
+    int w = 255 - ((d * d) >> 6);
+
+    return w < 1 ? 1 : w;
+}
+
+static inline unsigned int sat16(unsigned int v)
+{
+    return v > 0xffff ? 0xffff : v;
+}
+
+/* One macropixel (Y0 U Y1 V) from byte offset x of every frame */
+static void fuse_pair(const unsigned char *const *src, int n, unsigned char *dst, int x)
+{
+    unsigned int w[FUSE_MAX_FRAMES][4];
+    unsigned int sum[4] = { 0, 0, 0, 0 };
+    unsigned int acc[4] = { 0, 0, 0, 0 };
+    int i, k;
+
+    for (i = 0; i < n; i++) {
+        unsigned int w0 = hat(src[i][x]);
+        unsigned int w1 = hat(src[i][x + 2]);
+        unsigned int wc = (w0 + w1 + 1) >> 1;
+
+        w[i][0] = w0;
+        w[i][1] = wc;
+        w[i][2] = w1;
+        w[i][3] = wc;
+        for (k = 0; k < 4; k++)
+            sum[k] += w[i][k];
+    }
+
+    for (k = 0; k < 4; k++) {
+        unsigned int r = (unsigned int) (int) (65536.0f / (float) (int) sum[k]);
+
+        for (i = 0; i < n; i++) {
+            unsigned int q = ((w[i][k] << 8) * r) >> 16;
+
+            acc[k] = sat16(acc[k] + q * src[i][x + k]);
+        }
+        dst[x + k] = sat16(acc[k] + 128) >> 8;
+    }
+}
+
+#ifdef __SSE2__
+/* Weights of eight bytes of YUYV, widened to 16 bits */
+static inline __m128i hat_yuyv(__m128i p)
+{
+    const __m128i mid = _mm_set1_epi16(128);
+    const __m128i top = _mm_set1_epi16(255);
+    const __m128i one = _mm_set1_epi16(1);
+    const __m128i ymask = _mm_set_epi16(0, -1, 0, -1, 0, -1, 0, -1);
+    __m128i d = _mm_sub_epi16(p, mid);
+    __m128i w = _mm_max_epi16(_mm_sub_epi16(top, _mm_srli_epi16(_mm_mullo_epi16(d, d), 6)), one);
+    __m128i pair, c;
+
+    /* chroma: mean of the two luma weights of each macropixel */
+    w = _mm_and_si128(w, ymask);
+    pair = _mm_add_epi16(w, _mm_srli_epi64(w, 32));
+    pair = _mm_srli_epi16(_mm_add_epi16(pair, one), 1);
+    c = _mm_shufflehi_epi16(_mm_shufflelo_epi16(pair, _MM_SHUFFLE(0, 0, 0, 0)), _MM_SHUFFLE(0, 0, 0, 0));
+    return _mm_or_si128(w, _mm_andnot_si128(ymask, c));
+}
+
+/* 65536 / sum, truncated, for eight 16 bit sums of at least 2 */
+static inline __m128i recip16(__m128i sum)
+{
+    const __m128i zero = _mm_setzero_si128();
+    const __m128 num = _mm_set1_ps(65536.0f);
+    const __m128i bias = _mm_set1_epi32(32768);
+    __m128i lo = _mm_cvttps_epi32(_mm_div_ps(num, _mm_cvtepi32_ps(_mm_unpacklo_epi16(sum, zero))));
+    __m128i hi = _mm_cvttps_epi32(_mm_div_ps(num, _mm_cvtepi32_ps(_mm_unpackhi_epi16(sum, zero))));
+
+    /* up to 32768: pack around the signed range and flip back */
+    lo = _mm_sub_epi32(lo, bias);
+    hi = _mm_sub_epi32(hi, bias);
+    return _mm_xor_si128(_mm_packs_epi32(lo, hi), _mm_set1_epi16((short) 0x8000));
+}
+
+static int fuse_row_sse2(const unsigned char *const *src, int n, unsigned char *dst, int bytes)
+{
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i half = _mm_set1_epi16(128);
+    int x;
+
+    for (x = 0; x + 16 <= bytes; x += 16) {
+        __m128i wlo[FUSE_MAX_FRAMES], whi[FUSE_MAX_FRAMES];
+        __m128i sumlo = zero, sumhi = zero;
+        __m128i rlo, rhi, acclo = zero, acchi = zero;
+        int i;
+
+        for (i = 0; i < n; i++) {
+            __m128i p = _mm_loadu_si128((const __m128i *) (src[i] + x));
+
+            wlo[i] = hat_yuyv(_mm_unpacklo_epi8(p, zero));
+            whi[i] = hat_yuyv(_mm_unpackhi_epi8(p, zero));
+            sumlo = _mm_add_epi16(sumlo, wlo[i]);
+            sumhi = _mm_add_epi16(sumhi, whi[i]);
+        }
+        rlo = recip16(sumlo);
+        rhi = recip16(sumhi);
+
+        for (i = 0; i < n; i++) {
+            __m128i p = _mm_loadu_si128((const __m128i *) (src[i] + x));
+            __m128i qlo = _mm_mulhi_epu16(_mm_slli_epi16(wlo[i], 8), rlo);
+            __m128i qhi = _mm_mulhi_epu16(_mm_slli_epi16(whi[i], 8), rhi);
+
+            acclo = _mm_adds_epu16(acclo, _mm_mullo_epi16(qlo, _mm_unpacklo_epi8(p, zero)));
+            acchi = _mm_adds_epu16(acchi, _mm_mullo_epi16(qhi, _mm_unpackhi_epi8(p, zero)));
+        }
+        acclo = _mm_srli_epi16(_mm_adds_epu16(acclo, half), 8);
+        acchi = _mm_srli_epi16(_mm_adds_epu16(acchi, half), 8);
+        _mm_storeu_si128((__m128i *) (dst + x), _mm_packus_epi16(acclo, acchi));
+    }
+    return x;
+}
+#endif
+
+static void fuse(const unsigned char *const *src, int n, unsigned char *dst,
+                 int width, int height, int simd)
+{
+    const unsigned char *row[FUSE_MAX_FRAMES];
+    int bytes = width * 2;
+    int x, y, i;
+
+    if (n > FUSE_MAX_FRAMES)
+        n = FUSE_MAX_FRAMES;
+    if (n == 1) {
+        memcpy(dst, src[0], (size_t) bytes * height);
+        return;
+    }
+
+    for (y = 0; y < height; y++) {
+        for (i = 0; i < n; i++)
+            row[i] = src[i] + (size_t) y * bytes;
+
+        x = 0;
+#ifdef __SSE2__
+        if (simd)
+            x = fuse_row_sse2(row, n, dst, bytes);
+#else
+        (void) simd;
+#endif
+        for (; x < bytes; x += 4)
+            fuse_pair(row, n, dst, x);
+        dst += bytes;
+    }
+}
+
+void exposure_fuse_yuyv(const unsigned char *const *src, int n, unsigned char *dst,
+                        int width, int height)
+{
+    fuse(src, n, dst, width, height, 1);
+}
+
+void exposure_fuse_yuyv_c(const unsigned char *const *src, int n, unsigned char *dst,
+                          int width, int height)
+{
+    fuse(src, n, dst, width, height, 0);
+}
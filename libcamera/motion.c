@@ -0,0 +1,151 @@
+/*
+ *      This program is free software; you can redistribute it and/or modify
+ *      it under the terms of the GNU General Public License as published by
+ *      the Free Software Foundation; either version 2 of the License, or
+ *      (at your option) any later version.
+ *
+ * Global motion estimation for video stabilization.
+ *
+ * Luma is reduced by four in both directions, averaging four pixels of
+ * every fourth row, which reads a quarter of the frame. Textured 16x16
+ * blocks of the small image are then matched against the previous one by
+ * full search (one PSADBW per block row with SSE2; elsewhere the C sum of
+ * absolute differences, which the compiler can vectorise), and the median
+ * of the block vectors is taken as the frame's motion, so a subject moving
+ * through part of the picture does not drag the estimate along.
+ */
+
+#include <stdlib.h>
+
+#include "convert.h"
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#define BLOCK 16
+#define BLOCK_STEP 32
+#define MAX_BLOCKS 256
+/* blocks flatter than this (sum of differences to a one pixel shift of
+ * themselves) do not say where they moved */
+#define MIN_TEXTURE (BLOCK * BLOCK * 2)
+
+void luma_downscale4(const unsigned char *src, int order, int width, int height, unsigned char *dst)
+{
+    /* Y is in the even bytes of YUYV/YVYU, the odd ones of UYVY/VYUY */
+    int first = order & PACKED422_UYVY;
+    int dw = width / 4, dh = height / 4;
+    int x, y;
+
+    for (y = 0; y < dh; y++) {
+        const unsigned char *row = src + (size_t) y * 4 * width * 2 + first;
+
+        for (x = 0; x < dw; x++) {
+            const unsigned char *p = row + x * 8;
+
+            *dst++ = (p[0] + p[2] + p[4] + p[6] + 2) >> 2;
+        }
+    }
+}
+
+static int sad16_c(const unsigned char *a, const unsigned char *b, int stride)
+{
+    int sum = 0, x, y;
+
+    for (y = 0; y < BLOCK; y++, a += stride, b += stride)
+        for (x = 0; x < BLOCK; x++)
+            sum += abs(a[x] - b[x]);
+    return sum;
+}
+
+#ifdef __SSE2__
+static int sad16_sse2(const unsigned char *a, const unsigned char *b, int stride)
+{
+    __m128i sum = _mm_setzero_si128();
+    int y;
+
+    for (y = 0; y < BLOCK; y++, a += stride, b += stride)
+        sum = _mm_add_epi64(sum, _mm_sad_epu8(_mm_loadu_si128((const __m128i *) a),
+                                              _mm_loadu_si128((const __m128i *) b)));
+    return _mm_cvtsi128_si32(sum) + _mm_cvtsi128_si32(_mm_srli_si128(sum, 8));
+}
+#endif
+
+static int median(int *v, int n)
+{
+    int i, j;
+
+    for (i = 1; i < n; i++) {
+        int t = v[i];
+
+        for (j = i; j > 0 && v[j - 1] > t; j--)
+            v[j] = v[j - 1];
+        v[j] = t;
+    }
+    return v[n / 2];
+}
+
+static int estimate(const unsigned char *prev, const unsigned char *cur, int width, int height,
+                    int range, int *dx, int *dy, int simd)
+{
+    int (*sad)(const unsigned char *, const unsigned char *, int) = sad16_c;
+    int vx[MAX_BLOCKS], vy[MAX_BLOCKS];
+    int n = 0, bx, by;
+
+#ifdef __SSE2__
+    if (simd)
+        sad = sad16_sse2;
+#else
+    (void) simd;
+#endif
+
+    /* blocks far enough from the edges for every candidate to fit */
+    for (by = range; by + BLOCK + range + 1 <= height && n < MAX_BLOCKS; by += BLOCK_STEP) {
+        for (bx = range; bx + BLOCK + range + 1 <= width && n < MAX_BLOCKS; bx += BLOCK_STEP) {
+            const unsigned char *block = cur + by * width + bx;
+            int best = -1, bestX = 0, bestY = 0;
+            int x, y;
+
+            if (sad(block, block + width + 1, width) < MIN_TEXTURE)
+                continue;
+
+            /* cur(b) = prev(b - d); ties go to the smaller motion */
+            for (y = -range; y <= range; y++) {
+                for (x = -range; x <= range; x++) {
+                    int s = sad(block, prev + (by - y) * width + bx - x, width);
+
+                    if (best < 0 || s < best ||
+                        (s == best && abs(x) + abs(y) < abs(bestX) + abs(bestY))) {
+                        best = s;
+                        bestX = x;
+                        bestY = y;
+                    }
+                }
+            }
+            vx[n] = bestX;
+            vy[n] = bestY;
+            n++;
+        }
+    }
+
+    if (!n) {
+        *dx = 0;
+        *dy = 0;
+        return 0;
+    }
+    *dx = median(vx, n);
+    *dy = median(vy, n);
+    return n;
+}
+
+int estimate_translation(const unsigned char *prev, const unsigned char *cur, int width, int height,
+                         int range, int *dx, int *dy)
+{
+    return estimate(prev, cur, width, height, range, dx, dy, 1);
+}
+
+int estimate_translation_c(const unsigned char *prev, const unsigned char *cur, int width, int height,
+                           int range, int *dx, int *dy)
+{
+    return estimate(prev, cur, width, height, range, dx, dy, 0);
+}
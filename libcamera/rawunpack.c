@@ -0,0 +1,200 @@
+/*
+ *      This program is free software; you can redistribute it and/or modify
+ *      it under the terms of the GNU General Public License as published by
+ *      the Free Software Foundation; either version 2 of the License, or
+ *      (at your option) any later version.
+ *
+ * Raw sensor row unpacking.
+ *
+ * MIPI CSI-2 packs four 10 bit samples into five bytes (the high 8 bits of
+ * each, then one byte holding the low 2 bits of all four) and two 12 bit
+ * samples into three bytes (the high 8 bits of each, then both low
+ * nibbles). The packed groups are widened eight bytes at a time in a
+ * 64 bit register, which needs no shuffle instructions and so works the
+ * same with SSE2 and NEON; the stores assume a little endian CPU.
+ *
+ * Rows are unpacked one at a time, in chunks small enough to stay in L1,
+ * so consumers like the demosaic never need a 16 bit copy of the frame.
+ */
+
+#include <stdint.h>
+#include <string.h>
+
+#include "convert.h"
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+/* samples per chunk of raw_unpack_row8; a multiple of every group size */
+#define CHUNK 128
+
+int raw_row_bytes(const struct raw_format *fmt, int width)
+{
+    if (fmt->packing == RAW_MIPI)
+        return width * fmt->bits / 8;
+    return fmt->bits == 8 ? width : width * 2;
+}
+
+static void unpack_mipi10(const unsigned char *src, unsigned short *dst, int width)
+{
+    int x = 0;
+
+    /* an 8 byte load of the group at x stays inside the row while x + 8 <= width */
+    for (; x + 8 <= width; x += 4, src += 5) {
+        uint64_t v, msb, lsb, out;
+
+        memcpy(&v, src, 8);
+        msb = v & 0xffffffff;
+        lsb = (v >> 32) & 0xff;
+        out = (msb & 0xff) | (msb & 0xff00) << 8 | (msb & 0xff0000) << 16 | (msb & 0xff000000) << 24;
+        out = out << 2 | (lsb & 0x3) | (lsb & 0xc) << 14 | (lsb & 0x30) << 28 | (lsb & 0xc0) << 42;
+        memcpy(dst + x, &out, 8);
+    }
+    for (; x < width; x += 4, src += 5) {
+        int i;
+
+        for (i = 0; i < 4 && x + i < width; i++)
+            dst[x + i] = src[i] << 2 | ((src[4] >> (2 * i)) & 0x3);
+    }
+}
+
+static void unpack_mipi12(const unsigned char *src, unsigned short *dst, int width)
+{
+    int x = 0;
+
+    for (; x + 8 <= width; x += 4, src += 6) {
+        uint64_t v, out;
+
+        memcpy(&v, src, 8);
+        out = (v & 0xff) << 4 | ((v >> 16) & 0xf);
+        out |= ((v >> 8) & 0xff) << 20 | ((v >> 20) & 0xf) << 16;
+        out |= ((v >> 24) & 0xff) << 36 | ((v >> 40) & 0xf) << 32;
+        out |= ((v >> 32) & 0xff) << 52 | ((v >> 44) & 0xf) << 48;
+        memcpy(dst + x, &out, 8);
+    }
+    for (; x < width; x += 2, src += 3) {
+        dst[x] = src[0] << 4 | (src[2] & 0xf);
+        if (x + 1 < width)
+            dst[x + 1] = src[1] << 4 | (src[2] >> 4);
+    }
+}
+
+void raw_unpack_row16(const unsigned char *src, const struct raw_format *fmt,
+                      unsigned short *dst, int width)
+{
+    int x;
+
+    if (fmt->packing == RAW_MIPI && fmt->bits == 10) {
+        unpack_mipi10(src, dst, width);
+    } else if (fmt->packing == RAW_MIPI && fmt->bits == 12) {
+        unpack_mipi12(src, dst, width);
+    } else if (fmt->bits == 8) {
+        for (x = 0; x < width; x++)
+            dst[x] = src[x];
+    } else {
+        for (x = 0; x < width; x++)
+            dst[x] = src[x * 2] | (src[x * 2 + 1] << 8);
+    }
+}
+
+/*
+ * Black level, then gain, to 8 bits: samples are left aligned to 16 bits
+ * (bits above fmt->bits fall off) and the high byte of sample * gain / 256
+ * is kept, saturating at 255.
+ */
+static void scale_row8(const unsigned short *src, const struct raw_format *fmt,
+                       unsigned char *dst, int width, int simd)
+{
+    int shift = 16 - fmt->bits;
+    int x = 0;
+
+#ifdef __SSE2__
+    if (simd) {
+        const __m128i black = _mm_set1_epi16(fmt->black);
+        const __m128i gain = _mm_set1_epi16(fmt->gain);
+        const __m128i max = _mm_set1_epi16(255);
+        const __m128i count = _mm_cvtsi32_si128(shift);
+
+        for (; x + 16 <= width; x += 16) {
+            __m128i lo = _mm_loadu_si128((const __m128i *) (src + x));
+            __m128i hi = _mm_loadu_si128((const __m128i *) (src + x + 8));
+
+            lo = _mm_mulhi_epu16(_mm_sll_epi16(_mm_subs_epu16(lo, black), count), gain);
+            hi = _mm_mulhi_epu16(_mm_sll_epi16(_mm_subs_epu16(hi, black), count), gain);
+            /* min(v, 255) without SSE4.1: subtract the excess */
+            lo = _mm_sub_epi16(lo, _mm_subs_epu16(lo, max));
+            hi = _mm_sub_epi16(hi, _mm_subs_epu16(hi, max));
+            _mm_storeu_si128((__m128i *) (dst + x), _mm_packus_epi16(lo, hi));
+        }
+    }
+#else
+    (void) simd;
+#endif
+    for (; x < width; x++) {
+        unsigned int v = src[x] > fmt->black ? src[x] - fmt->black : 0;
+
+        v = (((v << shift) & 0xffff) * fmt->gain) >> 16;
+        dst[x] = v > 255 ? 255 : v;
+    }
+}
+
+static void unpack_row8(const unsigned char *src, const struct raw_format *fmt,
+                        unsigned char *dst, int width, int simd)
+{
+    unsigned short tmp[CHUNK];
+    int x;
+
+    for (x = 0; x < width; x += CHUNK) {
+        int n = width - x < CHUNK ? width - x : CHUNK;
+
+        raw_unpack_row16(src + raw_row_bytes(fmt, x), fmt, tmp, n);
+        scale_row8(tmp, fmt, dst + x, n, simd);
+    }
+}
+
+void raw_unpack_row8(const unsigned char *src, const struct raw_format *fmt,
+                     unsigned char *dst, int width)
+{
+    int x = 0;
+
+    if (fmt->black || fmt->gain != 256) {
+        unpack_row8(src, fmt, dst, width, 1);
+        return;
+    }
+
+    /* Unity: the high byte of every sample, straight from the packed row */
+    if (fmt->bits == 8) {
+        memcpy(dst, src, width);
+    } else if (fmt->packing == RAW_MIPI && fmt->bits == 10) {
+        for (; x < width; x += 4, src += 5)
+            memcpy(dst + x, src, 4);
+    } else if (fmt->packing == RAW_MIPI && fmt->bits == 12) {
+        for (; x < width; x += 2, src += 3) {
+            dst[x] = src[0];
+            dst[x + 1] = src[1];
+        }
+    } else {
+        int shift = 16 - fmt->bits;
+#ifdef __SSE2__
+        const __m128i count = _mm_cvtsi32_si128(shift);
+
+        for (; x + 16 <= width; x += 16) {
+            __m128i lo = _mm_loadu_si128((const __m128i *) (src + x * 2));
+            __m128i hi = _mm_loadu_si128((const __m128i *) (src + x * 2 + 16));
+
+            lo = _mm_srli_epi16(_mm_sll_epi16(lo, count), 8);
+            hi = _mm_srli_epi16(_mm_sll_epi16(hi, count), 8);
+            _mm_storeu_si128((__m128i *) (dst + x), _mm_packus_epi16(lo, hi));
+        }
+#endif
+        for (; x < width; x++)
+            dst[x] = (((src[x * 2] | (src[x * 2 + 1] << 8)) << shift) & 0xffff) >> 8;
+    }
+}
+
+void raw_unpack_row8_c(const unsigned char *src, const struct raw_format *fmt,
+                       unsigned char *dst, int width)
+{
+    unpack_row8(src, fmt, dst, width, 0);
+}
@@ -1,3 +1,5 @@
+#include "convert.h"
+
 static void yuv_to_rgb16(unsigned char y, unsigned char u, unsigned char v, unsigned char *rgb)
 {
     int r,g,b;
@@ -48,3 +50,41 @@ void convertYUYVtoRGB565(unsigned char *buf, unsigned char *rgb, int width, int
 
 }
 
+
+
+/*
+ * YUYV 4:2:2 -> packed RGB888, integer BT.601 full range. This is the row
+ * conversion the JPEG encoder feeds to libjpeg.
+ */
+void convertYUYVtoRGB888(unsigned char *buf, unsigned char *rgb, int width, int height)
+{
+    int x;
+    int pairs;
+
+    pairs = (width * height) / 2;
+
+    for (x = 0; x < pairs; x++) {
+        int y0, y1, u, v;
+        int dr, dg, db;
+        int c;
+
+        y0 = buf[0] << 8;
+        u = buf[1] - 128;
+        y1 = buf[2] << 8;
+        v = buf[3] - 128;
+
+        dr = 359 * v;
+        dg = -(88 * u) - (183 * v);
+        db = 454 * u;
+
+        c = (y0 + dr) >> 8; rgb[0] = (c > 255) ? 255 : ((c < 0) ? 0 : c);
+        c = (y0 + dg) >> 8; rgb[1] = (c > 255) ? 255 : ((c < 0) ? 0 : c);
+        c = (y0 + db) >> 8; rgb[2] = (c > 255) ? 255 : ((c < 0) ? 0 : c);
+        c = (y1 + dr) >> 8; rgb[3] = (c > 255) ? 255 : ((c < 0) ? 0 : c);
+        c = (y1 + dg) >> 8; rgb[4] = (c > 255) ? 255 : ((c < 0) ? 0 : c);
+        c = (y1 + db) >> 8; rgb[5] = (c > 255) ? 255 : ((c < 0) ? 0 : c);
+
+        buf += 4;
+        rgb += 6;
+    }
+}
@@ -0,0 +1,369 @@
+/*
+ *      This program is free software; you can redistribute it and/or modify
+ *      it under the terms of the GNU General Public License as published by
+ *      the Free Software Foundation; either version 2 of the License, or
+ *      (at your option) any later version.
+ *
+ * Model input straight from the capture: a window of a packed 4:2:2 or
+ * NV12/NV21 frame resized bilinearly (sample centres aligned, as the
+ * common inference frameworks resize) to planar RGB, one plane per
+ * channel, as bytes or as floats normalized per channel.
+ *
+ * Each output row takes one pass over the two source rows around it: they
+ * are blended into a line of the crop's width, sixteen bytes at a time
+ * with SSE2, the line is sampled at the output columns, and the samples
+ * are converted to RGB and normalized four at a time into the planes.
+ * Without SSE2 each plane of a row is a separate loop that the compiler
+ * can vectorise, like the row blend. Every path gives identical output.
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "convert.h"
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+/* BT.601 limited range */
+#define K_Y   1.164f
+#define K_RV  1.596f
+#define K_GU  0.391f
+#define K_GV  0.813f
+#define K_BU  2.018f
+
+/* Byte offsets of Y0, U, Y1, V for each PACKED422_* order */
+static const unsigned char offsets[4][4] = {
+    { 0, 1, 2, 3 },     /* YUYV */
+    { 1, 0, 3, 2 },     /* UYVY */
+    { 0, 3, 2, 1 },     /* YVYU */
+    { 1, 2, 3, 0 },     /* VYUY */
+};
+
+size_t tensor_frame_size(const struct tensor_params *p)
+{
+    size_t bpp = p->type == TENSOR_FLOAT32 ? sizeof(float) : 1;
+
+    if (p->width <= 0 || p->height <= 0 || p->width > TENSOR_MAX_SIZE ||
+        p->height > TENSOR_MAX_SIZE || (size_t) p->width > SIZE_MAX / 3 / bpp / p->height)
+        return 0;
+    return (size_t) p->width * p->height * 3 * bpp;
+}
+
+/* Where output sample i of n falls in a span of size samples, 16.16
+ * fixed point, clamped to the span */
+static int source_pos(int i, int n, int size)
+{
+    long long f = ((long long) (2 * i + 1) * size << 16) / (2 * n) - 32768;
+
+    if (f < 0)
+        f = 0;
+    if (f > (long long) (size - 1) << 16)
+        f = (long long) (size - 1) << 16;
+    return (int) f;
+}
+
+/* Index pairs and weights (0..255 for the second) of a bilinear tap */
+struct taps {
+    int *i0;
+    int *i1;
+    int *w;
+};
+
+static void set_tap(struct taps *t, int x, int pos, int last)
+{
+    t->i0[x] = pos >> 16;
+    t->i1[x] = t->i0[x] < last ? t->i0[x] + 1 : last;
+    t->w[x] = (pos >> 8) & 255;
+}
+
+/* (a * (256 - w) + b * w) / 256 over n bytes; a itself when w is 0 */
+static const unsigned char *blend_rows(const unsigned char *a, const unsigned char *b, int w,
+                                       unsigned char *dst, int n, int simd)
+{
+    int i = 0;
+
+    if (w == 0 || a == b)
+        return a;
+#ifdef __SSE2__
+    if (simd) {
+        const __m128i zero = _mm_setzero_si128();
+        const __m128i wa = _mm_set1_epi16(256 - w);
+        const __m128i wb = _mm_set1_epi16(w);
+        const __m128i round = _mm_set1_epi16(128);
+
+        /* at most 255 * 256 + 128: the 16 bit lanes hold it unsigned */
+        for (; i + 16 <= n; i += 16) {
+            __m128i va = _mm_loadu_si128((const __m128i *) (a + i));
+            __m128i vb = _mm_loadu_si128((const __m128i *) (b + i));
+            __m128i lo = _mm_add_epi16(_mm_mullo_epi16(_mm_unpacklo_epi8(va, zero), wa),
+                                       _mm_mullo_epi16(_mm_unpacklo_epi8(vb, zero), wb));
+            __m128i hi = _mm_add_epi16(_mm_mullo_epi16(_mm_unpackhi_epi8(va, zero), wa),
+                                       _mm_mullo_epi16(_mm_unpackhi_epi8(vb, zero), wb));
+
+            lo = _mm_srli_epi16(_mm_add_epi16(lo, round), 8);
+            hi = _mm_srli_epi16(_mm_add_epi16(hi, round), 8);
+            _mm_storeu_si128((__m128i *) (dst + i), _mm_packus_epi16(lo, hi));
+        }
+    }
+#else
+    (void) simd;
+#endif
+    for (; i < n; i++)
+        dst[i] = (a[i] * (256 - w) + b[i] * w + 128) >> 8;
+    return dst;
+}
+
+static inline int lerp(const unsigned char *p, int step, const struct taps *t, int x)
+{
+    return (p[t->i0[x] * step] * (256 - t->w[x]) + p[t->i1[x] * step] * t->w[x] + 128) >> 8;
+}
+
+static inline float clamp255f(float v)
+{
+    return v < 0.0f ? 0.0f : (v > 255.0f ? 255.0f : v);
+}
+
+/* Channel c (R, G, B) of one sample, unclamped */
+static inline float rgb_channel(int c, int y, int u, int v)
+{
+    float l = (y - 16) * K_Y;
+    float fu = u - 128;
+    float fv = v - 128;
+
+    if (c == 0)
+        return l + K_RV * fv;
+    if (c == 1)
+        return l - K_GU * fu - K_GV * fv;
+    return l + K_BU * fu;
+}
+
+/* Channel c of a row into its plane. Called with a constant c, so each
+ * call is a branch free loop the compiler vectorises. */
+static inline void plane_row(const short *ys, const short *us, const short *vs, int n, int c,
+                             const struct tensor_params *p, void *plane)
+{
+    float mean = p->mean[c];
+    float scale = p->scale[c];
+    int x;
+
+    if (p->type == TENSOR_FLOAT32) {
+        float *d = (float *) plane;
+
+        for (x = 0; x < n; x++)
+            d[x] = (clamp255f(rgb_channel(c, ys[x], us[x], vs[x])) - mean) * scale;
+    } else {
+        unsigned char *d = (unsigned char *) plane;
+
+        /* clamped after rounding, the same bytes: a float clamp ahead of
+         * the conversion keeps the compiler from vectorising */
+        for (x = 0; x < n; x++) {
+            int k = (int) (rgb_channel(c, ys[x], us[x], vs[x]) + 0.5f);
+
+            d[x] = k < 0 ? 0 : (k > 255 ? 255 : k);
+        }
+    }
+}
+
+/* Y, U, V samples of one row to the three planes */
+static void colour_row(const short *ys, const short *us, const short *vs, int n,
+                       const struct tensor_params *p, void *const *planes, int simd)
+{
+    int x = 0, c;
+
+#ifdef __SSE2__
+    if (simd) {
+        const __m128i zero = _mm_setzero_si128();
+        const __m128 lo = _mm_setzero_ps();
+        const __m128 hi = _mm_set1_ps(255.0f);
+        __m128 mean[3], scale[3];
+
+        for (c = 0; c < 3; c++) {
+            mean[c] = _mm_set1_ps(p->mean[c]);
+            scale[c] = _mm_set1_ps(p->scale[c]);
+        }
+        for (; x + 4 <= n; x += 4) {
+            __m128 y = _mm_cvtepi32_ps(_mm_unpacklo_epi16(_mm_loadl_epi64((const __m128i *) (ys + x)), zero));
+            __m128 u = _mm_cvtepi32_ps(_mm_unpacklo_epi16(_mm_loadl_epi64((const __m128i *) (us + x)), zero));
+            __m128 v = _mm_cvtepi32_ps(_mm_unpacklo_epi16(_mm_loadl_epi64((const __m128i *) (vs + x)), zero));
+            __m128 l, rgb[3];
+
+            l = _mm_mul_ps(_mm_sub_ps(y, _mm_set1_ps(16.0f)), _mm_set1_ps(K_Y));
+            u = _mm_sub_ps(u, _mm_set1_ps(128.0f));
+            v = _mm_sub_ps(v, _mm_set1_ps(128.0f));
+            rgb[0] = _mm_add_ps(l, _mm_mul_ps(_mm_set1_ps(K_RV), v));
+            rgb[1] = _mm_sub_ps(_mm_sub_ps(l, _mm_mul_ps(_mm_set1_ps(K_GU), u)),
+                                _mm_mul_ps(_mm_set1_ps(K_GV), v));
+            rgb[2] = _mm_add_ps(l, _mm_mul_ps(_mm_set1_ps(K_BU), u));
+
+            for (c = 0; c < 3; c++) {
+                __m128 k = _mm_min_ps(_mm_max_ps(rgb[c], lo), hi);
+
+                if (p->type == TENSOR_FLOAT32) {
+                    _mm_storeu_ps((float *) planes[c] + x,
+                                  _mm_mul_ps(_mm_sub_ps(k, mean[c]), scale[c]));
+                } else {
+                    __m128i i = _mm_cvttps_epi32(_mm_add_ps(k, _mm_set1_ps(0.5f)));
+                    int bytes;
+
+                    i = _mm_packus_epi16(_mm_packs_epi32(i, zero), zero);
+                    bytes = _mm_cvtsi128_si32(i);
+                    memcpy((unsigned char *) planes[c] + x, &bytes, 4);
+                }
+            }
+        }
+    }
+#else
+    if (simd) {
+        plane_row(ys, us, vs, n, 0, p, planes[0]);
+        plane_row(ys, us, vs, n, 1, p, planes[1]);
+        plane_row(ys, us, vs, n, 2, p, planes[2]);
+        return;
+    }
+#endif
+    for (; x < n; x++) {
+        float l = (ys[x] - 16) * K_Y;
+        float u = us[x] - 128;
+        float v = vs[x] - 128;
+        float rgb[3];
+
+        rgb[0] = l + K_RV * v;
+        rgb[1] = l - K_GU * u - K_GV * v;
+        rgb[2] = l + K_BU * u;
+        for (c = 0; c < 3; c++) {
+            float k = clamp255f(rgb[c]);
+
+            if (p->type == TENSOR_FLOAT32)
+                ((float *) planes[c])[x] = (k - p->mean[c]) * p->scale[c];
+            else
+                ((unsigned char *) planes[c])[x] = (int) (k + 0.5f);
+        }
+    }
+}
+
+static int convert(const unsigned char *src, int layout, int srcWidth, int srcHeight,
+                   const struct tensor_params *p, void *dst, int simd)
+{
+    int packed = layout < TENSOR_SRC_NV12;
+    int cropX = p->cropX & ~1;
+    int cropW = p->cropWidth > 0 ? p->cropWidth : srcWidth - cropX;
+    int cropH = p->cropHeight > 0 ? p->cropHeight : srcHeight - p->cropY;
+    int pairs = (cropW + 1) / 2;
+    int bpp = p->type == TENSOR_FLOAT32 ? (int) sizeof(float) : 1;
+    size_t planeBytes = tensor_frame_size(p) / 3;
+    unsigned char *lines, *base;
+    struct taps lt, ct;
+    short *ys, *us, *vs;
+    void *planes[3];
+    int x, y;
+
+    if (!planeBytes || cropX < 0 || p->cropY < 0 || cropW <= 0 || cropH <= 0 ||
+        cropX + pairs * 2 > srcWidth || p->cropY + cropH > srcHeight)
+        return -1;
+    if (layout < 0 || layout > TENSOR_SRC_NV21 || (!packed && ((srcWidth | srcHeight) & 1)))
+        return -1;
+
+    /* blended lines (packed: the whole 4:2:2 span; NV12: luma then
+     * chroma), the taps and the Y, U, V samples of a row */
+    base = malloc(pairs * 4 + 6 * p->width * sizeof(int) + 3 * (p->width + 4) * sizeof(short));
+    if (!base)
+        return -1;
+    lt.i0 = (int *) base;
+    lt.i1 = lt.i0 + p->width;
+    lt.w = lt.i1 + p->width;
+    ct.i0 = lt.w + p->width;
+    ct.i1 = ct.i0 + p->width;
+    ct.w = ct.i1 + p->width;
+    ys = (short *) (ct.w + p->width);
+    us = ys + p->width + 4;
+    vs = us + p->width + 4;
+    lines = (unsigned char *) (vs + p->width + 4);
+
+    /* chroma is co-sited with the even luma columns */
+    for (x = 0; x < p->width; x++) {
+        int pos = source_pos(x, p->width, cropW);
+        int cpos = pos / 2 < (pairs - 1) << 16 ? pos / 2 : (pairs - 1) << 16;
+
+        set_tap(&lt, x, pos, cropW - 1);
+        set_tap(&ct, x, cpos, pairs - 1);
+    }
+
+    planes[0] = (unsigned char *) dst + (p->flags & TENSOR_BGR ? 2 : 0) * planeBytes;
+    planes[1] = (unsigned char *) dst + planeBytes;
+    planes[2] = (unsigned char *) dst + (p->flags & TENSOR_BGR ? 0 : 2) * planeBytes;
+
+    for (y = 0; y < p->height; y++) {
+        int fy = (p->cropY << 16) + source_pos(y, p->height, cropH);
+        int y0 = fy >> 16;
+        int y1 = y0 + 1 < srcHeight ? y0 + 1 : y0;
+        const unsigned char *luma, *u, *v;
+        int lstep, cstep;
+
+        if (packed) {
+            const unsigned char *o = offsets[layout];
+            size_t stride = (size_t) srcWidth * 2;
+            const unsigned char *line = blend_rows(src + y0 * stride + cropX * 2,
+                                                   src + y1 * stride + cropX * 2,
+                                                   (fy >> 8) & 255, lines, pairs * 4, simd);
+
+            luma = line + o[0];
+            u = line + o[1];
+            v = line + o[3];
+            lstep = 2;
+            cstep = 4;
+        } else {
+            /* chroma rows sit between two luma rows */
+            const unsigned char *chroma = src + (size_t) srcWidth * srcHeight + cropX;
+            int cy = (fy - 32768) / 2;
+            int cy0, cy1;
+            const unsigned char *line;
+
+            if (cy < 0)
+                cy = 0;
+            if (cy > (srcHeight / 2 - 1) << 16)
+                cy = (srcHeight / 2 - 1) << 16;
+            cy0 = cy >> 16;
+            cy1 = cy0 + 1 < srcHeight / 2 ? cy0 + 1 : cy0;
+
+            luma = blend_rows(src + (size_t) y0 * srcWidth + cropX, src + (size_t) y1 * srcWidth + cropX,
+                              (fy >> 8) & 255, lines, cropW, simd);
+            line = blend_rows(chroma + (size_t) cy0 * srcWidth, chroma + (size_t) cy1 * srcWidth,
+                              (cy >> 8) & 255, lines + pairs * 2, pairs * 2, simd);
+            u = line + (layout == TENSOR_SRC_NV21);
+            v = line + (layout == TENSOR_SRC_NV12);
+            lstep = 1;
+            cstep = 2;
+        }
+
+        for (x = 0; x < p->width; x++) {
+            ys[x] = lerp(luma, lstep, &lt, x);
+            us[x] = lerp(u, cstep, &ct, x);
+            vs[x] = lerp(v, cstep, &ct, x);
+        }
+        {
+            void *row[3];
+            int c;
+
+            for (c = 0; c < 3; c++)
+                row[c] = (unsigned char *) planes[c] + (size_t) y * p->width * bpp;
+            colour_row(ys, us, vs, p->width, p, row, simd);
+        }
+    }
+
+    free(base);
+    return 0;
+}
+
+int tensor_convert(const unsigned char *src, int layout, int srcWidth, int srcHeight,
+                   const struct tensor_params *p, void *dst)
+{
+    return convert(src, layout, srcWidth, srcHeight, p, dst, 1);
+}
+
+int tensor_convert_c(const unsigned char *src, int layout, int srcWidth, int srcHeight,
+                     const struct tensor_params *p, void *dst)
+{
+    return convert(src, layout, srcWidth, srcHeight, p, dst, 0);
+}
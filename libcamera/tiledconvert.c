@@ -0,0 +1,328 @@
+/*
+ *      This program is free software; you can redistribute it and/or modify
+ *      it under the terms of the GNU General Public License as published by
+ *      the Free Software Foundation; either version 2 of the License, or
+ *      (at your option) any later version.
+ *
+ * Cache-blocked YUYV converters for large frames.
+ *
+ * The frame is walked in two-row bands, and each band in column tiles
+ * small enough that the source rows stay in L1 while every requested
+ * output is produced from them. The next band is prefetched while the
+ * current one is converted. With CONVERT_DST_UNCACHED the outputs are
+ * written as whole cache lines only: streaming stores on SSE2, otherwise
+ * a cached tile buffer that is copied out in one burst.
+ *
+ * Other packed 4:2:2 byte orders are reordered to YUYV in registers as
+ * they are loaded, so they cost about the same as YUYV.
+ *
+ * RGB565 uses fixed point arithmetic and may differ from the floating
+ * point convertYUYVtoRGB565 by one unit per channel.
+ */
+
+#include <string.h>
+
+#include "convert.h"
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+/* pixels per tile; two source rows of a tile are 8 KB */
+#define TILE_WIDTH 1024
+#define CACHE_LINE 64
+
+/* BT.601 limited range, 2^14 fixed point */
+#define C_Y   19071
+#define C_RV  26149
+#define C_GU  6406
+#define C_GV  13320
+#define C_BU  33063
+
+static inline int clamp8(int v)
+{
+    return v > 255 ? 255 : (v < 0 ? 0 : v);
+}
+
+static inline unsigned short pack565(int r, int g, int b)
+{
+    return ((clamp8(r) >> 3) << 11) | ((clamp8(g) >> 2) << 5) | (clamp8(b) >> 3);
+}
+
+/* Byte offsets of Y0, U, Y1, V for each PACKED422_* order */
+static const unsigned char packed422_offsets[4][4] = {
+    { 0, 1, 2, 3 },     /* YUYV */
+    { 1, 0, 3, 2 },     /* UYVY */
+    { 0, 3, 2, 1 },     /* YVYU */
+    { 1, 2, 3, 0 },     /* VYUY */
+};
+
+static void rgb565_row_c(const unsigned char *src, int order, unsigned short *dst, int width)
+{
+    const unsigned char *o = packed422_offsets[order];
+    int x;
+
+    for (x = 0; x < width; x += 2) {
+        int y0 = (src[o[0]] - 16) * C_Y;
+        int y1 = (src[o[2]] - 16) * C_Y;
+        int u = src[o[1]] - 128;
+        int v = src[o[3]] - 128;
+        int dr = C_RV * v;
+        int dg = -C_GU * u - C_GV * v;
+        int db = C_BU * u;
+
+        dst[0] = pack565((y0 + dr) >> 14, (y0 + dg) >> 14, (y0 + db) >> 14);
+        dst[1] = pack565((y1 + dr) >> 14, (y1 + dg) >> 14, (y1 + db) >> 14);
+        src += 4;
+        dst += 2;
+    }
+}
+
+/* Interleaved chroma, V first unless nv12 */
+static void yuv420sp_rows_c(const unsigned char *src0, const unsigned char *src1, int order,
+                            unsigned char *y0, unsigned char *y1, unsigned char *vu,
+                            int width, int nv12)
+{
+    const unsigned char *o = packed422_offsets[order];
+    int x;
+
+    for (x = 0; x < width; x += 2) {
+        y0[x] = src0[o[0]];
+        y0[x + 1] = src0[o[2]];
+        y1[x] = src1[o[0]];
+        y1[x + 1] = src1[o[2]];
+        vu[x + nv12] = (src0[o[3]] + src1[o[3]]) >> 1;
+        vu[x + !nv12] = (src0[o[1]] + src1[o[1]]) >> 1;
+        src0 += 4;
+        src1 += 4;
+    }
+}
+
+#ifdef __SSE2__
+
+static inline void store16(unsigned char *dst, __m128i v, int stream)
+{
+    if (stream)
+        _mm_stream_si128((__m128i *) dst, v);
+    else
+        _mm_storeu_si128((__m128i *) dst, v);
+}
+
+/* Reorder 16 bytes of packed 4:2:2 into YUYV */
+static inline __m128i load_yuyv(const unsigned char *src, int order)
+{
+    __m128i v = _mm_loadu_si128((const __m128i *) src);
+
+    if (order & PACKED422_UYVY)
+        v = _mm_or_si128(_mm_slli_epi16(v, 8), _mm_srli_epi16(v, 8));
+    if (order & PACKED422_YVYU) {
+        const __m128i c = _mm_and_si128(v, _mm_set1_epi32(0xff00ff00));
+        v = _mm_or_si128(_mm_and_si128(v, _mm_set1_epi32(0x00ff00ff)),
+                         _mm_or_si128(_mm_slli_epi32(c, 16), _mm_srli_epi32(c, 16)));
+    }
+    return v;
+}
+
+/* 8 pixels (16 source bytes) to 8 RGB565 pixels */
+static inline __m128i rgb565_8(__m128i yuyv)
+{
+    const __m128i lo8 = _mm_set1_epi16(0x00ff);
+    const __m128i lo16 = _mm_set1_epi32(0x0000ffff);
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i max = _mm_set1_epi16(255);
+
+    /* 16 bit lanes, scaled by 32 so mulhi keeps two fraction bits */
+    __m128i y, uv, u, v, yt, r, g, b;
+
+    y = _mm_slli_epi16(_mm_sub_epi16(_mm_and_si128(yuyv, lo8), _mm_set1_epi16(16)), 5);
+    uv = _mm_sub_epi16(_mm_srli_epi16(yuyv, 8), _mm_set1_epi16(128));
+    u = _mm_and_si128(uv, lo16);
+    v = _mm_srli_epi32(uv, 16);
+    u = _mm_slli_epi16(_mm_or_si128(u, _mm_slli_epi32(u, 16)), 5);
+    v = _mm_slli_epi16(_mm_or_si128(v, _mm_slli_epi32(v, 16)), 5);
+
+    /* coefficients in 2^13 fixed point */
+    yt = _mm_mulhi_epi16(y, _mm_set1_epi16(9535));
+    r = _mm_add_epi16(yt, _mm_mulhi_epi16(v, _mm_set1_epi16(13074)));
+    g = _mm_sub_epi16(yt, _mm_add_epi16(_mm_mulhi_epi16(u, _mm_set1_epi16(3203)),
+                                        _mm_mulhi_epi16(v, _mm_set1_epi16(6660))));
+    b = _mm_add_epi16(yt, _mm_mulhi_epi16(u, _mm_set1_epi16(16531)));
+
+    r = _mm_min_epi16(_mm_max_epi16(_mm_srai_epi16(r, 2), zero), max);
+    g = _mm_min_epi16(_mm_max_epi16(_mm_srai_epi16(g, 2), zero), max);
+    b = _mm_min_epi16(_mm_max_epi16(_mm_srai_epi16(b, 2), zero), max);
+
+    return _mm_or_si128(_mm_or_si128(_mm_slli_epi16(_mm_srli_epi16(r, 3), 11),
+                                      _mm_slli_epi16(_mm_srli_epi16(g, 2), 5)),
+                        _mm_srli_epi16(b, 3));
+}
+
+static void rgb565_row_sse2(const unsigned char *src, int order, unsigned short *dst, int width, int stream)
+{
+    int x;
+
+    for (x = 0; x + 8 <= width; x += 8)
+        store16((unsigned char *) (dst + x), rgb565_8(load_yuyv(src + x * 2, order)), stream);
+    if (x < width)
+        rgb565_row_c(src + x * 2, order, dst + x, width - x);
+}
+
+static void yuv420sp_rows_sse2(const unsigned char *src0, const unsigned char *src1, int order,
+                               unsigned char *y0, unsigned char *y1, unsigned char *vu,
+                               int width, int nv12, int stream)
+{
+    const __m128i lo8 = _mm_set1_epi16(0x00ff);
+    int x;
+
+    for (x = 0; x + 16 <= width; x += 16) {
+        __m128i a0 = load_yuyv(src0 + x * 2, order);
+        __m128i a1 = load_yuyv(src0 + x * 2 + 16, order);
+        __m128i b0 = load_yuyv(src1 + x * 2, order);
+        __m128i b1 = load_yuyv(src1 + x * 2 + 16, order);
+        /* truncating average of U V from both rows, then swap to V U for NV21 */
+        __m128i c0 = _mm_srli_epi16(_mm_add_epi16(_mm_srli_epi16(a0, 8), _mm_srli_epi16(b0, 8)), 1);
+        __m128i c1 = _mm_srli_epi16(_mm_add_epi16(_mm_srli_epi16(a1, 8), _mm_srli_epi16(b1, 8)), 1);
+
+        store16(y0 + x, _mm_packus_epi16(_mm_and_si128(a0, lo8), _mm_and_si128(a1, lo8)), stream);
+        store16(y1 + x, _mm_packus_epi16(_mm_and_si128(b0, lo8), _mm_and_si128(b1, lo8)), stream);
+
+        if (!nv12) {
+            c0 = _mm_shufflehi_epi16(_mm_shufflelo_epi16(c0, _MM_SHUFFLE(2, 3, 0, 1)), _MM_SHUFFLE(2, 3, 0, 1));
+            c1 = _mm_shufflehi_epi16(_mm_shufflelo_epi16(c1, _MM_SHUFFLE(2, 3, 0, 1)), _MM_SHUFFLE(2, 3, 0, 1));
+        }
+        store16(vu + x, _mm_packus_epi16(c0, c1), stream);
+    }
+    if (x < width)
+        yuv420sp_rows_c(src0 + x * 2, src1 + x * 2, order, y0 + x, y1 + x, vu + x, width - x, nv12);
+}
+
+#endif /* __SSE2__ */
+
+static inline void prefetch_rows(const unsigned char *src0, const unsigned char *src1, int bytes)
+{
+    int i;
+
+    for (i = 0; i < bytes; i += CACHE_LINE) {
+        __builtin_prefetch(src0 + i, 0, 3);
+        __builtin_prefetch(src1 + i, 0, 3);
+    }
+}
+
+static void rgb565_tile(const unsigned char *src, int order, unsigned char *dst, int width, int uncached)
+{
+#ifdef __SSE2__
+    rgb565_row_sse2(src, order, (unsigned short *) dst, width, uncached && !((unsigned long) dst & 15));
+#else
+    if (uncached) {
+        unsigned short tile[TILE_WIDTH];
+        rgb565_row_c(src, order, tile, width);
+        memcpy(dst, tile, width * 2);
+    } else {
+        rgb565_row_c(src, order, (unsigned short *) dst, width);
+    }
+#endif
+}
+
+static void yuv420sp_tile(const unsigned char *src0, const unsigned char *src1, int order,
+                          unsigned char *y0, unsigned char *y1, unsigned char *vu,
+                          int width, int nv12, int uncached)
+{
+#ifdef __SSE2__
+    yuv420sp_rows_sse2(src0, src1, order, y0, y1, vu, width, nv12,
+                       uncached && !(((unsigned long) y0 | (unsigned long) y1 | (unsigned long) vu) & 15));
+#else
+    if (uncached) {
+        unsigned char tile[3][TILE_WIDTH];
+        yuv420sp_rows_c(src0, src1, order, tile[0], tile[1], tile[2], width, nv12);
+        memcpy(y0, tile[0], width);
+        memcpy(y1, tile[1], width);
+        memcpy(vu, tile[2], width);
+    } else {
+        yuv420sp_rows_c(src0, src1, order, y0, y1, vu, width, nv12);
+    }
+#endif
+}
+
+void convertPacked422_tiled(unsigned char *buf, int order, unsigned char *rgb565,
+                            unsigned char *yuv420sp, int width, int height, int flags)
+{
+    int uncached = flags & CONVERT_DST_UNCACHED;
+    int nv12 = (flags & CONVERT_NV12) != 0;
+    unsigned char *vu = yuv420sp ? yuv420sp + width * height : NULL;
+    int y, x;
+
+    for (y = 0; y < height; y += 2) {
+        const unsigned char *src0 = buf + y * width * 2;
+        const unsigned char *src1 = src0 + width * 2;
+        int last = y + 2 >= height;
+
+        for (x = 0; x < width; x += TILE_WIDTH) {
+            int w = width - x < TILE_WIDTH ? width - x : TILE_WIDTH;
+
+            if (!last)
+                prefetch_rows(src0 + width * 4 + x * 2, src1 + width * 4 + x * 2, w * 2);
+
+            if (rgb565) {
+                rgb565_tile(src0 + x * 2, order, rgb565 + (y * width + x) * 2, w, uncached);
+                rgb565_tile(src1 + x * 2, order, rgb565 + ((y + 1) * width + x) * 2, w, uncached);
+            }
+            if (yuv420sp)
+                yuv420sp_tile(src0 + x * 2, src1 + x * 2, order,
+                              yuv420sp + y * width + x, yuv420sp + (y + 1) * width + x,
+                              vu + (y / 2) * width + x, w, nv12, uncached);
+        }
+    }
+
+#ifdef __SSE2__
+    if (uncached)
+        _mm_sfence();
+#endif
+}
+
+void convertPacked422_window(const unsigned char *buf, int order, int srcWidth, int x0, int y0,
+                             unsigned char *yuv420sp, int width, int height, int flags)
+{
+    int uncached = flags & CONVERT_DST_UNCACHED;
+    int nv12 = (flags & CONVERT_NV12) != 0;
+    unsigned char *vu = yuv420sp + width * height;
+    int stride = srcWidth * 2;
+    int y, x;
+
+    buf += (size_t) y0 * stride + x0 * 2;
+    for (y = 0; y < height; y += 2) {
+        const unsigned char *src0 = buf + (size_t) y * stride;
+        const unsigned char *src1 = src0 + stride;
+        int last = y + 2 >= height;
+
+        for (x = 0; x < width; x += TILE_WIDTH) {
+            int w = width - x < TILE_WIDTH ? width - x : TILE_WIDTH;
+
+            if (!last)
+                prefetch_rows(src0 + stride * 2 + x * 2, src1 + stride * 2 + x * 2, w * 2);
+            yuv420sp_tile(src0 + x * 2, src1 + x * 2, order,
+                          yuv420sp + y * width + x, yuv420sp + (y + 1) * width + x,
+                          vu + (y / 2) * width + x, w, nv12, uncached);
+        }
+    }
+
+#ifdef __SSE2__
+    if (uncached)
+        _mm_sfence();
+#endif
+}
+
+void convertYUYV_tiled(unsigned char *buf, unsigned char *rgb565, unsigned char *yuv420sp,
+                       int width, int height, int flags)
+{
+    convertPacked422_tiled(buf, PACKED422_YUYV, rgb565, yuv420sp, width, height, flags);
+}
+
+void convertYUYVtoRGB565_tiled(unsigned char *buf, unsigned char *rgb, int width, int height, int flags)
+{
+    convertYUYV_tiled(buf, rgb, NULL, width, height, flags);
+}
+
+void yuyv422_to_yuv420sp_tiled(unsigned char *in, unsigned char *out, int width, int height, int flags)
+{
+    convertYUYV_tiled(in, NULL, out, width, height, flags);
+}
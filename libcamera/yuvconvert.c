@@ -0,0 +1,47 @@
+/*
+ *      This program is free software; you can redistribute it and/or modify
+ *      it under the terms of the GNU General Public License as published by
+ *      the Free Software Foundation; either version 2 of the License, or
+ *      (at your option) any later version.
+ *
+ * Portable version of the YUYV -> YUV420SP kernel in convert.S. It produces
+ * the same output as the NEON code (chroma of each row pair averaged with
+ * truncation, V before U) so either can feed the preview callback.
+ */
+
+#include "convert.h"
+
+void yuyv422_to_yuv420sp_c(unsigned char *in, unsigned char *out, int width, int height)
+{
+    unsigned char *in1 = in + width * 2;
+    unsigned char *out1 = out + width;
+    unsigned char *uv = out + width * height;
+    int x, y;
+
+    for (y = 0; y < height; y += 2) {
+        for (x = 0; x < width * 2; x += 4) {
+            out[0] = in[x + 0];
+            out[1] = in[x + 2];
+            out1[0] = in1[x + 0];
+            out1[1] = in1[x + 2];
+            uv[0] = (in[x + 3] + in1[x + 3]) >> 1;
+            uv[1] = (in[x + 1] + in1[x + 1]) >> 1;
+            out += 2;
+            out1 += 2;
+            uv += 2;
+        }
+        in += width * 4;
+        in1 += width * 4;
+        out += width;
+        out1 += width;
+    }
+}
+
+void yuyv422_to_yuv420sp(unsigned char *in, unsigned char *out, int width, int height)
+{
+#ifdef HAVE_NEON_CONVERT
+    yuyv422_to_yuv420sp_neon(in, out, width, height);
+#else
+    yuyv422_to_yuv420sp_c(in, out, width, height);
+#endif
+}